@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * This file is shared between libc and the kernel, so don't put anything
+ * in here that won't work in both contexts.
+ */
+
+#ifdef _KERNEL
+#include <types.h>
+#include <lib.h>
+#include <endian.h>
+#else
+#include <stdint.h>
+#include <string.h>
+#include <sys/endian.h>
+#endif
+
+/*
+ * C standard function - copy a block of memory. MIPS version.
+ *
+ * The portable version in common/libc/string copies by words only
+ * when both pointers and the length are word-aligned. This one
+ * copies head bytes until the destination is word-aligned, moves the
+ * middle by words, and finishes with the tail bytes.
+ *
+ * When the source is then also aligned, the middle goes in bursts of
+ * eight words: eight loads and then eight stores, so no load has its
+ * result needed by the next instruction. If it isn't, each
+ * destination word is put together from two aligned source words
+ * with shifts. That way we never do an unaligned load, which MIPS
+ * doesn't allow. Every source word we load holds at least one byte
+ * we were asked to copy, so we never touch a page outside the source.
+ *
+ * Whole pages, and anything else that's burst-aligned at both ends,
+ * go straight to the burst loop.
+ */
+
+#define WORDSIZE	sizeof(uint32_t)
+#define BURSTSIZE	(8 * WORDSIZE)
+#define SHORTCOPY	16	/* below this, just copy bytes */
+
+/*
+ * Copy LEN bytes, a multiple of BURSTSIZE, between word-aligned
+ * buffers.
+ */
+static
+inline
+void
+copybursts(uint32_t *d, const uint32_t *s, size_t len)
+{
+	uint32_t t0, t1, t2, t3, t4, t5, t6, t7;
+
+	for (; len > 0; len -= BURSTSIZE) {
+		t0 = s[0]; t1 = s[1]; t2 = s[2]; t3 = s[3];
+		t4 = s[4]; t5 = s[5]; t6 = s[6]; t7 = s[7];
+		d[0] = t0; d[1] = t1; d[2] = t2; d[3] = t3;
+		d[4] = t4; d[5] = t5; d[6] = t6; d[7] = t7;
+		s += 8;
+		d += 8;
+	}
+}
+
+void *
+memcpy(void *dst, const void *src, size_t len)
+{
+	unsigned char *d = dst;
+	const unsigned char *s = src;
+	uint32_t *dw;
+	const uint32_t *sw;
+	uint32_t cur, next;
+	unsigned shift;
+
+	/*
+	 * memcpy does not support overlapping buffers, so always do it
+	 * forwards. (Don't change this without adjusting memmove.)
+	 */
+
+	if ((((uintptr_t)d | (uintptr_t)s | len) & (BURSTSIZE - 1)) == 0) {
+		copybursts(dst, src, len);
+		return dst;
+	}
+
+	if (len >= SHORTCOPY) {
+		/* Head: bytes until the destination is aligned. */
+		while ((uintptr_t)d % WORDSIZE != 0) {
+			*d++ = *s++;
+			len--;
+		}
+		dw = (uint32_t *)d;
+
+		if ((uintptr_t)s % WORDSIZE == 0) {
+			sw = (const uint32_t *)s;
+			copybursts(dw, sw, len & ~(BURSTSIZE - 1));
+			dw += (len & ~(BURSTSIZE - 1)) / WORDSIZE;
+			sw += (len & ~(BURSTSIZE - 1)) / WORDSIZE;
+			len &= BURSTSIZE - 1;
+			while (len >= WORDSIZE) {
+				*dw++ = *sw++;
+				len -= WORDSIZE;
+			}
+			s = (const unsigned char *)sw;
+		}
+		else {
+			shift = 8 * ((uintptr_t)s % WORDSIZE);
+			sw = (const uint32_t *)((uintptr_t)s & ~(WORDSIZE - 1));
+			cur = *sw++;
+			while (len >= WORDSIZE) {
+				next = *sw++;
+#if _BYTE_ORDER == _BIG_ENDIAN
+				*dw++ = (cur << shift) | (next >> (32 - shift));
+#else
+				*dw++ = (cur >> shift) | (next << (32 - shift));
+#endif
+				cur = next;
+				len -= WORDSIZE;
+			}
+			s = (const unsigned char *)sw - WORDSIZE + shift / 8;
+		}
+		d = (unsigned char *)dw;
+	}
+
+	/* Tail (or the whole thing, if it's short). */
+	while (len > 0) {
+		*d++ = *s++;
+		len--;
+	}
+
+	return dst;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * This file is shared between libc and the kernel, so don't put anything
+ * in here that won't work in both contexts.
+ */
+
+#ifdef _KERNEL
+#include <types.h>
+#include <lib.h>
+#else
+#include <stdint.h>
+#include <string.h>
+#endif
+
+/*
+ * C standard function - copy a block of memory, handling overlapping
+ * regions correctly. MIPS version.
+ *
+ * Unless the destination overlaps the end of the source, copying
+ * forwards is safe and memcpy does it. (As author/maintainer of
+ * libc, take advantage of the fact that we know memcpy copies
+ * forwards.) Otherwise copy back to front: tail bytes until the end
+ * of the destination is word-aligned, then the middle in bursts of
+ * eight words if the source end is aligned too, then the head bytes.
+ * Overlapping moves by a non-multiple of the word size are rare
+ * enough that they just go by bytes.
+ */
+
+#define WORDSIZE	sizeof(uint32_t)
+#define BURSTSIZE	(8 * WORDSIZE)
+#define SHORTCOPY	16	/* below this, just copy bytes */
+
+void *
+memmove(void *dst, const void *src, size_t len)
+{
+	unsigned char *d;
+	const unsigned char *s;
+	uint32_t *dw;
+	const uint32_t *sw;
+	uint32_t t0, t1, t2, t3, t4, t5, t6, t7;
+
+	if ((uintptr_t)dst <= (uintptr_t)src ||
+	    (uintptr_t)dst >= (uintptr_t)src + len) {
+		return memcpy(dst, src, len);
+	}
+
+	/* Work backwards from the ends. */
+	d = (unsigned char *)dst + len;
+	s = (const unsigned char *)src + len;
+
+	if (len >= SHORTCOPY &&
+	    ((uintptr_t)d - (uintptr_t)s) % WORDSIZE == 0) {
+		while ((uintptr_t)d % WORDSIZE != 0) {
+			*--d = *--s;
+			len--;
+		}
+		dw = (uint32_t *)d;
+		sw = (const uint32_t *)s;
+		for (; len >= BURSTSIZE; len -= BURSTSIZE) {
+			sw -= 8;
+			dw -= 8;
+			t7 = sw[7]; t6 = sw[6]; t5 = sw[5]; t4 = sw[4];
+			t3 = sw[3]; t2 = sw[2]; t1 = sw[1]; t0 = sw[0];
+			dw[7] = t7; dw[6] = t6; dw[5] = t5; dw[4] = t4;
+			dw[3] = t3; dw[2] = t2; dw[1] = t1; dw[0] = t0;
+		}
+		for (; len >= WORDSIZE; len -= WORDSIZE) {
+			*--dw = *--sw;
+		}
+		d = (unsigned char *)dw;
+		s = (const unsigned char *)sw;
+	}
+
+	while (len > 0) {
+		*--d = *--s;
+		len--;
+	}
+
+	return dst;
+}
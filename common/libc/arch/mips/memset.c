@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * This file is shared between libc and the kernel, so don't put anything
+ * in here that won't work in both contexts.
+ */
+
+#ifdef _KERNEL
+#include <types.h>
+#include <lib.h>
+#else
+#include <stdint.h>
+#include <string.h>
+#endif
+
+/*
+ * C standard function - initialize a block of memory. MIPS version.
+ *
+ * Like memcpy: head bytes until the pointer is word-aligned, then
+ * the middle in bursts of eight word stores, then words, then the
+ * tail bytes. Whole pages go straight to the burst loop.
+ */
+
+#define WORDSIZE	sizeof(uint32_t)
+#define BURSTSIZE	(8 * WORDSIZE)
+#define SHORTSET	16	/* below this, just store bytes */
+
+void *
+memset(void *ptr, int ch, size_t len)
+{
+	unsigned char *p = ptr;
+	uint32_t *pw;
+	uint32_t val;
+
+	val = (unsigned char)ch;
+	val |= val << 8;
+	val |= val << 16;
+
+	if (len >= SHORTSET) {
+		while ((uintptr_t)p % WORDSIZE != 0) {
+			*p++ = ch;
+			len--;
+		}
+		pw = (uint32_t *)p;
+		for (; len >= BURSTSIZE; len -= BURSTSIZE) {
+			pw[0] = val; pw[1] = val; pw[2] = val; pw[3] = val;
+			pw[4] = val; pw[5] = val; pw[6] = val; pw[7] = val;
+			pw += 8;
+		}
+		for (; len >= WORDSIZE; len -= WORDSIZE) {
+			*pw++ = val;
+		}
+		p = (unsigned char *)pw;
+	}
+
+	while (len > 0) {
+		*p++ = ch;
+		len--;
+	}
+
+	return ptr;
+}
@@ -36,9 +36,12 @@
 #include <types.h>
 #include <lib.h>
 #else
+#include <stdint.h>
 #include <string.h>
 #endif
 
+#include "strword.h"
+
 /*
  * Standard C string function: compare two strings and return their
  * sort order.
@@ -47,8 +50,35 @@
 int
 strcmp(const char *a, const char *b)
 {
+	const uint32_t *wa, *wb;
 	size_t i;
 
+	/*
+	 * If the strings are aligned the same way, skip the part
+	 * that's the same a word at a time, stopping at any word that
+	 * differs or holds the end of A. Then finish by bytes.
+	 */
+	if ((uintptr_t)a % sizeof(uint32_t) ==
+	    (uintptr_t)b % sizeof(uint32_t)) {
+		while (!WORDALIGNED(a)) {
+			if (*a == 0 || *a != *b) {
+				break;
+			}
+			a++;
+			b++;
+		}
+		if (WORDALIGNED(a)) {
+			wa = (const uint32_t *)a;
+			wb = (const uint32_t *)b;
+			while (*wa == *wb && !HASZERO(*wa)) {
+				wa++;
+				wb++;
+			}
+			a = (const char *)wa;
+			b = (const char *)wb;
+		}
+	}
+
 	/*
 	 * Walk down both strings until either they're different
 	 * or we hit the end of A.
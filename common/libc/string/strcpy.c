@@ -36,28 +36,57 @@
 #include <types.h>
 #include <lib.h>
 #else
+#include <stdint.h>
 #include <string.h>
 #endif
 
+#include "strword.h"
+
 /*
  * Standard C string function: copy one string to another.
  */
 char *
 strcpy(char *dest, const char *src)
 {
+	char *d = dest;
+	uint32_t *wd;
+	const uint32_t *ws;
 	size_t i;
 
+	/*
+	 * If the strings are aligned the same way, copy by words
+	 * until the word holding the null terminator. We never store
+	 * past the terminator.
+	 */
+	if ((uintptr_t)d % sizeof(uint32_t) ==
+	    (uintptr_t)src % sizeof(uint32_t)) {
+		while (!WORDALIGNED(src)) {
+			if ((*d = *src) == 0) {
+				return dest;
+			}
+			d++;
+			src++;
+		}
+		wd = (uint32_t *)d;
+		ws = (const uint32_t *)src;
+		while (!HASZERO(*ws)) {
+			*wd++ = *ws++;
+		}
+		d = (char *)wd;
+		src = (const char *)ws;
+	}
+
 	/*
 	 * Copy characters until we hit the null terminator.
 	 */
 	for (i=0; src[i]; i++) {
-		dest[i] = src[i];
+		d[i] = src[i];
 	}
 
 	/*
 	 * Add null terminator to result.
 	 */
-	dest[i] = 0;
+	d[i] = 0;
 
 	return dest;
 }
@@ -36,9 +36,12 @@
 #include <types.h>
 #include <lib.h>
 #else
+#include <stdint.h>
 #include <string.h>
 #endif
 
+#include "strword.h"
+
 /*
  * C standard string function: get length of a string
  */
@@ -46,10 +49,23 @@
 size_t
 strlen(const char *str)
 {
-	size_t ret = 0;
+	const char *s = str;
+	const uint32_t *w;
+
+	/* Check bytes until we're word-aligned, then whole words. */
+	while (!WORDALIGNED(s)) {
+		if (*s == 0) {
+			return s - str;
+		}
+		s++;
+	}
+	for (w = (const uint32_t *)s; !HASZERO(*w); w++) {
+		/* nothing */
+	}
 
-	while (str[ret]) {
-		ret++;
+	/* Find the terminator within the last word. */
+	for (s = (const char *)w; *s != 0; s++) {
+		/* nothing */
 	}
-	return ret;
+	return s - str;
 }
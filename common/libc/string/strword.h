@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _STRWORD_H_
+#define _STRWORD_H_
+
+/*
+ * Helpers for scanning strings a word at a time, shared by the
+ * string functions here and the kernel's copyinstr/copyoutstr. Like
+ * the files that include it, this must work in both the kernel and
+ * libc; the includer supplies uint32_t and uintptr_t.
+ *
+ * Only aligned words are ever loaded. An aligned word never
+ * straddles a page, so reading a whole word that holds the
+ * terminator can't fault where reading it a byte at a time wouldn't.
+ */
+
+/* True if the pointer P is word-aligned. */
+#define WORDALIGNED(p) ((uintptr_t)(p) % sizeof(uint32_t) == 0)
+
+/*
+ * Nonzero if any byte of the 32-bit word X is zero: subtracting 1
+ * from each byte borrows into the high bit only for bytes that were
+ * zero (or had the high bit set, which ~X rules out).
+ */
+#define HASZERO(x) (((x) - 0x01010101U) & ~(x) & 0x80808080U)
+
+#endif /* _STRWORD_H_ */
@@ -111,6 +111,23 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0,
+				     tf->tf_a1,
+				     (const_userptr_t)tf->tf_a2);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0,
+				     tf->tf_a1,
+				     &retval);
+		break;
+
 	    /* Add stuff here */
 		case SYS_open:
 		err = sys_open(
@@ -131,6 +148,10 @@ syscall(struct trapframe *tf)
 		err = sys_close(tf->tf_a0);
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
 	    case SYS_read:
 		err = sys_read(
 			tf->tf_a0,
@@ -145,6 +166,45 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_pread:
+	    case SYS_pwrite:
+		{
+			/*
+			 * The position is 64 bits wide and has to be
+			 * aligned, so it skips a3 and goes on the stack
+			 * at sp+16.
+			 */
+			uint64_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(pos));
+			if (err) {
+				break;
+			}
+
+			err = (callno == SYS_pread) ?
+				sys_pread(tf->tf_a0, (userptr_t)tf->tf_a1,
+					  tf->tf_a2, pos, &retval) :
+				sys_pwrite(tf->tf_a0, (userptr_t)tf->tf_a1,
+					   tf->tf_a2, pos, &retval);
+		}
+		break;
+
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+
 	    case SYS_lseek:
 		{
 			/*
@@ -178,6 +238,37 @@ syscall(struct trapframe *tf)
 		}
 		break;
 
+	    case SYS_ioctl:
+		err = sys_ioctl(tf->tf_a0, tf->tf_a1, (userptr_t)tf->tf_a2);
+		break;
+
+	    case SYS_poll:
+		err = sys_poll(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+
+	    case SYS_select:
+		{
+			/* The fifth argument goes on the stack at sp+16. */
+			userptr_t timeout;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &timeout, sizeof(timeout));
+			if (err) {
+				break;
+			}
+
+			err = sys_select(tf->tf_a0,
+					 (userptr_t)tf->tf_a1,
+					 (userptr_t)tf->tf_a2,
+					 (userptr_t)tf->tf_a3,
+					 timeout, &retval);
+		}
+		break;
+
 	    case SYS_chdir:
 		err = sys_chdir((userptr_t)tf->tf_a0);
 		break;
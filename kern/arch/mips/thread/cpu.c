@@ -278,6 +278,22 @@ wait(void)
 	      );
 }
 
+/*
+ * Read the cycle counter (c0_count).
+ */
+uint32_t
+cpu_cycles(void)
+{
+	uint32_t count;
+
+	__asm volatile(".set push;"		/* save assembler mode */
+		       ".set mips32;"		/* allow mips32 registers */
+		       "mfc0 %0,$9;"		/* get c0_count */
+		       ".set pop"		/* restore assembler mode */
+		       : "=r" (count));
+	return count;
+}
+
 /*
  * Idle the processor until something happens.
  */
@@ -52,6 +52,15 @@
  */
 #define CPU_FREQUENCY 25000000 /* 25 MHz */
 
+/* Cycles per hardclock, and the most hardclocks one timer can span */
+#define TIMER_PERIOD    (CPU_FREQUENCY / HZ)
+#define TIMER_MAXTICKS  (0xffffffffU / TIMER_PERIOD)
+
+/* Wiring of LAMEbus interrupts to bits in the cause register */
+#define LAMEBUS_IRQ_BIT  0x00000400	/* all system bus slots */
+#define LAMEBUS_IPI_BIT  0x00000800	/* inter-processor interrupt */
+#define MIPS_TIMER_BIT   0x00008000	/* on-chip timer */
+
 /*
  * Access to the on-chip timer.
  *
@@ -75,6 +84,20 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Read the cause register, to check for a pending timer interrupt.
+ */
+static
+uint32_t
+mips_cause_get(void)
+{
+	uint32_t cause;
+
+	/* $13 == c0_cause */
+	__asm volatile("mfc0 %0, $13" : "=r" (cause));
+	return cause;
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -115,7 +138,52 @@ mainbus_bootstrap(void)
 	/*
 	 * Configure the MIPS on-chip timer to interrupt HZ times a second.
 	 */
-	mips_timer_set(CPU_FREQUENCY / HZ);
+	mips_timer_set(TIMER_PERIOD);
+}
+
+/*
+ * Tickless idle.
+ *
+ * c0_count restarts from zero each time it reaches c0_compare, so
+ * while ticking normally it counts the cycles since the last
+ * hardclock. Raising c0_compare to a multiple of the period thus
+ * moves the next interrupt out to a later tick boundary without
+ * losing our place.
+ */
+unsigned
+mainbus_timer_skip(unsigned ticks)
+{
+	if (mips_cause_get() & MIPS_TIMER_BIT) {
+		/* A tick is already due; writing c0_compare would lose it. */
+		return 0;
+	}
+	if (ticks > TIMER_MAXTICKS) {
+		ticks = TIMER_MAXTICKS;
+	}
+	mips_timer_set(ticks * TIMER_PERIOD);
+	return ticks;
+}
+
+unsigned
+mainbus_timer_resume(unsigned ticks)
+{
+	unsigned passed;
+
+	if (mips_cause_get() & MIPS_TIMER_BIT) {
+		/*
+		 * It went off after all; the interrupt will call
+		 * hardclock for the last tick and reset the period.
+		 */
+		return ticks - 1;
+	}
+
+	/*
+	 * Take the interrupt at the next tick boundary. It resets
+	 * the timer to the normal period.
+	 */
+	passed = cpu_cycles() / TIMER_PERIOD;
+	mips_timer_set((passed + 1) * TIMER_PERIOD);
+	return passed;
 }
 
 /*
@@ -279,11 +347,6 @@ mainbus_send_ipi(struct cpu *target)
  * Interrupt dispatcher.
  */
 
-/* Wiring of LAMEbus interrupts to bits in the cause register */
-#define LAMEBUS_IRQ_BIT  0x00000400	/* all system bus slots */
-#define LAMEBUS_IPI_BIT  0x00000800	/* inter-processor interrupt */
-#define MIPS_TIMER_BIT   0x00008000	/* on-chip timer */
-
 void
 mainbus_interrupt(struct trapframe *tf)
 {
@@ -305,7 +368,7 @@ mainbus_interrupt(struct trapframe *tf)
 	}
 	if (cause & MIPS_TIMER_BIT) {
 		/* Reset the timer (this clears the interrupt) */
-		mips_timer_set(CPU_FREQUENCY / HZ);
+		mips_timer_set(TIMER_PERIOD);
 		/* and call hardclock */
 		hardclock();
 		seen = true;
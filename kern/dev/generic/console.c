@@ -49,12 +49,14 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <poll.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -72,6 +74,11 @@ static struct con_softc *the_console = NULL;
 static struct lock *con_userlock_read = NULL;
 static struct lock *con_userlock_write = NULL;
 
+/*
+ * Processes in poll() waiting for input.
+ */
+static struct pollhead con_pollhead;
+
 //////////////////////////////////////////////////
 
 /*
@@ -149,6 +156,56 @@ getch_intr(struct con_softc *cs)
 	return ret;
 }
 
+/*
+ * Check if there's input waiting, so getch_intr won't block.
+ *
+ * We don't synchronize with con_input; it only ever advances
+ * gotchars_head, so the worst that can happen is that we miss a
+ * character that's just arriving.
+ */
+static
+bool
+con_inputready(struct con_softc *cs)
+{
+	return cs->cs_gotchars_head != cs->cs_gotchars_tail;
+}
+
+/*
+ * Check if the input buffer is full, so con_input is dropping
+ * characters. Same synchronization caveats as con_inputready.
+ */
+static
+bool
+con_inputfull(struct con_softc *cs)
+{
+	return (cs->cs_gotchars_head + 1) % CONSOLE_INPUT_BUFFER_SIZE
+		== cs->cs_gotchars_tail;
+}
+
+/*
+ * Check if a read will complete without blocking: that is, if a
+ * whole line is buffered, or the buffer is full (see con_io).
+ */
+static
+bool
+con_lineready(struct con_softc *cs)
+{
+	unsigned i;
+	unsigned char ch;
+
+	if (con_inputfull(cs)) {
+		return true;
+	}
+	for (i = cs->cs_gotchars_tail; i != cs->cs_gotchars_head;
+	     i = (i + 1) % CONSOLE_INPUT_BUFFER_SIZE) {
+		ch = cs->cs_gotchars[i];
+		if (ch == '\n' || ch == '\r') {
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * Called from underlying device when a read-ready interrupt occurs.
  *
@@ -174,6 +231,7 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+	pollhead_wakeup(&con_pollhead);
 }
 
 /*
@@ -247,6 +305,7 @@ con_io(struct device *dev, struct uio *uio)
 	int result;
 	char ch;
 	struct lock *lk;
+	bool overflow;
 
 	(void)dev;  // unused
 
@@ -260,6 +319,14 @@ con_io(struct device *dev, struct uio *uio)
 	KASSERT(lk != NULL);
 	lock_acquire(lk);
 
+	/*
+	 * Reads normally wait for a whole line. But if the input
+	 * buffer has filled up without one, no newline can arrive
+	 * until it's drained; in that case return what's buffered.
+	 * This is also what con_poll promises.
+	 */
+	overflow = uio->uio_rw == UIO_READ && con_inputfull(the_console);
+
 	while (uio->uio_resid > 0) {
 		if (uio->uio_rw==UIO_READ) {
 			ch = getch();
@@ -274,6 +341,9 @@ con_io(struct device *dev, struct uio *uio)
 			if (ch=='\n') {
 				break;
 			}
+			if (overflow && !con_inputready(the_console)) {
+				break;
+			}
 		}
 		else {
 			result = uiomove(&ch, 1, uio);
@@ -302,10 +372,31 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Poll. The console is readable when a read won't block: when a
+ * whole line is buffered (or the buffer is full). It's always
+ * writable, as output only waits for the hardware.
+ */
+static
+int
+con_poll(struct device *dev, struct pollwait *pw, int *revents)
+{
+	(void)dev;
+
+	pollhead_register(&con_pollhead, pw);
+
+	*revents = POLLOUT | POLLWRNORM;
+	if (con_lineready(the_console)) {
+		*revents |= POLLIN | POLLRDNORM;
+	}
+	return 0;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -386,6 +477,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollhead_init(&con_pollhead);
 
 	the_console = cs;
 	con_userlock_read = rlk;
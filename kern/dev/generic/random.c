@@ -30,7 +30,11 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
 #include <uio.h>
 #include <vfs.h>
 #include <generic/random.h>
@@ -42,6 +46,11 @@
  * Remembers something that's a random source, and provides random()
  * and randmax() to the rest of the kernel.
  *
+ * Reading the hardware source costs a bus transaction per word, so
+ * random() and reads of random: actually come from a per-cpu
+ * xoshiro128** generator, which is reseeded from the hardware every
+ * RESEED_INTERVAL outputs.
+ *
  * The kernel config mechanism can be used to explicitly choose which
  * of the available random sources to use, if more than one is
  * available.
@@ -49,6 +58,93 @@
 
 static struct random_softc *the_random = NULL;
 
+#define RESEED_INTERVAL 4096
+
+/* Bytes generated at a time for reads of random: */
+#define READCHUNK 128
+
+/*
+ * Mix fresh hardware randomness into the current cpu's generator.
+ * Interrupts must be off.
+ */
+static
+void
+random_reseed(void)
+{
+	uint32_t *s = curcpu->c_randstate;
+	unsigned i;
+
+	if (the_random==NULL) {
+		panic("No random device\n");
+	}
+	for (i=0; i<4; i++) {
+		s[i] ^= the_random->rs_random(the_random->rs_devdata);
+	}
+	if (s[0] == 0 && s[1] == 0 && s[2] == 0 && s[3] == 0) {
+		/* The one state xoshiro can't leave. */
+		s[0] = 0x9e3779b9;
+	}
+	curcpu->c_randleft = RESEED_INTERVAL;
+}
+
+static
+uint32_t
+rotl(uint32_t x, unsigned k)
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+/*
+ * One step of xoshiro128** on the current cpu's state. Interrupts
+ * must be off, so we neither migrate nor get interleaved with an
+ * interrupt handler on this cpu.
+ */
+static
+uint32_t
+random_next(void)
+{
+	uint32_t *s = curcpu->c_randstate;
+	uint32_t result, t;
+
+	if (curcpu->c_randleft == 0) {
+		random_reseed();
+	}
+	curcpu->c_randleft--;
+
+	result = rotl(s[1] * 5, 7) * 9;
+	t = s[1] << 9;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 11);
+	return result;
+}
+
+/*
+ * Fill BUF with LEN random bytes.
+ */
+static
+void
+random_fill(void *buf, size_t len)
+{
+	char *p = buf;
+	uint32_t val;
+	size_t n;
+	int spl;
+
+	spl = splhigh();
+	while (len > 0) {
+		val = random_next();
+		n = len < sizeof(val) ? len : sizeof(val);
+		memcpy(p, &val, n);
+		p += n;
+		len -= n;
+	}
+	splx(spl);
+}
+
 /*
  * VFS device functions.
  * open: allow reading only.
@@ -67,19 +163,32 @@ randeachopen(struct device *dev, int openflags)
 }
 
 /*
- * VFS I/O function. Hand off to implementation.
+ * VFS I/O function. Generate a chunk at a time with interrupts off,
+ * then copy it out with them on.
  */
 static
 int
 randio(struct device *dev, struct uio *uio)
 {
-	struct random_softc *rs = dev->d_data;
+	char buf[READCHUNK];
+	size_t n;
+	int result;
+
+	(void)dev;
 
 	if (uio->uio_rw != UIO_READ) {
 		return EIO;
 	}
 
-	return rs->rs_read(rs->rs_devdata, uio);
+	while (uio->uio_resid > 0) {
+		n = uio->uio_resid < sizeof(buf) ? uio->uio_resid : sizeof(buf);
+		random_fill(buf, n);
+		result = uiomove(buf, n, uio);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
 }
 
 /*
@@ -98,10 +207,24 @@ randioctl(struct device *dev, int op, userptr_t data)
 	return EIOCTL;
 }
 
+/*
+ * VFS poll function. Random numbers are always available.
+ */
+static
+int
+randpoll(struct device *dev, struct pollwait *pw, int *revents)
+{
+	(void)dev;
+	(void)pw;
+	*revents = POLLIN | POLLRDNORM;
+	return 0;
+}
+
 static const struct device_ops random_devops = {
 	.devop_eachopen = randeachopen,
 	.devop_io = randio,
 	.devop_ioctl = randioctl,
+	.devop_poll = randpoll,
 };
 
 /*
@@ -142,10 +265,13 @@ config_random(struct random_softc *rs, int unit)
 uint32_t
 random(void)
 {
-	if (the_random==NULL) {
-		panic("No random device\n");
-	}
-	return the_random->rs_random(the_random->rs_devdata);
+	uint32_t val;
+	int spl;
+
+	spl = splhigh();
+	val = random_next();
+	splx(spl);
+	return val;
 }
 
 uint32_t
@@ -154,5 +280,6 @@ randmax(void)
 	if (the_random==NULL) {
 		panic("No random device\n");
 	}
-	return the_random->rs_randmax(the_random->rs_devdata);
+	/* The generator's range, not the device's. */
+	return 0xffffffff;
 }
@@ -38,6 +38,11 @@
  * This makes it unnecessary to copy the system files to the simulated
  * disk, although we recommend doing so and trying running without this
  * device as part of testing your filesystem.
+ *
+ * Every operation is a round trip through the device, so for files we
+ * keep a small cache of file data and the file size in the vnode. We
+ * assume nobody on the host side changes the files while we're using
+ * them.
  */
 
 #include <types.h>
@@ -49,6 +54,7 @@
 #include <uio.h>
 #include <membar.h>
 #include <synch.h>
+#include <vm.h>
 #include <lamebus/emu.h>
 #include <platform/bus.h>
 #include <vfs.h>
@@ -76,6 +82,9 @@
 #define EMU_OP_GETSIZE       8
 #define EMU_OP_TRUNC         9
 
+/* Most pages we read from the device at once (the rest is read-ahead) */
+#define EMUFS_MAXREADAHEAD  (EMU_MAXIO / PAGE_SIZE)
+
 /* Result codes for REG_RESULT */
 #define EMU_RES_SUCCESS      1
 #define EMU_RES_BADHANDLE    2
@@ -404,6 +413,234 @@ emu_trunc(struct emu_softc *sc, uint32_t handle, off_t len)
 //
 ////////////////////////////////////////////////////////////
 
+////////////////////////////////////////////////////////////
+//
+// File data cache
+//
+// Each file vnode caches up to EMUFS_CACHEPAGES pages of the file,
+// replaced in LRU order. Misses read several pages in one device
+// operation: as many as the read asks for, or more if the file is
+// being read sequentially, up to EMUFS_MAXREADAHEAD. Writes go
+// straight through to the device and invalidate what they overlap.
+//
+// All of this is protected by ev_lock, which is acquired before
+// e_lock.
+//
+
+/*
+ * Set up the cache in a new vnode.
+ */
+static
+int
+emufs_cache_init(struct emufs_vnode *ev)
+{
+	unsigned i;
+
+	ev->ev_lock = lock_create("emufs-vnode");
+	if (ev->ev_lock == NULL) {
+		return ENOMEM;
+	}
+	ev->ev_sizevalid = false;
+	ev->ev_size = 0;
+	ev->ev_nextread = 0;
+	ev->ev_readahead = 1;
+	ev->ev_clock = 0;
+	for (i=0; i<EMUFS_CACHEPAGES; i++) {
+		ev->ev_pages[i].ep_data = NULL;
+		ev->ev_pages[i].ep_pageno = 0;
+		ev->ev_pages[i].ep_len = 0;
+		ev->ev_pages[i].ep_lastuse = 0;
+		ev->ev_pages[i].ep_valid = false;
+	}
+	return 0;
+}
+
+/*
+ * Free the cache in a vnode that's going away.
+ */
+static
+void
+emufs_cache_cleanup(struct emufs_vnode *ev)
+{
+	unsigned i;
+
+	for (i=0; i<EMUFS_CACHEPAGES; i++) {
+		kfree(ev->ev_pages[i].ep_data);
+	}
+	lock_destroy(ev->ev_lock);
+}
+
+/*
+ * Look for a page in the cache.
+ */
+static
+struct emufs_page *
+emufs_cache_find(struct emufs_vnode *ev, off_t pageno)
+{
+	struct emufs_page *ep;
+	unsigned i;
+
+	for (i=0; i<EMUFS_CACHEPAGES; i++) {
+		ep = &ev->ev_pages[i];
+		if (ep->ep_valid && ep->ep_pageno == pageno) {
+			ep->ep_lastuse = ++ev->ev_clock;
+			return ep;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Choose a cache slot to (re)use: the least recently used, preferring
+ * invalid ones. The slot is marked invalid and most recently used, so
+ * calling this again picks a different one.
+ */
+static
+struct emufs_page *
+emufs_cache_getslot(struct emufs_vnode *ev)
+{
+	struct emufs_page *ep;
+	unsigned i;
+
+	ep = &ev->ev_pages[0];
+	for (i=1; i<EMUFS_CACHEPAGES; i++) {
+		if (ev->ev_pages[i].ep_lastuse < ep->ep_lastuse) {
+			ep = &ev->ev_pages[i];
+		}
+	}
+
+	if (ep->ep_data == NULL) {
+		ep->ep_data = kmalloc(PAGE_SIZE);
+		if (ep->ep_data == NULL) {
+			return NULL;
+		}
+	}
+	ep->ep_valid = false;
+	ep->ep_lastuse = ++ev->ev_clock;
+	return ep;
+}
+
+/*
+ * Throw away cached pages that overlap the byte range [start, end),
+ * along with any page that held the end of the file, which may since
+ * have moved.
+ */
+static
+void
+emufs_cache_invalidate(struct emufs_vnode *ev, off_t start, off_t end)
+{
+	struct emufs_page *ep;
+	off_t pagestart;
+	unsigned i;
+
+	for (i=0; i<EMUFS_CACHEPAGES; i++) {
+		ep = &ev->ev_pages[i];
+		if (!ep->ep_valid) {
+			continue;
+		}
+		pagestart = ep->ep_pageno * PAGE_SIZE;
+		if (ep->ep_len < PAGE_SIZE ||
+		    (pagestart < end && pagestart + PAGE_SIZE > start)) {
+			ep->ep_valid = false;
+			ep->ep_lastuse = 0;
+		}
+	}
+}
+
+/*
+ * Read up to NPAGES pages, starting with page PAGENO (which must not
+ * already be cached), into the cache in one device operation. Hand
+ * back the cache slot holding PAGENO.
+ */
+static
+int
+emufs_cache_fill(struct emufs_vnode *ev, off_t pageno, unsigned npages,
+		 struct emufs_page **ret)
+{
+	struct emufs_page *pages[EMUFS_MAXREADAHEAD];
+	struct iovec iov[EMUFS_MAXREADAHEAD];
+	struct uio ku;
+	off_t filepages;
+	size_t got, len;
+	unsigned i;
+	int result;
+
+	KASSERT(lock_do_i_hold(ev->ev_lock));
+
+	if (npages > EMUFS_MAXREADAHEAD) {
+		npages = EMUFS_MAXREADAHEAD;
+	}
+	/* Don't read past EOF if we know where it is... */
+	if (ev->ev_sizevalid) {
+		filepages = (ev->ev_size + PAGE_SIZE - 1) / PAGE_SIZE;
+		if (pageno + npages > filepages && filepages > pageno) {
+			npages = filepages - pageno;
+		}
+	}
+	/* ...or over pages we already have. */
+	for (i=1; i<npages; i++) {
+		if (emufs_cache_find(ev, pageno + i) != NULL) {
+			npages = i;
+			break;
+		}
+	}
+
+	for (i=0; i<npages; i++) {
+		pages[i] = emufs_cache_getslot(ev);
+		if (pages[i] == NULL) {
+			if (i == 0) {
+				return ENOMEM;
+			}
+			npages = i;
+			break;
+		}
+		iov[i].iov_kbase = pages[i]->ep_data;
+		iov[i].iov_len = PAGE_SIZE;
+	}
+
+	ku.uio_iov = iov;
+	ku.uio_iovcnt = npages;
+	ku.uio_offset = pageno * PAGE_SIZE;
+	ku.uio_resid = npages * PAGE_SIZE;
+	ku.uio_segflg = UIO_SYSSPACE;
+	ku.uio_rw = UIO_READ;
+	ku.uio_space = NULL;
+
+	result = emu_read(ev->ev_emu, ev->ev_handle, npages * PAGE_SIZE, &ku);
+	if (result) {
+		return result;
+	}
+	got = npages * PAGE_SIZE - ku.uio_resid;
+
+	for (i=0; i<npages; i++) {
+		len = got > i * PAGE_SIZE ? got - i * PAGE_SIZE : 0;
+		if (len > PAGE_SIZE) {
+			len = PAGE_SIZE;
+		}
+		pages[i]->ep_pageno = pageno + i;
+		pages[i]->ep_len = len;
+		/* keep the first page even if empty; it marks EOF */
+		if (i == 0 || len > 0) {
+			pages[i]->ep_valid = true;
+		}
+		else {
+			pages[i]->ep_lastuse = 0;
+		}
+	}
+
+	/* A short read means we found the end of the file. */
+	if (got < npages * PAGE_SIZE) {
+		ev->ev_size = pageno * PAGE_SIZE + got;
+		ev->ev_sizevalid = true;
+	}
+
+	*ret = pages[0];
+	return 0;
+}
+
+//
+////////////////////////////////////////////////////////////
+
 ////////////////////////////////////////////////////////////
 //
 // vnode functions
@@ -529,44 +766,85 @@ emufs_reclaim(struct vnode *v)
 	lock_release(ef->ef_emu->e_lock);
 	vfs_biglock_release();
 
+	emufs_cache_cleanup(ev);
 	kfree(ev);
 	return 0;
 }
 
 /*
  * VOP_READ
+ *
+ * Copy out of the cache, filling it as needed. A read that starts
+ * where the last one ended doubles the read-ahead window; any other
+ * read resets it.
  */
 static
 int
 emufs_read(struct vnode *v, struct uio *uio)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	uint32_t amt;
-	size_t oldresid;
+	struct emufs_page *ep;
+	off_t pageno;
+	unsigned pageoff, npages;
+	size_t len;
 	int result;
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
-	while (uio->uio_resid > 0) {
-		amt = uio->uio_resid;
-		if (amt > EMU_MAXIO) {
-			amt = EMU_MAXIO;
+	lock_acquire(ev->ev_lock);
+
+	if (uio->uio_offset == ev->ev_nextread) {
+		if (ev->ev_readahead < EMUFS_MAXREADAHEAD) {
+			ev->ev_readahead *= 2;
 		}
+	}
+	else {
+		ev->ev_readahead = 1;
+	}
 
-		oldresid = uio->uio_resid;
+	result = 0;
+	while (uio->uio_resid > 0) {
+		if (uio->uio_offset > (off_t)0xffffffff) {
+			/* beyond the largest size the file can have */
+			break;
+		}
+		if (ev->ev_sizevalid && uio->uio_offset >= ev->ev_size) {
+			break;
+		}
 
-		result = emu_read(ev->ev_emu, ev->ev_handle, amt, uio);
-		if (result) {
-			return result;
+		pageno = uio->uio_offset / PAGE_SIZE;
+		pageoff = uio->uio_offset % PAGE_SIZE;
+
+		ep = emufs_cache_find(ev, pageno);
+		if (ep == NULL) {
+			npages = (pageoff + uio->uio_resid + PAGE_SIZE - 1)
+				/ PAGE_SIZE;
+			if (npages < ev->ev_readahead) {
+				npages = ev->ev_readahead;
+			}
+			result = emufs_cache_fill(ev, pageno, npages, &ep);
+			if (result) {
+				break;
+			}
 		}
 
-		if (uio->uio_resid == oldresid) {
-			/* nothing read - EOF */
+		if (pageoff >= ep->ep_len) {
+			/* EOF */
+			break;
+		}
+		len = ep->ep_len - pageoff;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(ep->ep_data + pageoff, len, uio);
+		if (result) {
 			break;
 		}
 	}
 
-	return 0;
+	ev->ev_nextread = uio->uio_offset;
+	lock_release(ev->ev_lock);
+	return result;
 }
 
 /*
@@ -599,10 +877,15 @@ emufs_write(struct vnode *v, struct uio *uio)
 	struct emufs_vnode *ev = v->vn_data;
 	uint32_t amt;
 	size_t oldresid;
+	off_t start;
 	int result;
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
+	lock_acquire(ev->ev_lock);
+
+	start = uio->uio_offset;
+	result = 0;
 	while (uio->uio_resid > 0) {
 		amt = uio->uio_resid;
 		if (amt > EMU_MAXIO) {
@@ -613,7 +896,7 @@ emufs_write(struct vnode *v, struct uio *uio)
 
 		result = emu_write(ev->ev_emu, ev->ev_handle, amt, uio);
 		if (result) {
-			return result;
+			break;
 		}
 
 		if (uio->uio_resid == oldresid) {
@@ -622,7 +905,20 @@ emufs_write(struct vnode *v, struct uio *uio)
 		}
 	}
 
-	return 0;
+	if (result) {
+		/* not sure what made it to the file; forget everything */
+		emufs_cache_invalidate(ev, 0, (off_t)0xffffffff);
+		ev->ev_sizevalid = false;
+	}
+	else {
+		emufs_cache_invalidate(ev, start, uio->uio_offset);
+		if (ev->ev_sizevalid && uio->uio_offset > ev->ev_size) {
+			ev->ev_size = uio->uio_offset;
+		}
+	}
+
+	lock_release(ev->ev_lock);
+	return result;
 }
 
 /*
@@ -645,6 +941,9 @@ emufs_ioctl(struct vnode *v, int op, userptr_t data)
 
 /*
  * VOP_STAT
+ *
+ * The size of a file is cached; the size of a directory changes
+ * behind our back when files are created in it, so ask every time.
  */
 static
 int
@@ -655,9 +954,26 @@ emufs_stat(struct vnode *v, struct stat *statbuf)
 
 	bzero(statbuf, sizeof(struct stat));
 
-	result = emu_getsize(ev->ev_emu, ev->ev_handle, &statbuf->st_size);
-	if (result) {
-		return result;
+	if (ev->ev_isdir) {
+		result = emu_getsize(ev->ev_emu, ev->ev_handle,
+				     &statbuf->st_size);
+		if (result) {
+			return result;
+		}
+	}
+	else {
+		lock_acquire(ev->ev_lock);
+		if (!ev->ev_sizevalid) {
+			result = emu_getsize(ev->ev_emu, ev->ev_handle,
+					     &ev->ev_size);
+			if (result) {
+				lock_release(ev->ev_lock);
+				return result;
+			}
+			ev->ev_sizevalid = true;
+		}
+		statbuf->st_size = ev->ev_size;
+		lock_release(ev->ev_lock);
 	}
 
 	result = VOP_GETTYPE(v, &statbuf->st_mode);
@@ -725,7 +1041,15 @@ int
 emufs_truncate(struct vnode *v, off_t len)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	return emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	int result;
+
+	lock_acquire(ev->ev_lock);
+	result = emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	emufs_cache_invalidate(ev, len, (off_t)0xffffffff);
+	ev->ev_size = len;
+	ev->ev_sizevalid = (result == 0);
+	lock_release(ev->ev_lock);
+	return result;
 }
 
 /*
@@ -1086,6 +1410,7 @@ static const struct vnode_ops emufs_fileops = {
 	.vop_stat = emufs_stat,
 	.vop_gettype = emufs_file_gettype,
 	.vop_isseekable = emufs_isseekable,
+	.vop_poll = vopnoblock_poll,
 	.vop_fsync = emufs_fsync,
 	.vop_mmap = emufs_mmap,
 	.vop_truncate = emufs_truncate,
@@ -1120,6 +1445,7 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_stat = emufs_stat,
 	.vop_gettype = emufs_dir_gettype,
 	.vop_isseekable = emufs_isseekable,
+	.vop_poll = vopnoblock_poll,
 	.vop_fsync = emufs_void_op_isdir,
 	.vop_mmap = emufs_void_op_isdir,
 	.vop_truncate = emufs_truncate_isdir,
@@ -1174,15 +1500,26 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 	ev = kmalloc(sizeof(struct emufs_vnode));
 	if (ev==NULL) {
 		lock_release(ef->ef_emu->e_lock);
+		vfs_biglock_release();
 		return ENOMEM;
 	}
 
 	ev->ev_emu = ef->ef_emu;
 	ev->ev_handle = handle;
+	ev->ev_isdir = isdir != 0;
+
+	result = emufs_cache_init(ev);
+	if (result) {
+		lock_release(ef->ef_emu->e_lock);
+		vfs_biglock_release();
+		kfree(ev);
+		return result;
+	}
 
 	result = vnode_init(&ev->ev_v, isdir ? &emufs_dirops : &emufs_fileops,
 			    &ef->ef_fs, ev);
 	if (result) {
+		emufs_cache_cleanup(ev);
 		lock_release(ef->ef_emu->e_lock);
 		vfs_biglock_release();
 		kfree(ev);
@@ -1193,6 +1530,7 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 	if (result) {
 		/* note: vnode_cleanup undoes vnode_init - it does not kfree */
 		vnode_cleanup(&ev->ev_v);
+		emufs_cache_cleanup(ev);
 		lock_release(ef->ef_emu->e_lock);
 		vfs_biglock_release();
 		kfree(ev);
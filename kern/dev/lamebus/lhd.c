@@ -33,6 +33,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <membar.h>
@@ -165,6 +166,20 @@ lhd_ioctl(struct device *d, int op, userptr_t data)
 	return EIOCTL;
 }
 
+/*
+ * Poll. Disk I/O takes time, but it never waits for anything that
+ * poll could report, so the disk is always ready.
+ */
+static
+int
+lhd_poll(struct device *d, struct pollwait *pw, int *revents)
+{
+	(void)d;
+	(void)pw;
+	*revents = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+	return 0;
+}
+
 #if 0
 /*
  * Reset the device.
@@ -268,6 +283,7 @@ static const struct device_ops lhd_devops = {
 	.devop_eachopen = lhd_eachopen,
 	.devop_io = lhd_io,
 	.devop_ioctl = lhd_ioctl,
+	.devop_poll = lhd_poll,
 };
 
 /*
@@ -33,6 +33,7 @@
 #include <array.h>
 #include <fs.h>
 #include <vnode.h>
+#include <poll.h>
 
 #ifndef SEMFS_INLINE
 #define SEMFS_INLINE INLINE
@@ -55,6 +56,7 @@ struct semfs_sem {
 	struct lock *sems_lock;			/* Lock to protect count */
 	struct cv *sems_cv;			/* CV to wait */
 	unsigned sems_count;			/* Semaphore count */
+	struct pollhead sems_pollhead;		/* poll() waiters */
 	bool sems_hasvnode;			/* The vnode exists */
 	bool sems_linked;			/* In the directory */
 };
@@ -80,6 +82,7 @@ struct semfs_vnode {
 	struct vnode semv_absvn;		/* Abstract vnode */
 	struct semfs *semv_semfs;		/* Back-pointer to fs */
 	unsigned semv_semnum;			/* Which semaphore */
+	struct semfs_sem *semv_sem;		/* It, or NULL for the dir */
 };
 
 /*
@@ -30,8 +30,10 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/ioctl.h>
 #include <stat.h>
 #include <uio.h>
+#include <copyinout.h>
 #include <synch.h>
 #include <thread.h>
 #include <proc.h>
@@ -62,16 +64,6 @@ semfs_eachopen(struct vnode *vn, int openflags)
 	return 0;
 }
 
-static
-int
-semfs_ioctl(struct vnode *vn, int op, userptr_t data)
-{
-	(void)vn;
-	(void)op;
-	(void)data;
-	return EINVAL;
-}
-
 static
 int
 semfs_gettype(struct vnode *vn, mode_t *ret)
@@ -106,10 +98,6 @@ semfs_fsync(struct vnode *vn)
 ////////////////////////////////////////////////////////////
 // semaphore ops
 
-/*
- * XXX fold these two together
- */
-
 static
 struct semfs_sem *
 semfs_getsembynum(struct semfs *semfs, unsigned semnum)
@@ -123,20 +111,25 @@ semfs_getsembynum(struct semfs *semfs, unsigned semnum)
 	return sem;
 }
 
+/*
+ * The semaphore for a vnode. This doesn't need the table lock: the
+ * semaphore can't go away while it has a vnode, so the vnode keeps
+ * a pointer to it.
+ */
 static
 struct semfs_sem *
 semfs_getsem(struct semfs_vnode *semv)
 {
-	struct semfs *semfs = semv->semv_semfs;
-
-	return semfs_getsembynum(semfs, semv->semv_semnum);
+	KASSERT(semv->semv_sem != NULL);
+	return semv->semv_sem;
 }
 
 /*
  * Wakeup helper. We only need to wake up if there are sleepers, which
  * should only be the case if the old count is 0; and we only
  * potentially need to wake more than one sleeper if the new count
- * will be more than 1.
+ * will be more than 1. The count going from 0 to nonzero is also the
+ * only change that makes a difference to poll().
  */
 static
 void
@@ -151,6 +144,7 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	else {
 		cv_broadcast(sem->sems_cv, sem->sems_lock);
 	}
+	pollhead_wakeup(&sem->sems_pollhead);
 }
 
 /*
@@ -181,23 +175,19 @@ semfs_semstat(struct vnode *vn, struct stat *buf)
 }
 
 /*
- * Read. This is P(); decrease the count by the amount read.
- * Don't actually bother to transfer any data.
+ * P() COUNT times; that is, wait until COUNT can be taken off the
+ * count, taking what's there as it comes.
  */
 static
-int
-semfs_read(struct vnode *vn, struct uio *uio)
+void
+semfs_P(struct semfs_vnode *semv, struct semfs_sem *sem, size_t count)
 {
-	struct semfs_vnode *semv = vn->vn_data;
-	struct semfs_sem *sem;
 	size_t consume;
 
-	sem = semfs_getsem(semv);
-
 	lock_acquire(sem->sems_lock);
-	while (uio->uio_resid > 0) {
+	while (count > 0) {
 		if (sem->sems_count > 0) {
-			consume = uio->uio_resid;
+			consume = count;
 			if (consume > sem->sems_count) {
 				consume = sem->sems_count;
 			}
@@ -205,10 +195,9 @@ semfs_read(struct vnode *vn, struct uio *uio)
 			      semv->semv_semnum, sem->sems_count,
 			      sem->sems_count - consume);
 			sem->sems_count -= consume;
-			/* don't bother advancing the uio data pointers */
-			uio->uio_resid -= consume;
+			count -= consume;
 		}
-		if (uio->uio_resid == 0) {
+		if (count == 0) {
 			break;
 		}
 		if (sem->sems_count == 0) {
@@ -218,6 +207,45 @@ semfs_read(struct vnode *vn, struct uio *uio)
 		}
 	}
 	lock_release(sem->sems_lock);
+}
+
+/*
+ * V() COUNT times at once.
+ */
+static
+int
+semfs_V(struct semfs_vnode *semv, struct semfs_sem *sem, size_t count)
+{
+	unsigned newcount;
+
+	lock_acquire(sem->sems_lock);
+	newcount = sem->sems_count + count;
+	if (newcount < sem->sems_count) {
+		/* overflow */
+		lock_release(sem->sems_lock);
+		return EFBIG;
+	}
+	DEBUG(DB_SEMFS, "semfs: sem%u: V, count %u -> %u\n",
+	      semv->semv_semnum, sem->sems_count, newcount);
+	semfs_wakeup(sem, newcount);
+	sem->sems_count = newcount;
+	lock_release(sem->sems_lock);
+	return 0;
+}
+
+/*
+ * Read. This is P(); decrease the count by the amount read.
+ * Don't actually bother to transfer any data.
+ */
+static
+int
+semfs_read(struct vnode *vn, struct uio *uio)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+
+	semfs_P(semv, semfs_getsem(semv), uio->uio_resid);
+	/* don't bother advancing the uio data pointers */
+	uio->uio_resid = 0;
 	return 0;
 }
 
@@ -230,29 +258,53 @@ int
 semfs_write(struct vnode *vn, struct uio *uio)
 {
 	struct semfs_vnode *semv = vn->vn_data;
-	struct semfs_sem *sem;
-	unsigned newcount;
-
-	sem = semfs_getsem(semv);
+	int result;
 
-	lock_acquire(sem->sems_lock);
-	while (uio->uio_resid > 0) {
-		newcount = sem->sems_count + uio->uio_resid;
-		if (newcount < sem->sems_count) {
-			/* overflow */
-			lock_release(sem->sems_lock);
-			return EFBIG;
-		}
-		DEBUG(DB_SEMFS, "semfs: sem%u: V, count %u -> %u\n",
-		      semv->semv_semnum, sem->sems_count, newcount);
-		semfs_wakeup(sem, newcount);
-		sem->sems_count = newcount;
-		uio->uio_resid = 0;
+	if (uio->uio_resid == 0) {
+		return 0;
 	}
-	lock_release(sem->sems_lock);
+	result = semfs_V(semv, semfs_getsem(semv), uio->uio_resid);
+	if (result) {
+		return result;
+	}
+	uio->uio_resid = 0;
 	return 0;
 }
 
+/*
+ * ioctl. SEMIOC_P and SEMIOC_V are P and V by a count given
+ * directly, without going through read/write and a uio; see
+ * <kern/ioctl.h>.
+ */
+static
+int
+semfs_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	unsigned count;
+	int result;
+
+	if (semv->semv_semnum == SEMFS_ROOTDIR) {
+		return EIOCTL;
+	}
+	if (op != SEMIOC_P && op != SEMIOC_V) {
+		return EIOCTL;
+	}
+
+	result = copyin(data, &count, sizeof(count));
+	if (result) {
+		return result;
+	}
+	if (count == 0) {
+		return 0;
+	}
+	if (op == SEMIOC_P) {
+		semfs_P(semv, semfs_getsem(semv), count);
+		return 0;
+	}
+	return semfs_V(semv, semfs_getsem(semv), count);
+}
+
 /*
  * Truncate. Set the count to the specified value.
  *
@@ -289,6 +341,32 @@ semfs_truncate(struct vnode *vn, off_t len)
 	return 0;
 }
 
+/*
+ * poll() for semaphore vnodes. A semaphore is readable (P won't
+ * block) when the count is nonzero; it's always writable, as V never
+ * blocks.
+ */
+static
+int
+semfs_poll(struct vnode *vn, struct pollwait *pw, int *revents)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+
+	sem = semfs_getsem(semv);
+
+	pollhead_register(&sem->sems_pollhead, pw);
+
+	*revents = POLLOUT | POLLWRNORM;
+	lock_acquire(sem->sems_lock);
+	if (sem->sems_count > 0) {
+		*revents |= POLLIN | POLLRDNORM;
+	}
+	lock_release(sem->sems_lock);
+
+	return 0;
+}
+
 ////////////////////////////////////////////////////////////
 // directory ops
 
@@ -660,6 +738,7 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_stat = semfs_dirstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
+	.vop_poll = vopnoblock_poll,
 	.vop_fsync = semfs_fsync,
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
@@ -693,6 +772,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_stat = semfs_semstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
+	.vop_poll = semfs_poll,
 	.vop_fsync = semfs_fsync,
 	.vop_mmap = vopfail_mmap_perm,
 	.vop_truncate = semfs_truncate,
@@ -734,6 +814,7 @@ semfs_vnode_create(struct semfs *semfs, unsigned semnum)
 
 	semv->semv_semfs = semfs;
 	semv->semv_semnum = semnum;
+	semv->semv_sem = NULL;
 
 	result = vnode_init(&semv->semv_absvn, optable,
 			    &semfs->semfs_absfs, semv);
@@ -789,6 +870,7 @@ semfs_getvnode(struct semfs *semfs, unsigned semnum, struct vnode **ret)
 		KASSERT(sem != NULL);
 		KASSERT(sem->sems_hasvnode == false);
 		sem->sems_hasvnode = true;
+		semv->semv_sem = sem;
 	}
 	lock_release(semfs->semfs_tablelock);
 
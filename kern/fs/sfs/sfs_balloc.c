@@ -33,15 +33,17 @@
  * Block allocation.
  */
 #include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
 #include <lib.h>
 #include <bitmap.h>
+#include <vfs.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
 /*
  * Zero out a disk block.
  */
-static
 int
 sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
 {
@@ -52,21 +54,56 @@ sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
 }
 
 /*
- * Allocate a block.
+ * Find a free block and mark it in use. If NEAR is not 0, prefer the
+ * first free block at or after it, so consecutive blocks of a file
+ * end up next to each other on disk; otherwise take the next free
+ * block after the last one allocated. If there are none, blocks held
+ * as other files' reservations may be the problem, so give them back
+ * and try again. Blocks freed since the last sync (see sfs_bfree)
+ * may be the problem too, but syncing here would commit half an
+ * operation; see sfs_bretry.
  */
+static
 int
-sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
+sfs_bgrab(struct sfs_fs *sfs, daddr_t near, daddr_t *block)
 {
 	int result;
+	bool retried = false;
 
-	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+ again:
+	if (near != 0) {
+		result = bitmap_alloc_near(sfs->sfs_freemap, near, block);
+	}
+	else {
+		result = bitmap_alloc(sfs->sfs_freemap, block);
+	}
+	if (result == ENOSPC && !retried) {
+		sfs_bunreserveall(sfs);
+		retried = true;
+		goto again;
+	}
 	if (result) {
 		return result;
 	}
 	sfs->sfs_freemapdirty = true;
 
-	if (*diskblock >= sfs->sfs_sb.sb_nblocks) {
-		panic("sfs: balloc: invalid block %u\n", *diskblock);
+	if (*block >= sfs->sfs_sb.sb_nblocks) {
+		panic("sfs: invalid block %u allocated\n", *block);
+	}
+	return 0;
+}
+
+/*
+ * Allocate a block, preferably at NEAR (see sfs_bgrab), and clear it.
+ */
+int
+sfs_balloc(struct sfs_fs *sfs, daddr_t near, daddr_t *diskblock)
+{
+	int result;
+
+	result = sfs_bgrab(sfs, near, diskblock);
+	if (result) {
+		return result;
 	}
 
 	/* Clear block before returning it */
@@ -77,16 +114,127 @@ sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
 	return result;
 }
 
+/*
+ * Reserve a run of up to MAX free blocks, starting with the first
+ * free block at or after NEAR (or anywhere, if NEAR is 0), and hand
+ * back where it starts and how long it is. The blocks are marked in
+ * use but not cleared.
+ */
+int
+sfs_breserve(struct sfs_fs *sfs, daddr_t near, unsigned max,
+	     daddr_t *start, unsigned *num)
+{
+	daddr_t block;
+	unsigned n;
+	int result;
+
+	KASSERT(max > 0);
+
+	result = sfs_bgrab(sfs, near, &block);
+	if (result) {
+		return result;
+	}
+
+	for (n = 1; n < max; n++) {
+		if (block + n >= sfs->sfs_sb.sb_nblocks ||
+		    bitmap_isset(sfs->sfs_freemap, block + n)) {
+			break;
+		}
+		bitmap_mark(sfs->sfs_freemap, block + n);
+	}
+
+	*start = block;
+	*num = n;
+	return 0;
+}
+
+/*
+ * Give back the blocks a vnode has reserved but not used. Nothing on
+ * disk refers to them, so unlike sfs_bfree they're free at once.
+ */
+void
+sfs_bunreserve(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+
+	while (sv->sv_reslen > 0) {
+		bitmap_unmark(sfs->sfs_freemap, sv->sv_resstart);
+		sfs->sfs_freemapdirty = true;
+		sv->sv_resstart++;
+		sv->sv_reslen--;
+	}
+}
+
+/*
+ * Give back all the reserved blocks on the volume, when we run out of
+ * space. Otherwise reservations last until the file is truncated or
+ * reclaimed; they never reach the disk (see sfs_freemapio).
+ */
+void
+sfs_bunreserveall(struct sfs_fs *sfs)
+{
+	unsigned i, num;
+
+	num = vnodearray_num(sfs->sfs_vnodes);
+	for (i=0; i<num; i++) {
+		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
+		sfs_bunreserve(v->vn_data);
+	}
+}
+
 /*
  * Free a block.
+ *
+ * The block can't be handed out again until a sync has put the change
+ * that freed it on disk (committed it, on a journaled volume). Until
+ * then its old owner may still point to it on disk, and whole-block
+ * file writes go straight to the disk, so after a crash a directory
+ * or indirect block could come back holding another file's data.
+ * So the block stays marked in the freemap, which keeps the allocator
+ * off it, and goes in the freed map instead; sfs_freemapio writes it
+ * out as free, and sfs_bsynced really frees it after the sync.
  */
 void
 sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock)
 {
-	bitmap_unmark(sfs->sfs_freemap, diskblock);
+	KASSERT(bitmap_isset(sfs->sfs_freemap, diskblock));
+	bitmap_mark(sfs->sfs_freedmap, diskblock);
+	sfs->sfs_nfreed++;
 	sfs->sfs_freemapdirty = true;
 }
 
+/*
+ * A sync has finished; the blocks freed before it are free now.
+ */
+void
+sfs_bsynced(struct sfs_fs *sfs)
+{
+	unsigned char *freed;
+	unsigned i, j, nbytes;
+	daddr_t block;
+
+	if (sfs->sfs_nfreed == 0) {
+		return;
+	}
+
+	freed = bitmap_getdata(sfs->sfs_freedmap);
+	nbytes = SFS_FS_FREEMAPBITS(sfs) / CHAR_BIT;
+	for (i=0; i<nbytes && sfs->sfs_nfreed > 0; i++) {
+		if (freed[i] == 0) {
+			continue;
+		}
+		for (j=0; j<CHAR_BIT; j++) {
+			block = i * CHAR_BIT + j;
+			if (bitmap_isset(sfs->sfs_freedmap, block)) {
+				bitmap_unmark(sfs->sfs_freedmap, block);
+				bitmap_unmark(sfs->sfs_freemap, block);
+				sfs->sfs_nfreed--;
+			}
+		}
+	}
+	KASSERT(sfs->sfs_nfreed == 0);
+}
+
 /*
  * Check if a block is in use.
  */
@@ -100,3 +248,18 @@ sfs_bused(struct sfs_fs *sfs, daddr_t diskblock)
 	return bitmap_isset(sfs->sfs_freemap, diskblock);
 }
 
+/*
+ * An operation has failed with RESULT, and the caller is between
+ * operations. If it ran out of space while blocks freed since the
+ * last sync were being held back, sync to release them and return
+ * true, so the caller can try the operation again.
+ */
+bool
+sfs_bretry(struct sfs_fs *sfs, int result)
+{
+	if (result != ENOSPC || sfs->sfs_nfreed == 0) {
+		return false;
+	}
+	/* If the sync fails, the blocks are still held; don't bother */
+	return FSOP_SYNC(&sfs->sfs_absfs) == 0;
+}
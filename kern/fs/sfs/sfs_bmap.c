@@ -39,18 +39,152 @@
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/*
+ * Allocate a disk block to hold block FILEBLOCK of a file, preferably
+ * at NEAR (if not 0). Blocks past the current end of the file come
+ * from a run of blocks reserved for the file, so that a file growing
+ * alongside others still gets laid out contiguously. Unless FRESH is
+ * not NULL, the block is cleared; otherwise *FRESH is set and the
+ * caller is responsible for writing the whole block.
+ */
+static
+int
+sfs_bmap_alloc(struct sfs_vnode *sv, uint32_t fileblock, daddr_t near,
+	       bool *fresh, daddr_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	uint32_t fileblocks;
+	daddr_t block;
+	unsigned num;
+	int result;
+
+	fileblocks = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+
+	if (fileblock < fileblocks) {
+		/* Filling in a hole; just take one block */
+		result = sfs_breserve(sfs, near, 1, &block, &num);
+		if (result) {
+			return result;
+		}
+	}
+	else {
+		if (sv->sv_reslen == 0 ||
+		    (near != 0 && near != sv->sv_resstart)) {
+			/* Nothing suitable reserved; reserve a new run */
+			sfs_bunreserve(sv);
+			result = sfs_breserve(sfs, near, SFS_PREALLOC,
+					      &sv->sv_resstart, &sv->sv_reslen);
+			if (result) {
+				return result;
+			}
+		}
+		block = sv->sv_resstart++;
+		sv->sv_reslen--;
+
+		/* It was written out as free; now it's in use */
+		sfs->sfs_freemapdirty = true;
+	}
+
+	if (fresh != NULL) {
+		*fresh = true;
+	}
+	else {
+		result = sfs_clearblock(sfs, block);
+		if (result) {
+			sfs_bfree(sfs, block);
+			return result;
+		}
+	}
+
+	*diskblock = block;
+	return 0;
+}
+
+/*
+ * Number of file blocks mapped by each entry of an indirect block at
+ * indirection LEVEL (1 for single indirect blocks, and so on).
+ */
+static
+uint32_t
+sfs_bmap_range(unsigned level)
+{
+	uint32_t range = 1;
+
+	while (level-- > 1) {
+		range *= SFS_DBPERIDB;
+	}
+	return range;
+}
+
+/*
+ * Find where file block FILEBLOCK is mapped from: the direct blocks
+ * (level 0) or the single, double, or triple indirect tree (levels 1
+ * to 3). Returns the slot in the inode that starts the lookup, the
+ * level, and the offset of the block from the first one that slot
+ * maps. Fails with EFBIG if the block is past what we can map.
+ */
+static
+int
+sfs_bmap_locate(struct sfs_vnode *sv, uint32_t fileblock,
+		uint32_t **slot, unsigned *level, uint32_t *offset)
+{
+	uint32_t range;
+
+	if (fileblock < SFS_NDIRECT) {
+		*slot = &sv->sv_i.sfi_direct[fileblock];
+		*level = 0;
+		*offset = 0;
+		return 0;
+	}
+	fileblock -= SFS_NDIRECT;
+
+	range = SFS_DBPERIDB;
+	if (fileblock < range) {
+		*slot = &sv->sv_i.sfi_indirect;
+		*level = 1;
+		*offset = fileblock;
+		return 0;
+	}
+	fileblock -= range;
+
+	range *= SFS_DBPERIDB;
+	if (fileblock < range) {
+		*slot = &sv->sv_i.sfi_dindirect;
+		*level = 2;
+		*offset = fileblock;
+		return 0;
+	}
+	fileblock -= range;
+
+	range *= SFS_DBPERIDB;
+	if (fileblock < range) {
+		*slot = &sv->sv_i.sfi_tindirect;
+		*level = 3;
+		*offset = fileblock;
+		return 0;
+	}
+
+	return EFBIG;
+}
+
 /*
  * Look up the disk block number (from 0 up to the number of blocks on
  * the disk) given a file and the logical block number within that
  * file. If DOALLOC is set, and no such block exists, one will be
- * allocated.
+ * allocated, along with any indirect blocks needed to reach it. If
+ * FRESH is not NULL, it is set to whether the block was newly
+ * allocated and not zeroed; the caller must then overwrite all of it
+ * (or clear it with sfs_clearblock), and on a volume without a
+ * journal, write it through before anything else.
  */
 int
 sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
-	 daddr_t *diskblock)
+	 bool *fresh, daddr_t *diskblock)
 {
 	/*
-	 * I/O buffer for handling indirect blocks.
+	 * I/O buffer for handling indirect blocks. We only ever need
+	 * one at a time: each indirect block is written back, if it
+	 * changed, before we move down to the next level.
 	 *
 	 * Note: in real life (and when you've done the fs assignment)
 	 * you would get space from the disk buffer cache for this,
@@ -59,9 +193,12 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	static uint32_t idbuf[SFS_DBPERIDB];
 
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	uint32_t *slot;		/* where the next block number is kept */
+	daddr_t parent;		/* indirect block holding SLOT; 0 for inode */
 	daddr_t block;
-	daddr_t idblock;
-	uint32_t idnum, idoff;
+	daddr_t near;
+	unsigned level, index;
+	uint32_t offset, range;
 	int result;
 
 	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
@@ -69,120 +206,120 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	/* Since we're using a static buffer, we'd better be locked. */
 	KASSERT(vfs_biglock_do_i_hold());
 
-	/*
-	 * If the block we want is one of the direct blocks...
-	 */
-	if (fileblock < SFS_NDIRECT) {
-		/*
-		 * Get the block number
-		 */
-		block = sv->sv_i.sfi_direct[fileblock];
-
-		/*
-		 * Do we need to allocate?
-		 */
-		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
-			if (result) {
-				return result;
-			}
-
-			/* Remember what we allocated; mark inode dirty */
-			sv->sv_i.sfi_direct[fileblock] = block;
-			sv->sv_dirty = true;
-		}
+	if (fresh != NULL) {
+		*fresh = false;
+	}
 
-		/*
-		 * Hand back the block
-		 */
-		if (block != 0 && !sfs_bused(sfs, block)) {
-			panic("sfs: Data block %u (block %u of file %u) "
-			      "marked free\n", block, fileblock, sv->sv_ino);
-		}
-		*diskblock = block;
-		return 0;
+	result = sfs_bmap_locate(sv, fileblock, &slot, &level, &offset);
+	if (result) {
+		return result;
 	}
 
 	/*
-	 * It's not a direct block; it must be in the indirect block.
-	 * Subtract off the number of direct blocks, so FILEBLOCK is
-	 * now the offset into the indirect block space.
+	 * Where to put a block we allocate straight off the inode: right
+	 * after the previous direct block, or for the single indirect
+	 * block, after the last direct block.
 	 */
-
-	fileblock -= SFS_NDIRECT;
-
-	/* Get the indirect block number and offset w/i that indirect block */
-	idnum = fileblock / SFS_DBPERIDB;
-	idoff = fileblock % SFS_DBPERIDB;
+	near = 0;
+	if (level == 0 && fileblock > 0 && sv->sv_i.sfi_direct[fileblock-1]) {
+		near = sv->sv_i.sfi_direct[fileblock-1] + 1;
+	}
+	else if (level == 1 && sv->sv_i.sfi_direct[SFS_NDIRECT-1]) {
+		near = sv->sv_i.sfi_direct[SFS_NDIRECT-1] + 1;
+	}
 
 	/*
-	 * We only have one indirect block. If the offset we were asked for
-	 * is too large, we can't handle it, so fail.
+	 * Walk down the indirect blocks, if any. Each time around, SLOT
+	 * names the indirect block at LEVEL, and OFFSET is the position
+	 * of our file block within the range it maps.
 	 */
-	if (idnum >= SFS_NINDIRECT) {
-		return EFBIG;
-	}
-
-	/* Get the disk block number of the indirect block. */
-	idblock = sv->sv_i.sfi_indirect;
-
-	if (idblock==0 && !doalloc) {
-		/*
-		 * There's no indirect block allocated. We weren't
-		 * asked to allocate anything, so pretend the indirect
-		 * block was filled with all zeros.
-		 */
-		*diskblock = 0;
-		return 0;
-	}
-	else if (idblock==0) {
-		/*
-		 * There's no indirect block allocated, but we need to
-		 * allocate a block whose number needs to be stored in
-		 * the indirect block. Thus, we need to allocate an
-		 * indirect block.
-		 */
-		result = sfs_balloc(sfs, &idblock);
-		if (result) {
-			return result;
+	parent = 0;
+	range = sfs_bmap_range(level);
+	for (; level > 0; level--) {
+		block = *slot;
+		if (block == 0 && !doalloc) {
+			/*
+			 * There's no indirect block allocated. We weren't
+			 * asked to allocate anything, so pretend the
+			 * indirect block was filled with all zeros.
+			 */
+			*diskblock = 0;
+			return 0;
 		}
+		else if (block == 0) {
+			/* Allocate an indirect block; it comes cleared */
+			result = sfs_bmap_alloc(sv, fileblock, near, NULL,
+						&block);
+			if (result) {
+				return result;
+			}
 
-		/* Remember the block we just allocated */
-		sv->sv_i.sfi_indirect = idblock;
-
-		/* Mark the inode dirty */
-		sv->sv_dirty = true;
-
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
-	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
-		if (result) {
-			return result;
+			/* Remember it in the inode or the parent */
+			*slot = block;
+			if (parent == 0) {
+				sv->sv_dirty = true;
+			}
+			else {
+				result = sfs_writeblock(sfs, parent, idbuf,
+							sizeof(idbuf));
+				if (result) {
+					return result;
+				}
+			}
+			bzero(idbuf, sizeof(idbuf));
+		}
+		else {
+			/* Load it */
+			result = sfs_readblock(sfs, block, idbuf,
+					       sizeof(idbuf));
+			if (result) {
+				return result;
+			}
 		}
+
+		/* Move down a level */
+		index = offset / range;
+		offset %= range;
+		range /= SFS_DBPERIDB;
+		parent = block;
+		slot = &idbuf[index];
+		near = (index > 0 && idbuf[index-1]) ?
+			idbuf[index-1] + 1 : parent + 1;
 	}
 
-	/* Get the block out of the indirect block buffer */
-	block = idbuf[idoff];
+	/* Now SLOT names the data block */
+	block = *slot;
 
 	/* If there's no block there, allocate one */
 	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
+		/*
+		 * Without a journal, the indirect block goes to disk
+		 * below, before the caller's data can, so clear the new
+		 * block on disk first; after a crash it mustn't show
+		 * whatever was there before. A block mapped from the
+		 * inode is fine, since the caller's data goes to disk
+		 * before the inode is next written.
+		 */
+		if (parent != 0 && sfs->sfs_sb.sb_journalblocks == 0) {
+			fresh = NULL;
+		}
+		result = sfs_bmap_alloc(sv, fileblock, near, fresh, &block);
 		if (result) {
 			return result;
 		}
 
 		/* Remember the block we allocated */
-		idbuf[idoff] = block;
-
-		/* The indirect block is now dirty; write it back */
-		result = sfs_writeblock(sfs, idblock, idbuf, sizeof(idbuf));
-		if (result) {
-			return result;
+		*slot = block;
+		if (parent == 0) {
+			sv->sv_dirty = true;
+		}
+		else {
+			/* The indirect block is now dirty; write it back */
+			result = sfs_writeblock(sfs, parent, idbuf,
+						sizeof(idbuf));
+			if (result) {
+				return result;
+			}
 		}
 	}
 
@@ -196,35 +333,116 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 }
 
 /*
- * Called for ftruncate() and from sfs_reclaim.
+ * Truncate the tree under the indirect block named by *IDBLOCK, which
+ * is at indirection LEVEL and maps file blocks starting at BASE,
+ * freeing everything at or past file block BLOCKLEN. If the indirect
+ * block ends up empty, free it too, clear *IDBLOCK, and set *CHANGED.
  */
+static
 int
-sfs_itrunc(struct sfs_vnode *sv, off_t len)
+sfs_itrunc_ib(struct sfs_fs *sfs, uint32_t *idblock, unsigned level,
+	      uint32_t base, uint32_t blocklen, bool *changed)
 {
 	/*
-	 * I/O buffer for handling the indirect block.
+	 * I/O buffers for the indirect blocks, one per level, since
+	 * we recurse.
 	 *
 	 * Note: in real life (and when you've done the fs assignment)
 	 * you would get space from the disk buffer cache for this,
 	 * not use a static area.
 	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
+	static uint32_t idbufs[3][SFS_DBPERIDB];
+
+	uint32_t *idbuf;
+	uint32_t range, j;
+	bool hasnonzero, iddirty, sub;
+	int result;
+
+	KASSERT(level >= 1 && level <= 3);
+	KASSERT(vfs_biglock_do_i_hold());
+
+	range = sfs_bmap_range(level);
+	if (*idblock == 0 || blocklen >= base + SFS_DBPERIDB * range) {
+		/* Nothing here, or all of it is before the new EOF */
+		return 0;
+	}
+
+	/* Read the indirect block */
+	idbuf = idbufs[level-1];
+	result = sfs_readblock(sfs, *idblock, idbuf, SFS_BLOCKSIZE);
+	if (result) {
+		return result;
+	}
+
+	hasnonzero = false;
+	iddirty = false;
+	for (j=0; j<SFS_DBPERIDB; j++) {
+		if (idbuf[j] != 0 && level > 1) {
+			/* Trim the subtree */
+			sub = false;
+			result = sfs_itrunc_ib(sfs, &idbuf[j], level-1,
+					       base + j*range, blocklen, &sub);
+			if (result) {
+				return result;
+			}
+			iddirty = iddirty || sub;
+		}
+		else if (idbuf[j] != 0 && blocklen <= base + j) {
+			/* Discard any blocks that are past the new EOF */
+			sfs_bfree(sfs, idbuf[j]);
+			idbuf[j] = 0;
+			iddirty = true;
+		}
+		/* Remember if we see any nonzero blocks in here */
+		if (idbuf[j] != 0) {
+			hasnonzero = true;
+		}
+	}
+
+	if (!hasnonzero) {
+		/* The whole indirect block is empty now; free it */
+		sfs_bfree(sfs, *idblock);
+		*idblock = 0;
+		*changed = true;
+	}
+	else if (iddirty) {
+		/* The indirect block is dirty; write it back */
+		result = sfs_writeblock(sfs, *idblock, idbuf, SFS_BLOCKSIZE);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
 
+/*
+ * Called for ftruncate() and from sfs_reclaim.
+ */
+int
+sfs_itrunc(struct sfs_vnode *sv, off_t len)
+{
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 
 	/* Length in blocks (divide rounding up) */
 	uint32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
 
-	uint32_t i, j;
-	daddr_t block, idblock;
-	uint32_t baseblock, highblock;
+	uint32_t i;
+	daddr_t block;
+	uint32_t baseblock;
 	int result;
-	int hasnonzero, iddirty;
-
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	bool changed;
 
 	vfs_biglock_acquire();
 
+	result = sfs_wb_opbegin(sfs, SFS_OPBLOCKS);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
+	/* Give back any blocks reserved for growth */
+	sfs_bunreserve(sv);
+
 	/*
 	 * Go through the direct blocks. Discard any that are
 	 * past the limit we're truncating to.
@@ -238,55 +456,28 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 		}
 	}
 
-	/* Indirect block number */
-	idblock = sv->sv_i.sfi_indirect;
-
-	/* The lowest block in the indirect block */
+	/* Then the single, double, and triple indirect trees */
+	changed = false;
 	baseblock = SFS_NDIRECT;
-
-	/* The highest block in the indirect block */
-	highblock = baseblock + SFS_DBPERIDB - 1;
-
-	if (blocklen < highblock && idblock != 0) {
-		/* We're past the proposed EOF; may need to free stuff */
-
-		/* Read the indirect block */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
-		if (result) {
-			vfs_biglock_release();
-			return result;
-		}
-
-		hasnonzero = 0;
-		iddirty = 0;
-		for (j=0; j<SFS_DBPERIDB; j++) {
-			/* Discard any blocks that are past the new EOF */
-			if (blocklen < baseblock+j && idbuf[j] != 0) {
-				sfs_bfree(sfs, idbuf[j]);
-				idbuf[j] = 0;
-				iddirty = 1;
-			}
-			/* Remember if we see any nonzero blocks in here */
-			if (idbuf[j]!=0) {
-				hasnonzero=1;
-			}
-		}
-
-		if (!hasnonzero) {
-			/* The whole indirect block is empty now; free it */
-			sfs_bfree(sfs, idblock);
-			sv->sv_i.sfi_indirect = 0;
-			sv->sv_dirty = true;
-		}
-		else if (iddirty) {
-			/* The indirect block is dirty; write it back */
-			result = sfs_writeblock(sfs, idblock, idbuf,
-						sizeof(idbuf));
-			if (result) {
-				vfs_biglock_release();
-				return result;
-			}
-		}
+	result = sfs_itrunc_ib(sfs, &sv->sv_i.sfi_indirect, 1,
+			       baseblock, blocklen, &changed);
+	if (result == 0) {
+		baseblock += sfs_bmap_range(2);
+		result = sfs_itrunc_ib(sfs, &sv->sv_i.sfi_dindirect, 2,
+				       baseblock, blocklen, &changed);
+	}
+	if (result == 0) {
+		baseblock += sfs_bmap_range(3);
+		result = sfs_itrunc_ib(sfs, &sv->sv_i.sfi_tindirect, 3,
+				       baseblock, blocklen, &changed);
+	}
+	if (changed) {
+		sv->sv_dirty = true;
+	}
+	if (result) {
+		sfs_wb_opend(sfs);
+		vfs_biglock_release();
+		return result;
 	}
 
 	/* Set the file size */
@@ -295,7 +486,7 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	/* Mark the inode dirty */
 	sv->sv_dirty = true;
 
+	sfs_wb_opend(sfs);
 	vfs_biglock_release();
 	return 0;
 }
-
@@ -39,22 +39,6 @@
 #include <sfs.h>
 #include "sfsprivate.h"
 
-/*
- * Read the directory entry out of slot SLOT of a directory vnode.
- * The "slot" is the index of the directory entry, starting at 0.
- */
-static
-int
-sfs_readdir(struct sfs_vnode *sv, int slot, struct sfs_direntry *sd)
-{
-	off_t actualpos;
-
-	/* Compute the actual position in the directory to read. */
-	actualpos = slot * sizeof(struct sfs_direntry);
-
-	return sfs_metaio(sv, actualpos, sd, sizeof(*sd), UIO_READ);
-}
-
 /*
  * Write (overwrite) the directory entry in slot SLOT of a directory
  * vnode.
@@ -95,48 +79,366 @@ sfs_dir_nentries(struct sfs_vnode *sv)
 }
 
 /*
- * Search a directory for a particular filename in a directory, and
- * return its inode number, its slot, and/or the slot number of an
- * empty directory slot if one is found.
+ * Number of directory entries that fit in one block.
+ */
+#define SFS_DIRPERBLOCK (SFS_BLOCKSIZE / sizeof(struct sfs_direntry))
+
+/*
+ * Read block BLOCK of a directory into SDS, handing back the number
+ * of entries actually present in it (the last block may be partial).
  */
+static
 int
-sfs_dir_findname(struct sfs_vnode *sv, const char *name,
-		uint32_t *ino, int *slot, int *emptyslot)
+sfs_dir_readblock(struct sfs_vnode *sv, unsigned block,
+		  struct sfs_direntry *sds, unsigned *ret)
 {
-	struct sfs_direntry tsd;
-	int found, nentries, i, result;
+	unsigned nentries, num;
+	int result;
 
 	nentries = sfs_dir_nentries(sv);
+	KASSERT(block * SFS_DIRPERBLOCK < nentries);
 
-	/* For each slot... */
-	found = 0;
-	for (i=0; i<nentries; i++) {
+	num = nentries - block * SFS_DIRPERBLOCK;
+	if (num > SFS_DIRPERBLOCK) {
+		num = SFS_DIRPERBLOCK;
+	}
+
+	result = sfs_metaio(sv, (off_t)block * SFS_BLOCKSIZE, sds,
+			    num * sizeof(struct sfs_direntry), UIO_READ);
+	if (result) {
+		return result;
+	}
+	*ret = num;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// In-core directory index
+
+/*
+ * The first time a directory is searched we read it a block at a
+ * time and build a hash table mapping each name to its inode number
+ * and slot, plus a list of the empty slots. After that, lookups and
+ * links do not read the directory at all.
+ *
+ * The index is only a cache of what is on disk. If we run out of
+ * memory building or updating it, we throw it away and fall back to
+ * scanning the directory until it can be built again.
+ */
+
+#define SFS_DIRINDEX_MINBUCKETS 16
+
+struct sfs_dirslot {
+	struct sfs_dirslot *ds_next;	/* hash chain or empty list */
+	char *ds_name;			/* name, or NULL if slot is empty */
+	uint32_t ds_ino;		/* inode number */
+	int ds_slot;			/* slot in the directory */
+};
+
+struct sfs_dirindex {
+	struct sfs_dirslot **di_buckets;
+	unsigned di_nbuckets;
+	unsigned di_count;		/* number of names */
+	struct sfs_dirslot *di_empty;	/* empty slots */
+};
+
+/*
+ * String hash (FNV-1a).
+ */
+static
+uint32_t
+sfs_dir_hash(const char *name)
+{
+	uint32_t h = 2166136261U;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/*
+ * Free a dirslot list.
+ */
+static
+void
+sfs_dirslot_freelist(struct sfs_dirslot *ds)
+{
+	struct sfs_dirslot *next;
 
-		/* Read the entry from that slot */
-		result = sfs_readdir(sv, i, &tsd);
+	while (ds != NULL) {
+		next = ds->ds_next;
+		if (ds->ds_name != NULL) {
+			kfree(ds->ds_name);
+		}
+		kfree(ds);
+		ds = next;
+	}
+}
+
+/*
+ * Throw away the index for a directory, if it has one.
+ */
+void
+sfs_dir_dropindex(struct sfs_vnode *sv)
+{
+	struct sfs_dirindex *di = sv->sv_dirindex;
+	unsigned i;
+
+	if (di == NULL) {
+		return;
+	}
+	for (i=0; i<di->di_nbuckets; i++) {
+		sfs_dirslot_freelist(di->di_buckets[i]);
+	}
+	sfs_dirslot_freelist(di->di_empty);
+	kfree(di->di_buckets);
+	kfree(di);
+	sv->sv_dirindex = NULL;
+}
+
+/*
+ * Find a name in the index.
+ */
+static
+struct sfs_dirslot *
+sfs_dirindex_find(struct sfs_dirindex *di, const char *name)
+{
+	struct sfs_dirslot *ds;
+
+	ds = di->di_buckets[sfs_dir_hash(name) % di->di_nbuckets];
+	while (ds != NULL) {
+		if (!strcmp(ds->ds_name, name)) {
+			return ds;
+		}
+		ds = ds->ds_next;
+	}
+	return NULL;
+}
+
+/*
+ * Double the number of hash buckets. If we can't get the memory,
+ * just keep the chains we have; they're longer but still correct.
+ */
+static
+void
+sfs_dirindex_grow(struct sfs_dirindex *di)
+{
+	struct sfs_dirslot **newbuckets, *ds, *next;
+	unsigned newnum, i, ix;
+
+	newnum = di->di_nbuckets * 2;
+	newbuckets = kmalloc(newnum * sizeof(*newbuckets));
+	if (newbuckets == NULL) {
+		return;
+	}
+	for (i=0; i<newnum; i++) {
+		newbuckets[i] = NULL;
+	}
+
+	for (i=0; i<di->di_nbuckets; i++) {
+		for (ds = di->di_buckets[i]; ds != NULL; ds = next) {
+			next = ds->ds_next;
+			ix = sfs_dir_hash(ds->ds_name) % newnum;
+			ds->ds_next = newbuckets[ix];
+			newbuckets[ix] = ds;
+		}
+	}
+
+	kfree(di->di_buckets);
+	di->di_buckets = newbuckets;
+	di->di_nbuckets = newnum;
+}
+
+/*
+ * Enter a name into the index, using DS if it's not null (it must
+ * then have already been removed from the empty list).
+ */
+static
+int
+sfs_dirindex_add(struct sfs_dirindex *di, struct sfs_dirslot *ds,
+		 const char *name, uint32_t ino, int slot)
+{
+	unsigned ix;
+
+	KASSERT(sfs_dirindex_find(di, name) == NULL);
+
+	if (ds == NULL) {
+		ds = kmalloc(sizeof(*ds));
+		if (ds == NULL) {
+			return ENOMEM;
+		}
+	}
+	ds->ds_name = kstrdup(name);
+	if (ds->ds_name == NULL) {
+		kfree(ds);
+		return ENOMEM;
+	}
+	ds->ds_ino = ino;
+	ds->ds_slot = slot;
+
+	ix = sfs_dir_hash(name) % di->di_nbuckets;
+	ds->ds_next = di->di_buckets[ix];
+	di->di_buckets[ix] = ds;
+	di->di_count++;
+
+	if (di->di_count > 2 * di->di_nbuckets) {
+		sfs_dirindex_grow(di);
+	}
+	return 0;
+}
+
+/*
+ * Put a slot on the empty list, using DS if it's not null.
+ */
+static
+int
+sfs_dirindex_addempty(struct sfs_dirindex *di, struct sfs_dirslot *ds,
+		      int slot)
+{
+	if (ds == NULL) {
+		ds = kmalloc(sizeof(*ds));
+		if (ds == NULL) {
+			return ENOMEM;
+		}
+	}
+	ds->ds_name = NULL;
+	ds->ds_ino = SFS_NOINO;
+	ds->ds_slot = slot;
+	ds->ds_next = di->di_empty;
+	di->di_empty = ds;
+	return 0;
+}
+
+/*
+ * Build the index for a directory by reading it a block at a time.
+ */
+static
+int
+sfs_dir_buildindex(struct sfs_vnode *sv)
+{
+	/* This is a static buffer; we need the big lock */
+	static struct sfs_direntry sds[SFS_DIRPERBLOCK];
+
+	struct sfs_dirindex *di;
+	unsigned nentries, nbuckets, block, num, i;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(sv->sv_dirindex == NULL);
+
+	nentries = sfs_dir_nentries(sv);
+	nbuckets = SFS_DIRINDEX_MINBUCKETS;
+	while (nbuckets < nentries / 2) {
+		nbuckets *= 2;
+	}
+
+	di = kmalloc(sizeof(*di));
+	if (di == NULL) {
+		return ENOMEM;
+	}
+	di->di_buckets = kmalloc(nbuckets * sizeof(*di->di_buckets));
+	if (di->di_buckets == NULL) {
+		kfree(di);
+		return ENOMEM;
+	}
+	for (i=0; i<nbuckets; i++) {
+		di->di_buckets[i] = NULL;
+	}
+	di->di_nbuckets = nbuckets;
+	di->di_count = 0;
+	di->di_empty = NULL;
+	sv->sv_dirindex = di;
+
+	for (block = 0; block * SFS_DIRPERBLOCK < nentries; block++) {
+		result = sfs_dir_readblock(sv, block, sds, &num);
 		if (result) {
+			sfs_dir_dropindex(sv);
 			return result;
 		}
-		if (tsd.sfd_ino == SFS_NOINO) {
-			/* Free slot - report it back if one was requested */
-			if (emptyslot != NULL) {
-				*emptyslot = i;
+		for (i=0; i<num; i++) {
+			if (sds[i].sfd_ino == SFS_NOINO) {
+				result = sfs_dirindex_addempty(di, NULL,
+					block * SFS_DIRPERBLOCK + i);
+			}
+			else {
+				/* Ensure null termination, just in case */
+				sds[i].sfd_name[sizeof(sds[i].sfd_name)-1] = 0;
+
+				/* Each name may legally appear only once... */
+				KASSERT(sfs_dirindex_find(di,
+						sds[i].sfd_name) == NULL);
+
+				result = sfs_dirindex_add(di, NULL,
+					sds[i].sfd_name, sds[i].sfd_ino,
+					block * SFS_DIRPERBLOCK + i);
 			}
+			if (result) {
+				sfs_dir_dropindex(sv);
+				return result;
+			}
+		}
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// Directory operations
+
+/*
+ * Search a directory for a particular filename by reading through
+ * it, without the index. This is the fallback for when there isn't
+ * memory for the index.
+ */
+static
+int
+sfs_dir_scanname(struct sfs_vnode *sv, const char *name,
+		 uint32_t *ino, int *slot, int *emptyslot)
+{
+	/* This is a static buffer; we need the big lock */
+	static struct sfs_direntry sds[SFS_DIRPERBLOCK];
+
+	unsigned nentries, block, num, i;
+	int found, result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	nentries = sfs_dir_nentries(sv);
+
+	/* For each block... */
+	found = 0;
+	for (block = 0; block * SFS_DIRPERBLOCK < nentries; block++) {
+
+		result = sfs_dir_readblock(sv, block, sds, &num);
+		if (result) {
+			return result;
 		}
-		else {
+
+		/* ... and each slot in it */
+		for (i=0; i<num; i++) {
+			if (sds[i].sfd_ino == SFS_NOINO) {
+				/* Free slot - report it back if requested */
+				if (emptyslot != NULL) {
+					*emptyslot = block*SFS_DIRPERBLOCK + i;
+				}
+				continue;
+			}
+
 			/* Ensure null termination, just in case */
-			tsd.sfd_name[sizeof(tsd.sfd_name)-1] = 0;
-			if (!strcmp(tsd.sfd_name, name)) {
+			sds[i].sfd_name[sizeof(sds[i].sfd_name)-1] = 0;
+			if (!strcmp(sds[i].sfd_name, name)) {
 
 				/* Each name may legally appear only once... */
 				KASSERT(found==0);
 
 				found = 1;
 				if (slot != NULL) {
-					*slot = i;
+					*slot = block*SFS_DIRPERBLOCK + i;
 				}
 				if (ino != NULL) {
-					*ino = tsd.sfd_ino;
+					*ino = sds[i].sfd_ino;
 				}
 			}
 		}
@@ -145,6 +447,48 @@ sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 	return found ? 0 : ENOENT;
 }
 
+/*
+ * Search a directory for a particular filename in a directory, and
+ * return its inode number, its slot, and/or the slot number of an
+ * empty directory slot if one is found.
+ */
+int
+sfs_dir_findname(struct sfs_vnode *sv, const char *name,
+		uint32_t *ino, int *slot, int *emptyslot)
+{
+	struct sfs_dirindex *di;
+	struct sfs_dirslot *ds;
+	int result;
+
+	if (sv->sv_dirindex == NULL) {
+		result = sfs_dir_buildindex(sv);
+		if (result == ENOMEM) {
+			return sfs_dir_scanname(sv, name, ino, slot,
+						emptyslot);
+		}
+		if (result) {
+			return result;
+		}
+	}
+	di = sv->sv_dirindex;
+
+	if (emptyslot != NULL && di->di_empty != NULL) {
+		*emptyslot = di->di_empty->ds_slot;
+	}
+
+	ds = sfs_dirindex_find(di, name);
+	if (ds == NULL) {
+		return ENOENT;
+	}
+	if (slot != NULL) {
+		*slot = ds->ds_slot;
+	}
+	if (ino != NULL) {
+		*ino = ds->ds_ino;
+	}
+	return 0;
+}
+
 /*
  * Create a link in a directory to the specified inode by number, with
  * the specified name, and optionally hand back the slot.
@@ -155,6 +499,8 @@ sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino, int *slot)
 	int emptyslot = -1;
 	int result;
 	struct sfs_direntry sd;
+	struct sfs_dirindex *di;
+	struct sfs_dirslot *ds;
 
 	/* Look up the name. We want to make sure it *doesn't* exist. */
 	result = sfs_dir_findname(sv, name, NULL, NULL, &emptyslot);
@@ -185,23 +531,65 @@ sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino, int *slot)
 	}
 
 	/* Write the entry. */
-	return sfs_writedir(sv, emptyslot, &sd);
+	result = sfs_writedir(sv, emptyslot, &sd);
+	if (result) {
+		return result;
+	}
+
+	/* Update the index, if there is one. */
+	di = sv->sv_dirindex;
+	if (di != NULL) {
+		ds = NULL;
+		if (di->di_empty != NULL &&
+		    di->di_empty->ds_slot == emptyslot) {
+			ds = di->di_empty;
+			di->di_empty = ds->ds_next;
+		}
+		if (sfs_dirindex_add(di, ds, name, ino, emptyslot)) {
+			sfs_dir_dropindex(sv);
+		}
+	}
+	return 0;
 }
 
 /*
- * Unlink a name in a directory, by slot number.
+ * Unlink a name in a directory, by slot number. NAME must be the
+ * name in that slot.
  */
 int
-sfs_dir_unlink(struct sfs_vnode *sv, int slot)
+sfs_dir_unlink(struct sfs_vnode *sv, const char *name, int slot)
 {
 	struct sfs_direntry sd;
+	struct sfs_dirindex *di;
+	struct sfs_dirslot **dsp, *ds;
+	int result;
 
 	/* Initialize a suitable directory entry... */
 	bzero(&sd, sizeof(sd));
 	sd.sfd_ino = SFS_NOINO;
 
 	/* ... and write it */
-	return sfs_writedir(sv, slot, &sd);
+	result = sfs_writedir(sv, slot, &sd);
+	if (result) {
+		return result;
+	}
+
+	/* Move the slot to the empty list in the index, if there is one. */
+	di = sv->sv_dirindex;
+	if (di != NULL) {
+		dsp = &di->di_buckets[sfs_dir_hash(name) % di->di_nbuckets];
+		while (*dsp != NULL && strcmp((*dsp)->ds_name, name)) {
+			dsp = &(*dsp)->ds_next;
+		}
+		ds = *dsp;
+		KASSERT(ds != NULL);
+		KASSERT(ds->ds_slot == slot);
+		*dsp = ds->ds_next;
+		di->di_count--;
+		kfree(ds->ds_name);
+		sfs_dirindex_addempty(di, ds, slot);
+	}
+	return 0;
 }
 
 /*
@@ -45,10 +45,37 @@
 #include "sfsprivate.h"
 
 
-/* Shortcuts for the size macros in kern/sfs.h */
-#define SFS_FS_NBLOCKS(sfs)        ((sfs)->sfs_sb.sb_nblocks)
-#define SFS_FS_FREEMAPBITS(sfs)    SFS_FREEMAPBITS(SFS_FS_NBLOCKS(sfs))
-#define SFS_FS_FREEMAPBLOCKS(sfs)  SFS_FREEMAPBLOCKS(SFS_FS_NBLOCKS(sfs))
+/*
+ * Make the on-disk image of freemap block J in BUF, from PTR, the
+ * same block of the in-memory freemap, and FREED, the same block of
+ * the freed map.
+ */
+static
+void
+sfs_freemapmask(struct sfs_fs *sfs, uint32_t j, const char *ptr,
+		const char *freed, char *buf)
+{
+	struct sfs_vnode *sv;
+	uint32_t i, num;
+	daddr_t first, block, end;
+
+	for (i=0; i<SFS_BLOCKSIZE; i++) {
+		buf[i] = ptr[i] & ~freed[i];
+	}
+
+	first = j * SFS_BITSPERBLOCK;
+	num = vnodearray_num(sfs->sfs_vnodes);
+	for (i=0; i<num; i++) {
+		sv = vnodearray_get(sfs->sfs_vnodes, i)->vn_data;
+		end = sv->sv_resstart + sv->sv_reslen;
+		for (block = sv->sv_resstart; block < end; block++) {
+			if (block >= first && block < first + SFS_BITSPERBLOCK) {
+				buf[(block - first) / CHAR_BIT] &=
+					~(1 << ((block - first) % CHAR_BIT));
+			}
+		}
+	}
+}
 
 /*
  * Routine for doing I/O (reads or writes) on the free block bitmap.
@@ -66,13 +93,20 @@
  *
  * The sectors used by the superblock and the bitmap itself are
  * likewise marked in use by mksfs.
+ *
+ * Blocks freed since the last sync (see sfs_bfree) and blocks reserved
+ * for growing files (see sfs_breserve) are marked in use in memory,
+ * but are written out as free.
  */
 static
 int
 sfs_freemapio(struct sfs_fs *sfs, enum uio_rw rw)
 {
+	/* Buffer for masking out blocks; protected by the big lock */
+	static char maskbuf[SFS_BLOCKSIZE];
+
 	uint32_t j, freemapblocks;
-	char *freemapdata;
+	char *freemapdata, *freeddata;
 	int result;
 
 	/* Number of blocks in the free block bitmap. */
@@ -80,6 +114,7 @@ sfs_freemapio(struct sfs_fs *sfs, enum uio_rw rw)
 
 	/* Pointer to our freemap data in memory. */
 	freemapdata = bitmap_getdata(sfs->sfs_freemap);
+	freeddata = bitmap_getdata(sfs->sfs_freedmap);
 
 	/* For each block in the free block bitmap... */
 	for (j=0; j<freemapblocks; j++) {
@@ -93,8 +128,10 @@ sfs_freemapio(struct sfs_fs *sfs, enum uio_rw rw)
 					       SFS_BLOCKSIZE);
 		}
 		else {
-			result = sfs_writeblock(sfs, SFS_FREEMAP_START+j, ptr,
-						SFS_BLOCKSIZE);
+			sfs_freemapmask(sfs, j, ptr,
+					freeddata + j*SFS_BLOCKSIZE, maskbuf);
+			result = sfs_writeblock(sfs, SFS_FREEMAP_START+j,
+						maskbuf, SFS_BLOCKSIZE);
 		}
 
 		/* If we failed, stop. */
@@ -155,7 +192,7 @@ sfs_sync(struct fs *fs)
 	num = vnodearray_num(sfs->sfs_vnodes);
 	for (i=0; i<num; i++) {
 		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+		sfs_sync_inode(v->vn_data);
 	}
 
 	/* If the free block map needs to be written, write it. */
@@ -179,6 +216,16 @@ sfs_sync(struct fs *fs)
 		sfs->sfs_superdirty = false;
 	}
 
+	/* Now push it all to disk */
+	result = sfs_wb_flush(sfs);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
+	/* Nothing on disk refers to the blocks freed before now */
+	sfs_bsynced(sfs);
+
 	vfs_biglock_release();
 	return 0;
 }
@@ -212,8 +259,13 @@ sfs_fs_destroy(struct sfs_fs *sfs)
 	if (sfs->sfs_freemap != NULL) {
 		bitmap_destroy(sfs->sfs_freemap);
 	}
+	if (sfs->sfs_freedmap != NULL) {
+		bitmap_destroy(sfs->sfs_freedmap);
+	}
 	vnodearray_destroy(sfs->sfs_vnodes);
 	KASSERT(sfs->sfs_device == NULL);
+	KASSERT(sfs->sfs_ra == NULL);
+	KASSERT(sfs->sfs_wb == NULL);
 	kfree(sfs);
 }
 
@@ -239,6 +291,11 @@ sfs_unmount(struct fs *fs)
 	/* We should have just had sfs_sync called. */
 	KASSERT(sfs->sfs_superdirty == false);
 	KASSERT(sfs->sfs_freemapdirty == false);
+	KASSERT(sfs->sfs_nfreed == 0);
+
+	/* Stop the syncer and read-ahead while we still have the device */
+	sfs_wb_destroy(sfs);
+	sfs_ra_destroy(sfs);
 
 	/* The vfs layer takes care of the device for us */
 	sfs->sfs_device = NULL;
@@ -309,6 +366,15 @@ sfs_fs_create(void)
 	/* freemap */
 	sfs->sfs_freemap = NULL;
 	sfs->sfs_freemapdirty = false;
+	sfs->sfs_freedmap = NULL;
+	sfs->sfs_nfreed = 0;
+
+	/* read-ahead and delayed writes start once the volume is loaded */
+	sfs->sfs_ra = NULL;
+	sfs->sfs_wb = NULL;
+
+	/* journal; set up when it's checked */
+	sfs->sfs_jseq = 0;
 
 	return sfs;
 
@@ -396,9 +462,18 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Ensure null termination of the volume name */
 	sfs->sfs_sb.sb_volname[sizeof(sfs->sfs_sb.sb_volname)-1] = 0;
 
+	/* Finish any transaction interrupted by a crash */
+	result = sfs_jnl_replay(sfs);
+	if (result) {
+		sfs_fs_destroy(sfs);
+		vfs_biglock_release();
+		return result;
+	}
+
 	/* Load free block bitmap */
 	sfs->sfs_freemap = bitmap_create(SFS_FS_FREEMAPBITS(sfs));
-	if (sfs->sfs_freemap == NULL) {
+	sfs->sfs_freedmap = bitmap_create(SFS_FS_FREEMAPBITS(sfs));
+	if (sfs->sfs_freemap == NULL || sfs->sfs_freedmap == NULL) {
 		sfs_fs_destroy(sfs);
 		vfs_biglock_release();
 		return ENOMEM;
@@ -409,6 +484,21 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 		vfs_biglock_release();
 		return result;
 	}
+	bitmap_recount(sfs->sfs_freemap);
+
+	/* Start read-ahead; if we can't, just do without */
+	result = sfs_ra_create(sfs);
+	if (result) {
+		kprintf("sfs: %s: no read-ahead: %s\n",
+			sfs->sfs_sb.sb_volname, strerror(result));
+	}
+
+	/* Likewise delayed writes */
+	result = sfs_wb_create(sfs);
+	if (result) {
+		kprintf("sfs: %s: no delayed writes: %s\n",
+			sfs->sfs_sb.sb_volname, strerror(result));
+	}
 
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
@@ -93,10 +93,20 @@ sfs_reclaim(struct vnode *v)
 	}
 	spinlock_release(&v->vn_countlock);
 
+	result = sfs_wb_opbegin(sfs, SFS_OPBLOCKS);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
+	/* Give back any blocks reserved for growth */
+	sfs_bunreserve(sv);
+
 	/* If there are no on-disk references to the file either, erase it. */
 	if (sv->sv_i.sfi_linkcount == 0) {
 		result = sfs_itrunc(sv, 0);
 		if (result) {
+			sfs_wb_opend(sfs);
 			vfs_biglock_release();
 			return result;
 		}
@@ -105,6 +115,7 @@ sfs_reclaim(struct vnode *v)
 	/* Sync the inode to disk */
 	result = sfs_sync_inode(sv);
 	if (result) {
+		sfs_wb_opend(sfs);
 		vfs_biglock_release();
 		return result;
 	}
@@ -131,8 +142,10 @@ sfs_reclaim(struct vnode *v)
 	}
 	vnodearray_remove(sfs->sfs_vnodes, ix);
 
+	sfs_dir_dropindex(sv);
 	vnode_cleanup(&sv->sv_absvn);
 
+	sfs_wb_opend(sfs);
 	vfs_biglock_release();
 
 	/* Release the storage for the vnode structure itself. */
@@ -205,6 +218,18 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Not dirty yet */
 	sv->sv_dirty = false;
 
+	/* Directory index is built on first use */
+	sv->sv_dirindex = NULL;
+
+	/* No blocks reserved yet */
+	sv->sv_resstart = 0;
+	sv->sv_reslen = 0;
+
+	/* No reads yet */
+	sv->sv_nextread = 0;
+	sv->sv_rawindow = 0;
+	sv->sv_ranext = 0;
+
 	/*
 	 * FORCETYPE is set if we're creating a new file, because the
 	 * block on disk will have been zeroed out by sfs_balloc and
@@ -269,7 +294,7 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 	 * number is the block number, so just get a block.)
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, 0, &ino);
 	if (result) {
 		return result;
 	}
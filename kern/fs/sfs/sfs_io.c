@@ -53,17 +53,15 @@
  */
 
 /*
- * Read or write a block, retrying I/O errors.
+ * Do device I/O, retrying I/O errors. This is also used by the
+ * syncer, which doesn't hold the big lock.
  */
-static
 int
-sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
+sfs_devio(struct sfs_fs *sfs, struct uio *uio)
 {
 	int result;
 	int tries=0;
 
-	KASSERT(vfs_biglock_do_i_hold());
-
 	DEBUG(DB_SFS, "sfs: %s %llu\n",
 	      uio->uio_rw == UIO_READ ? "read" : "write",
 	      uio->uio_offset / SFS_BLOCKSIZE);
@@ -99,35 +97,96 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 }
 
 /*
- * Read a block.
+ * Read or write a block directly.
+ */
+static
+int
+sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
+{
+	daddr_t block;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	block = uio->uio_offset / SFS_BLOCKSIZE;
+
+	result = sfs_devio(sfs, uio);
+
+	if (uio->uio_rw == UIO_WRITE) {
+		/* Any read-ahead copy of this block is now out of date */
+		sfs_ra_invalidate(sfs, block);
+	}
+	return result;
+}
+
+/*
+ * Read a block. Use the delayed-write buffers if they have it, and
+ * keep it there if there's room.
  */
 int
 sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 {
 	struct iovec iov;
 	struct uio ku;
+	int result;
 
 	KASSERT(len == SFS_BLOCKSIZE);
 
+	if (sfs_wb_read(sfs, block, data)) {
+		return 0;
+	}
+
 	SFSUIO(&iov, &ku, data, block, UIO_READ);
-	return sfs_rwblock(sfs, &ku);
+	result = sfs_rwblock(sfs, &ku);
+	if (result == 0) {
+		sfs_wb_insert(sfs, block, data);
+	}
+	return result;
 }
 
 /*
- * Write a block.
+ * Write a block. Once the volume is fully mounted this goes through
+ * the delayed-write buffers; see sfs_writeback.c. META says whether
+ * it's metadata, which isn't delayed if the volume has no journal.
  */
+static
 int
-sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
+sfs_writeblock_internal(struct sfs_fs *sfs, daddr_t block, void *data,
+			size_t len, bool meta)
 {
 	struct iovec iov;
 	struct uio ku;
 
 	KASSERT(len == SFS_BLOCKSIZE);
 
+	if (sfs->sfs_wb != NULL) {
+		KASSERT(vfs_biglock_do_i_hold());
+		return sfs_wb_write(sfs, block, data, meta);
+	}
+
 	SFSUIO(&iov, &ku, data, block, UIO_WRITE);
 	return sfs_rwblock(sfs, &ku);
 }
 
+/*
+ * Write a metadata block.
+ */
+int
+sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
+{
+	return sfs_writeblock_internal(sfs, block, data, len, true);
+}
+
+/*
+ * Write a block of file data.
+ */
+static
+int
+sfs_writedata(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
+{
+	return sfs_writeblock_internal(sfs, block, data, len, false);
+}
+
 ////////////////////////////////////////////////////////////
 //
 // File-level I/O
@@ -159,6 +218,7 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 	daddr_t diskblock;
 	uint32_t fileblock;
+	bool fresh;
 	int result;
 
 	/* Allocate missing blocks if and only if we're writing */
@@ -172,21 +232,26 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
-	/* Get the disk block number */
-	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
+	/*
+	 * Get the disk block number. A newly allocated block isn't
+	 * zeroed on disk; we zero the buffer instead and write the
+	 * whole thing below.
+	 */
+	result = sfs_bmap(sv, fileblock, doalloc, &fresh, &diskblock);
 	if (result) {
 		return result;
 	}
 
-	if (diskblock == 0) {
+	if (diskblock == 0 || fresh) {
 		/*
-		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * There was no block mapped at this point in the file,
+		 * or there wasn't until just now. Zero the buffer.
 		 */
-		KASSERT(uio->uio_rw == UIO_READ);
+		KASSERT(uio->uio_rw == UIO_READ || fresh);
 		bzero(iobuf, sizeof(iobuf));
 	}
-	else {
+	else if (!sfs_wb_read(sfs, diskblock, iobuf) &&
+		 !sfs_ra_get(sfs, diskblock, iobuf)) {
 		/*
 		 * Read the block.
 		 */
@@ -201,18 +266,31 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	 */
 	result = uiomove(iobuf+skipstart, len, uio);
 	if (result) {
+		if (fresh && sfs_clearblock(sfs, diskblock)) {
+			kprintf("sfs: block %u: could not clear after "
+				"failed write\n", diskblock);
+		}
 		return result;
 	}
 
 	/*
-	 * If it was a write, write back the modified block.
+	 * If it was a write, write back the modified block. A new block
+	 * that wasn't cleared on disk can't be left for later, or on a
+	 * volume without a journal the inode could reach the disk first
+	 * (see sfs_bmap); sfs_writeblock writes it through there.
 	 */
-	if (uio->uio_rw == UIO_WRITE) {
+	if (uio->uio_rw == UIO_WRITE && fresh) {
 		result = sfs_writeblock(sfs, diskblock, iobuf, sizeof(iobuf));
 		if (result) {
 			return result;
 		}
 	}
+	else if (uio->uio_rw == UIO_WRITE) {
+		result = sfs_writedata(sfs, diskblock, iobuf, sizeof(iobuf));
+		if (result) {
+			return result;
+		}
+	}
 
 	return 0;
 }
@@ -224,11 +302,21 @@ static
 int
 sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 {
+	/*
+	 * Buffer for blocks that have been read ahead.
+	 *
+	 * Note: in real life (and when you've done the fs assignment)
+	 * you would get space from the disk buffer cache for this,
+	 * not use a static area.
+	 */
+	static char rabuf[SFS_BLOCKSIZE];
+
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 	daddr_t diskblock;
 	uint32_t fileblock;
 	int result;
 	bool doalloc = (uio->uio_rw==UIO_WRITE);
+	bool fresh;
 	off_t saveoff;
 	off_t diskoff;
 	off_t saveres;
@@ -237,8 +325,12 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
-	/* Look up the disk block number */
-	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
+	/*
+	 * Look up the disk block number. If we're writing and a new
+	 * block gets allocated, don't bother zeroing it; we're about
+	 * to overwrite all of it.
+	 */
+	result = sfs_bmap(sv, fileblock, doalloc, &fresh, &diskblock);
 	if (result) {
 		return result;
 	}
@@ -254,6 +346,21 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 		return uiomovezeros(SFS_BLOCKSIZE, uio);
 	}
 
+	if (uio->uio_rw == UIO_READ) {
+		/* We're using a global static buffer; it had better be locked */
+		KASSERT(vfs_biglock_do_i_hold());
+
+		/* A delayed write is newer than what's on disk */
+		if (sfs_wb_read(sfs, diskblock, rabuf) ||
+		    sfs_ra_get(sfs, diskblock, rabuf)) {
+			return uiomove(rabuf, SFS_BLOCKSIZE, uio);
+		}
+	}
+	else {
+		/* We're replacing the whole block; drop any buffered copy */
+		sfs_wb_discard(sfs, diskblock);
+	}
+
 	/*
 	 * Do the I/O directly to the uio region. Save the uio_offset,
 	 * and substitute one that makes sense to the device.
@@ -279,9 +386,76 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	uio->uio_offset = (uio->uio_offset - diskoff) + saveoff;
 	uio->uio_resid = (uio->uio_resid - diskres) + saveres;
 
+	if (result && fresh) {
+		/* Don't leave whatever was there before visible */
+		if (sfs_clearblock(sfs, diskblock)) {
+			kprintf("sfs: block %u: could not clear after "
+				"failed write\n", diskblock);
+		}
+	}
+
 	return result;
 }
 
+/*
+ * Sequential read detection. A read that begins where the last one
+ * ended doubles the read-ahead window, up to SFS_RA_MAXWINDOW; any
+ * other read halves it. This is tracked per vnode rather than per
+ * open file, since that's all the VOP interface gives us.
+ */
+static
+void
+sfs_ra_check(struct sfs_vnode *sv, struct uio *uio)
+{
+	if (uio->uio_offset == sv->sv_nextread) {
+		if (sv->sv_rawindow == 0) {
+			sv->sv_rawindow = 1;
+		}
+		else if (sv->sv_rawindow < SFS_RA_MAXWINDOW) {
+			sv->sv_rawindow *= 2;
+		}
+	}
+	else {
+		sv->sv_rawindow /= 2;
+		sv->sv_ranext = 0;
+	}
+}
+
+/*
+ * After a read, ask for the blocks in the read-ahead window past the
+ * current position that haven't already been asked for.
+ */
+static
+void
+sfs_ra_issue(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	uint32_t fileblock, endblock, fileblocks;
+	daddr_t diskblock;
+
+	fileblock = sv->sv_nextread / SFS_BLOCKSIZE;
+	endblock = fileblock + sv->sv_rawindow;
+	fileblocks = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	if (endblock > fileblocks) {
+		endblock = fileblocks;
+	}
+	if (fileblock < sv->sv_ranext) {
+		fileblock = sv->sv_ranext;
+	}
+
+	for (; fileblock < endblock; fileblock++) {
+		if (sfs_bmap(sv, fileblock, false, NULL, &diskblock)) {
+			break;
+		}
+		if (diskblock != 0) {
+			sfs_ra_request(sfs, diskblock);
+		}
+	}
+	if (fileblock > sv->sv_ranext) {
+		sv->sv_ranext = fileblock;
+	}
+}
+
 /*
  * Do I/O of a whole region of data, whether or not it's block-aligned.
  */
@@ -304,6 +478,8 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 		off_t size = sv->sv_i.sfi_size;
 		off_t endpos = uio->uio_offset + uio->uio_resid;
 
+		sfs_ra_check(sv, uio);
+
 		if (uio->uio_offset >= size) {
 			/* At or past EOF - just return */
 			return 0;
@@ -378,6 +554,14 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 		sv->sv_dirty = true;
 	}
 
+	/* Remember where we got to, and read ahead from there */
+	if (uio->uio_rw == UIO_READ) {
+		sv->sv_nextread = uio->uio_offset;
+		if (result == 0 && sv->sv_rawindow > 0) {
+			sfs_ra_issue(sv);
+		}
+	}
+
 	/* Add in any extra amount we couldn't read because of EOF */
 	uio->uio_resid += extraresid;
 
@@ -429,7 +613,7 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 
 	/* Get the disk block number */
 	doalloc = (rw == UIO_WRITE);
-	result = sfs_bmap(sv, vnblock, doalloc, &diskblock);
+	result = sfs_bmap(sv, vnblock, doalloc, NULL, &diskblock);
 	if (result) {
 		return result;
 	}
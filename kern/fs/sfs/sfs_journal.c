@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * SFS filesystem
+ *
+ * Metadata journal.
+ *
+ * The on-disk layout is described in kern/sfs.h. The delayed-write
+ * code in sfs_writeback.c hands us the whole set of dirty blocks as
+ * one transaction; we write it to the journal, it writes the blocks
+ * home, and then we advance the journal header past the transaction.
+ * Because the dirty set is taken when the volume is synced, under the
+ * big lock, a transaction holds inode, freemap, directory, and
+ * indirect block updates from whole operations only.
+ *
+ * At mount time, before anything else is read, a complete transaction
+ * still in the journal is written home again. An incomplete one (no
+ * commit record, or a bad checksum) never reached its home blocks and
+ * is ignored. Either way recovery reads at most one journal's worth
+ * of blocks, however big the volume is.
+ *
+ * Journal I/O bypasses the delayed-write buffers.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <vfs.h>
+#include <sfs.h>
+#include "sfsprivate.h"
+
+/* FNV-1a, for the commit checksum */
+#define SFS_JNL_HASHINIT  2166136261U
+#define SFS_JNL_HASHPRIME 16777619U
+
+/* Shortcuts */
+#define SFS_JNL_START(sfs)  ((sfs)->sfs_sb.sb_journalstart)
+#define SFS_JNL_BLOCKS(sfs) ((sfs)->sfs_sb.sb_journalblocks)
+
+/* Record and block buffers; protected by the big lock */
+static struct sfs_jrecord sfs_jnl_rec;
+static char sfs_jnl_buf[SFS_BLOCKSIZE];
+static uint32_t sfs_jnl_homes[SFS_JNL_MAXBLOCKS];
+
+static
+uint32_t
+sfs_jnl_hash(uint32_t hash, const void *data)
+{
+	const unsigned char *p = data;
+	unsigned i;
+
+	for (i=0; i<SFS_BLOCKSIZE; i++) {
+		hash ^= p[i];
+		hash *= SFS_JNL_HASHPRIME;
+	}
+	return hash;
+}
+
+/*
+ * Read or write a block of the journal, or a home block.
+ */
+static
+int
+sfs_jnl_io(struct sfs_fs *sfs, daddr_t block, void *data, enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+
+	SFSUIO(&iov, &ku, data, block, rw);
+	return sfs_devio(sfs, &ku);
+}
+
+/*
+ * Write a header, descriptor, or commit record into journal block
+ * OFFSET. Fills in the magic number; the caller fills in the rest.
+ */
+static
+int
+sfs_jnl_putrec(struct sfs_fs *sfs, uint32_t offset, uint32_t type)
+{
+	sfs_jnl_rec.jr_magic = SFS_JNL_MAGIC;
+	sfs_jnl_rec.jr_type = type;
+	return sfs_jnl_io(sfs, SFS_JNL_START(sfs) + offset, &sfs_jnl_rec,
+			  UIO_WRITE);
+}
+
+/*
+ * Read the record in journal block OFFSET and check that it's a
+ * record of type TYPE for transaction SEQ.
+ */
+static
+int
+sfs_jnl_getrec(struct sfs_fs *sfs, uint32_t offset, uint32_t type,
+	       uint32_t seq, bool *ok)
+{
+	int result;
+
+	result = sfs_jnl_io(sfs, SFS_JNL_START(sfs) + offset, &sfs_jnl_rec,
+			    UIO_READ);
+	if (result) {
+		return result;
+	}
+	*ok = sfs_jnl_rec.jr_magic == SFS_JNL_MAGIC &&
+		sfs_jnl_rec.jr_type == type &&
+		sfs_jnl_rec.jr_seq == seq &&
+		sfs_jnl_rec.jr_nblocks <= SFS_JNL_MAXBLOCKS;
+	return 0;
+}
+
+/*
+ * Write N blocks (home locations BLOCKS, contents DATA) to the
+ * journal as one transaction. Once this returns success the blocks
+ * may be written home.
+ */
+int
+sfs_jnl_commit(struct sfs_fs *sfs, unsigned n,
+	       const daddr_t *blocks, char *const *data)
+{
+	uint32_t hash;
+	unsigned i;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(SFS_JNL_BLOCKS(sfs) > 0);
+	KASSERT(n > 0 && n <= SFS_JNL_MAXBLOCKS);
+
+	bzero(&sfs_jnl_rec, sizeof(sfs_jnl_rec));
+	sfs_jnl_rec.jr_seq = sfs->sfs_jseq;
+	sfs_jnl_rec.jr_nblocks = n;
+	for (i=0; i<n; i++) {
+		sfs_jnl_rec.jr_blocks[i] = blocks[i];
+	}
+	result = sfs_jnl_putrec(sfs, 1, SFS_JNL_DESC);
+	if (result) {
+		return result;
+	}
+
+	hash = SFS_JNL_HASHINIT;
+	for (i=0; i<n; i++) {
+		result = sfs_jnl_io(sfs, SFS_JNL_START(sfs) + 2 + i, data[i],
+				    UIO_WRITE);
+		if (result) {
+			return result;
+		}
+		hash = sfs_jnl_hash(hash, data[i]);
+	}
+
+	bzero(&sfs_jnl_rec, sizeof(sfs_jnl_rec));
+	sfs_jnl_rec.jr_seq = sfs->sfs_jseq;
+	sfs_jnl_rec.jr_nblocks = n;
+	sfs_jnl_rec.jr_sum = hash;
+	return sfs_jnl_putrec(sfs, 2 + n, SFS_JNL_COMMIT);
+}
+
+/*
+ * The current transaction is home; advance the header past it.
+ */
+int
+sfs_jnl_checkpoint(struct sfs_fs *sfs)
+{
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(SFS_JNL_BLOCKS(sfs) > 0);
+
+	bzero(&sfs_jnl_rec, sizeof(sfs_jnl_rec));
+	sfs_jnl_rec.jr_seq = sfs->sfs_jseq + 1;
+	result = sfs_jnl_putrec(sfs, 0, SFS_JNL_HEADER);
+	if (result) {
+		return result;
+	}
+	sfs->sfs_jseq++;
+	return 0;
+}
+
+/*
+ * Check the journal and replay the transaction in it, if it's
+ * complete. Called at mount time after the superblock is loaded.
+ */
+int
+sfs_jnl_replay(struct sfs_fs *sfs)
+{
+	uint32_t start, nblocks, seq, n, i;
+	uint32_t hash;
+	bool ok;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	start = SFS_JNL_START(sfs);
+	nblocks = SFS_JNL_BLOCKS(sfs);
+	if (nblocks == 0) {
+		/* No journal */
+		return 0;
+	}
+	if (start < SFS_FREEMAP_START + SFS_FS_FREEMAPBLOCKS(sfs) ||
+	    nblocks < SFS_JNL_MAXBLOCKS + 3 ||
+	    start + nblocks > SFS_FS_NBLOCKS(sfs)) {
+		kprintf("sfs: %s: bad journal location %u+%u\n",
+			sfs->sfs_sb.sb_volname, start, nblocks);
+		return EINVAL;
+	}
+
+	result = sfs_jnl_io(sfs, start, &sfs_jnl_rec, UIO_READ);
+	if (result) {
+		return result;
+	}
+	if (sfs_jnl_rec.jr_magic != SFS_JNL_MAGIC ||
+	    sfs_jnl_rec.jr_type != SFS_JNL_HEADER) {
+		kprintf("sfs: %s: bad journal header\n",
+			sfs->sfs_sb.sb_volname);
+		return EINVAL;
+	}
+	seq = sfs_jnl_rec.jr_seq;
+	sfs->sfs_jseq = seq;
+
+	/* Is there a transaction? */
+	result = sfs_jnl_getrec(sfs, 1, SFS_JNL_DESC, seq, &ok);
+	if (result) {
+		return result;
+	}
+	n = sfs_jnl_rec.jr_nblocks;
+	if (!ok || n == 0) {
+		return 0;
+	}
+	for (i=0; i<n; i++) {
+		sfs_jnl_homes[i] = sfs_jnl_rec.jr_blocks[i];
+		if (sfs_jnl_homes[i] >= SFS_FS_NBLOCKS(sfs) ||
+		    (sfs_jnl_homes[i] >= start &&
+		     sfs_jnl_homes[i] < start + nblocks)) {
+			kprintf("sfs: %s: journal transaction %u: "
+				"bad block %u\n", sfs->sfs_sb.sb_volname,
+				seq, sfs_jnl_homes[i]);
+			return EINVAL;
+		}
+	}
+
+	/* Is it complete? */
+	hash = SFS_JNL_HASHINIT;
+	for (i=0; i<n; i++) {
+		result = sfs_jnl_io(sfs, start + 2 + i, sfs_jnl_buf,
+				    UIO_READ);
+		if (result) {
+			return result;
+		}
+		hash = sfs_jnl_hash(hash, sfs_jnl_buf);
+	}
+	result = sfs_jnl_getrec(sfs, 2 + n, SFS_JNL_COMMIT, seq, &ok);
+	if (result) {
+		return result;
+	}
+	if (!ok || sfs_jnl_rec.jr_nblocks != n || sfs_jnl_rec.jr_sum != hash) {
+		kprintf("sfs: %s: discarding incomplete journal "
+			"transaction %u\n", sfs->sfs_sb.sb_volname, seq);
+		return 0;
+	}
+
+	/* Yes; write it home */
+	for (i=0; i<n; i++) {
+		result = sfs_jnl_io(sfs, start + 2 + i, sfs_jnl_buf,
+				    UIO_READ);
+		if (result) {
+			return result;
+		}
+		result = sfs_jnl_io(sfs, sfs_jnl_homes[i], sfs_jnl_buf,
+				    UIO_WRITE);
+		if (result) {
+			return result;
+		}
+	}
+	result = sfs_jnl_checkpoint(sfs);
+	if (result) {
+		return result;
+	}
+
+	kprintf("sfs: %s: replayed journal transaction %u (%u blocks)\n",
+		sfs->sfs_sb.sb_volname, seq, n);
+	return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * SFS filesystem
+ *
+ * Read-ahead.
+ *
+ * When sfs_io sees a file being read sequentially, it asks for the
+ * next few blocks to be read in advance. A per-volume work item,
+ * run by the kernel work queues, reads them into a small set of
+ * block buffers while the reader is off doing something else with
+ * the data it already has, and sfs_blockio and sfs_partialio check
+ * those buffers before going to the disk.
+ *
+ * The read-ahead work does not take the big lock, so reads can
+ * proceed while other filesystem operations run; it talks to the
+ * device directly. Every block write goes through sfs_rwblock, which
+ * calls sfs_ra_invalidate, so buffered blocks never go stale. A block
+ * written while its read is in flight is discarded when the read
+ * finishes.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <workqueue.h>
+#include <vfs.h>
+#include <device.h>
+#include <sfs.h>
+#include "sfsprivate.h"
+
+/* Number of block buffers per volume */
+#define SFS_RA_SLOTS 32
+
+typedef enum {
+	SFS_RA_EMPTY,		/* not in use */
+	SFS_RA_PENDING,		/* requested, not yet started */
+	SFS_RA_INFLIGHT,	/* being read */
+	SFS_RA_VALID,		/* holds the block's contents */
+} sfs_rastate_t;
+
+struct sfs_raslot {
+	daddr_t rs_block;		/* disk block */
+	sfs_rastate_t rs_state;
+	bool rs_stale;			/* written while in flight */
+	unsigned rs_lastuse;		/* for FIFO/LRU ordering */
+	char *rs_data;			/* SFS_BLOCKSIZE bytes */
+};
+
+struct sfs_readahead {
+	struct lock *ra_lock;		/* protects everything here */
+	struct cv *ra_cv;		/* signaled on any state change */
+	struct work ra_work;		/* reads pending blocks */
+	bool ra_shutdown;		/* don't start any more reads */
+	unsigned ra_clock;		/* counter for rs_lastuse */
+	struct sfs_raslot ra_slots[SFS_RA_SLOTS];
+};
+
+/*
+ * Find the slot holding (or about to hold) BLOCK.
+ */
+static
+struct sfs_raslot *
+sfs_ra_find(struct sfs_readahead *ra, daddr_t block)
+{
+	unsigned i;
+
+	for (i=0; i<SFS_RA_SLOTS; i++) {
+		if (ra->ra_slots[i].rs_state != SFS_RA_EMPTY &&
+		    ra->ra_slots[i].rs_block == block) {
+			return &ra->ra_slots[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * The read-ahead work. Reads pending blocks in the order they were
+ * requested, until there aren't any; sfs_ra_request submits it again
+ * when there are.
+ */
+static
+void
+sfs_ra_work(void *data)
+{
+	struct sfs_fs *sfs = data;
+	struct sfs_readahead *ra = sfs->sfs_ra;
+	struct sfs_raslot *rs;
+	struct iovec iov;
+	struct uio ku;
+	daddr_t block;
+	unsigned i;
+	int result;
+
+	lock_acquire(ra->ra_lock);
+	while (!ra->ra_shutdown) {
+		rs = NULL;
+		for (i=0; i<SFS_RA_SLOTS; i++) {
+			if (ra->ra_slots[i].rs_state == SFS_RA_PENDING &&
+			    (rs == NULL ||
+			     ra->ra_slots[i].rs_lastuse < rs->rs_lastuse)) {
+				rs = &ra->ra_slots[i];
+			}
+		}
+		if (rs == NULL) {
+			break;
+		}
+
+		rs->rs_state = SFS_RA_INFLIGHT;
+		rs->rs_stale = false;
+		block = rs->rs_block;
+		lock_release(ra->ra_lock);
+
+		SFSUIO(&iov, &ku, rs->rs_data, block, UIO_READ);
+		result = DEVOP_IO(sfs->sfs_device, &ku);
+
+		lock_acquire(ra->ra_lock);
+		if (result || rs->rs_stale) {
+			rs->rs_state = SFS_RA_EMPTY;
+		}
+		else {
+			rs->rs_state = SFS_RA_VALID;
+		}
+		cv_broadcast(ra->ra_cv, ra->ra_lock);
+	}
+	lock_release(ra->ra_lock);
+}
+
+/*
+ * Ask for BLOCK to be read ahead. If there's no room, forget it.
+ */
+void
+sfs_ra_request(struct sfs_fs *sfs, daddr_t block)
+{
+	struct sfs_readahead *ra = sfs->sfs_ra;
+	struct sfs_raslot *rs;
+	unsigned i;
+
+	if (ra == NULL) {
+		return;
+	}
+
+	lock_acquire(ra->ra_lock);
+	if (sfs_ra_find(ra, block) != NULL) {
+		lock_release(ra->ra_lock);
+		return;
+	}
+
+	/* Use an empty slot, or else the least recently used full one */
+	rs = NULL;
+	for (i=0; i<SFS_RA_SLOTS; i++) {
+		if (ra->ra_slots[i].rs_state == SFS_RA_EMPTY) {
+			rs = &ra->ra_slots[i];
+			break;
+		}
+		if (ra->ra_slots[i].rs_state == SFS_RA_VALID &&
+		    (rs == NULL ||
+		     ra->ra_slots[i].rs_lastuse < rs->rs_lastuse)) {
+			rs = &ra->ra_slots[i];
+		}
+	}
+	if (rs != NULL) {
+		rs->rs_block = block;
+		rs->rs_state = SFS_RA_PENDING;
+		rs->rs_lastuse = ra->ra_clock++;
+		work_submit(&ra->ra_work);
+	}
+	lock_release(ra->ra_lock);
+}
+
+/*
+ * If BLOCK has been read ahead, copy it into BUF and return true.
+ * If it's being read right now, wait for it. If it's been requested
+ * but not started, cancel the request; the caller will read it
+ * itself sooner than we would.
+ */
+bool
+sfs_ra_get(struct sfs_fs *sfs, daddr_t block, void *buf)
+{
+	struct sfs_readahead *ra = sfs->sfs_ra;
+	struct sfs_raslot *rs;
+	bool ret = false;
+
+	if (ra == NULL) {
+		return false;
+	}
+
+	lock_acquire(ra->ra_lock);
+	while ((rs = sfs_ra_find(ra, block)) != NULL &&
+	       rs->rs_state == SFS_RA_INFLIGHT) {
+		cv_wait(ra->ra_cv, ra->ra_lock);
+	}
+	if (rs != NULL) {
+		if (rs->rs_state == SFS_RA_PENDING) {
+			rs->rs_state = SFS_RA_EMPTY;
+		}
+		else {
+			KASSERT(rs->rs_state == SFS_RA_VALID);
+			memcpy(buf, rs->rs_data, SFS_BLOCKSIZE);
+			rs->rs_lastuse = ra->ra_clock++;
+			ret = true;
+		}
+	}
+	lock_release(ra->ra_lock);
+	return ret;
+}
+
+/*
+ * BLOCK has been written; forget anything we have for it.
+ */
+void
+sfs_ra_invalidate(struct sfs_fs *sfs, daddr_t block)
+{
+	struct sfs_readahead *ra = sfs->sfs_ra;
+	struct sfs_raslot *rs;
+
+	if (ra == NULL) {
+		return;
+	}
+
+	lock_acquire(ra->ra_lock);
+	rs = sfs_ra_find(ra, block);
+	if (rs != NULL) {
+		if (rs->rs_state == SFS_RA_INFLIGHT) {
+			rs->rs_stale = true;
+		}
+		else {
+			rs->rs_state = SFS_RA_EMPTY;
+		}
+	}
+	lock_release(ra->ra_lock);
+}
+
+/*
+ * Set up read-ahead for a volume. Called at the end of mount.
+ */
+int
+sfs_ra_create(struct sfs_fs *sfs)
+{
+	struct sfs_readahead *ra;
+	unsigned i;
+	int result;
+
+	KASSERT(sfs->sfs_ra == NULL);
+
+	ra = kmalloc(sizeof(*ra));
+	if (ra == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<SFS_RA_SLOTS; i++) {
+		ra->ra_slots[i].rs_state = SFS_RA_EMPTY;
+		ra->ra_slots[i].rs_data = NULL;
+	}
+	ra->ra_lock = lock_create("sfs-readahead");
+	ra->ra_cv = cv_create("sfs-readahead");
+	if (ra->ra_lock == NULL || ra->ra_cv == NULL) {
+		result = ENOMEM;
+		goto fail;
+	}
+	for (i=0; i<SFS_RA_SLOTS; i++) {
+		ra->ra_slots[i].rs_data = kmalloc(SFS_BLOCKSIZE);
+		if (ra->ra_slots[i].rs_data == NULL) {
+			result = ENOMEM;
+			goto fail;
+		}
+	}
+	work_init(&ra->ra_work, sfs_ra_work, sfs);
+	ra->ra_shutdown = false;
+	ra->ra_clock = 0;
+
+	sfs->sfs_ra = ra;
+	return 0;
+
+ fail:
+	for (i=0; i<SFS_RA_SLOTS; i++) {
+		if (ra->ra_slots[i].rs_data != NULL) {
+			kfree(ra->ra_slots[i].rs_data);
+		}
+	}
+	if (ra->ra_cv != NULL) {
+		cv_destroy(ra->ra_cv);
+	}
+	if (ra->ra_lock != NULL) {
+		lock_destroy(ra->ra_lock);
+	}
+	kfree(ra);
+	return result;
+}
+
+/*
+ * Stop read-ahead and free everything. Called during unmount, while
+ * the device is still attached.
+ */
+void
+sfs_ra_destroy(struct sfs_fs *sfs)
+{
+	struct sfs_readahead *ra = sfs->sfs_ra;
+	unsigned i;
+
+	if (ra == NULL) {
+		return;
+	}
+
+	lock_acquire(ra->ra_lock);
+	ra->ra_shutdown = true;
+	lock_release(ra->ra_lock);
+
+	work_cancel(&ra->ra_work);
+	work_wait(&ra->ra_work);
+	work_cleanup(&ra->ra_work);
+
+	sfs->sfs_ra = NULL;
+
+	for (i=0; i<SFS_RA_SLOTS; i++) {
+		kfree(ra->ra_slots[i].rs_data);
+	}
+	cv_destroy(ra->ra_cv);
+	lock_destroy(ra->ra_lock);
+	kfree(ra);
+}
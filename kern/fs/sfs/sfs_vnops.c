@@ -116,13 +116,41 @@ static
 int
 sfs_write(struct vnode *v, struct uio *uio)
 {
+	struct sfs_fs *sfs = v->vn_fs->fs_data;
 	struct sfs_vnode *sv = v->vn_data;
-	int result;
+	size_t rest;
+	int result = 0;
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
 	vfs_biglock_acquire();
-	result = sfs_io(sv, uio);
+
+	/*
+	 * Do the write as a series of operations of at most
+	 * SFS_WRITECHUNK bytes, so a big write doesn't need a journal
+	 * transaction big enough to hold all of it. Hide the rest of
+	 * the uio from sfs_io while it does each one.
+	 */
+	while (result == 0 && uio->uio_resid > 0) {
+		rest = 0;
+		if (uio->uio_resid > SFS_WRITECHUNK) {
+			rest = uio->uio_resid - SFS_WRITECHUNK;
+			uio->uio_resid = SFS_WRITECHUNK;
+		}
+
+		result = sfs_wb_opbegin(sfs, SFS_OPBLOCKS);
+		if (result == 0) {
+			result = sfs_io(sv, uio);
+			sfs_wb_opend(sfs);
+		}
+		uio->uio_resid += rest;
+
+		if (sfs_bretry(sfs, result)) {
+			/* Freed blocks are free now; carry on */
+			result = 0;
+		}
+	}
+
 	vfs_biglock_release();
 
 	return result;
@@ -215,19 +243,16 @@ sfs_isseekable(struct vnode *v)
 /*
  * Called for fsync(), and also on filesystem unmount, global sync(),
  * and some other cases.
+ *
+ * Delayed writes and journal transactions are per volume, and a
+ * transaction must not hold half an operation, so this syncs the
+ * whole volume.
  */
 static
 int
 sfs_fsync(struct vnode *v)
 {
-	struct sfs_vnode *sv = v->vn_data;
-	int result;
-
-	vfs_biglock_acquire();
-	result = sfs_sync_inode(sv);
-	vfs_biglock_release();
-
-	return result;
+	return FSOP_SYNC(v->vn_fs);
 }
 
 /*
@@ -286,19 +311,29 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_vnode *newguy;
 	uint32_t ino;
+	bool retried = false;
 	int result;
 
 	vfs_biglock_acquire();
 
+ again:
+	result = sfs_wb_opbegin(sfs, SFS_OPBLOCKS);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
 	/* Look up the name */
 	result = sfs_dir_findname(sv, name, &ino, NULL, NULL);
 	if (result!=0 && result!=ENOENT) {
+		sfs_wb_opend(sfs);
 		vfs_biglock_release();
 		return result;
 	}
 
 	/* If it exists and we didn't want it to, fail */
 	if (result==0 && excl) {
+		sfs_wb_opend(sfs);
 		vfs_biglock_release();
 		return EEXIST;
 	}
@@ -307,10 +342,12 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 		/* We got something; load its vnode and return */
 		result = sfs_loadvnode(sfs, ino, SFS_TYPE_INVAL, &newguy);
 		if (result) {
+			sfs_wb_opend(sfs);
 			vfs_biglock_release();
 			return result;
 		}
 		*ret = &newguy->sv_absvn;
+		sfs_wb_opend(sfs);
 		vfs_biglock_release();
 		return 0;
 	}
@@ -318,6 +355,11 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	/* Didn't exist - create it */
 	result = sfs_makeobj(sfs, SFS_TYPE_FILE, &newguy);
 	if (result) {
+		sfs_wb_opend(sfs);
+		if (!retried && sfs_bretry(sfs, result)) {
+			retried = true;
+			goto again;
+		}
 		vfs_biglock_release();
 		return result;
 	}
@@ -329,6 +371,11 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 	result = sfs_dir_link(sv, name, newguy->sv_ino, NULL);
 	if (result) {
 		VOP_DECREF(&newguy->sv_absvn);
+		sfs_wb_opend(sfs);
+		if (!retried && sfs_bretry(sfs, result)) {
+			retried = true;
+			goto again;
+		}
 		vfs_biglock_release();
 		return result;
 	}
@@ -341,6 +388,7 @@ sfs_creat(struct vnode *v, const char *name, bool excl, mode_t mode,
 
 	*ret = &newguy->sv_absvn;
 
+	sfs_wb_opend(sfs);
 	vfs_biglock_release();
 	return 0;
 }
@@ -354,6 +402,7 @@ static
 int
 sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 {
+	struct sfs_fs *sfs = dir->vn_fs->fs_data;
 	struct sfs_vnode *sv = dir->vn_data;
 	struct sfs_vnode *f = file->vn_data;
 	int result;
@@ -362,8 +411,15 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 
 	vfs_biglock_acquire();
 
+	result = sfs_wb_opbegin(sfs, SFS_OPBLOCKS);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
 	/* Hard links to directories aren't allowed. */
 	if (f->sv_i.sfi_type == SFS_TYPE_DIR) {
+		sfs_wb_opend(sfs);
 		vfs_biglock_release();
 		return EINVAL;
 	}
@@ -371,6 +427,7 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 	/* Create the link */
 	result = sfs_dir_link(sv, name, f->sv_ino, NULL);
 	if (result) {
+		sfs_wb_opend(sfs);
 		vfs_biglock_release();
 		return result;
 	}
@@ -379,6 +436,7 @@ sfs_link(struct vnode *dir, const char *name, struct vnode *file)
 	f->sv_i.sfi_linkcount++;
 	f->sv_dirty = true;
 
+	sfs_wb_opend(sfs);
 	vfs_biglock_release();
 	return 0;
 }
@@ -390,6 +448,7 @@ static
 int
 sfs_remove(struct vnode *dir, const char *name)
 {
+	struct sfs_fs *sfs = dir->vn_fs->fs_data;
 	struct sfs_vnode *sv = dir->vn_data;
 	struct sfs_vnode *victim;
 	int slot;
@@ -397,15 +456,22 @@ sfs_remove(struct vnode *dir, const char *name)
 
 	vfs_biglock_acquire();
 
+	result = sfs_wb_opbegin(sfs, SFS_OPBLOCKS);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
 	/* Look for the file and fetch a vnode for it. */
 	result = sfs_lookonce(sv, name, &victim, &slot);
 	if (result) {
+		sfs_wb_opend(sfs);
 		vfs_biglock_release();
 		return result;
 	}
 
 	/* Erase its directory entry. */
-	result = sfs_dir_unlink(sv, slot);
+	result = sfs_dir_unlink(sv, name, slot);
 	if (result==0) {
 		/* If we succeeded, decrement the link count. */
 		KASSERT(victim->sv_i.sfi_linkcount > 0);
@@ -416,6 +482,7 @@ sfs_remove(struct vnode *dir, const char *name)
 	/* Discard the reference that sfs_lookonce got us */
 	VOP_DECREF(&victim->sv_absvn);
 
+	sfs_wb_opend(sfs);
 	vfs_biglock_release();
 	return result;
 }
@@ -431,6 +498,7 @@ int
 sfs_rename(struct vnode *d1, const char *n1,
 	   struct vnode *d2, const char *n2)
 {
+	struct sfs_fs *sfs = d1->vn_fs->fs_data;
 	struct sfs_vnode *sv = d1->vn_data;
 	struct sfs_vnode *g1;
 	int slot1, slot2;
@@ -438,12 +506,19 @@ sfs_rename(struct vnode *d1, const char *n1,
 
 	vfs_biglock_acquire();
 
+	result = sfs_wb_opbegin(sfs, SFS_OPBLOCKS);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
 	KASSERT(d1==d2);
 	KASSERT(sv->sv_ino == SFS_ROOTDIR_INO);
 
 	/* Look up the old name of the file and get its inode and slot number*/
 	result = sfs_lookonce(sv, n1, &g1, &slot1);
 	if (result) {
+		sfs_wb_opend(sfs);
 		vfs_biglock_release();
 		return result;
 	}
@@ -469,7 +544,7 @@ sfs_rename(struct vnode *d1, const char *n1,
 	g1->sv_dirty = true;
 
 	/* Unlink the old slot */
-	result = sfs_dir_unlink(sv, slot1);
+	result = sfs_dir_unlink(sv, n1, slot1);
 	if (result) {
 		goto puke_harder;
 	}
@@ -485,6 +560,7 @@ sfs_rename(struct vnode *d1, const char *n1,
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_absvn);
 
+	sfs_wb_opend(sfs);
 	vfs_biglock_release();
 	return 0;
 
@@ -492,7 +568,7 @@ sfs_rename(struct vnode *d1, const char *n1,
 	/*
 	 * Error recovery: try to undo what we already did
 	 */
-	result2 = sfs_dir_unlink(sv, slot2);
+	result2 = sfs_dir_unlink(sv, n2, slot2);
 	if (result2) {
 		kprintf("sfs: rename: %s\n", strerror(result));
 		kprintf("sfs: rename: while cleaning up: %s\n",
@@ -503,6 +579,7 @@ sfs_rename(struct vnode *d1, const char *n1,
  puke:
 	/* Let go of the reference to g1 */
 	VOP_DECREF(&g1->sv_absvn);
+	sfs_wb_opend(sfs);
 	vfs_biglock_release();
 	return result;
 }
@@ -594,6 +671,7 @@ const struct vnode_ops sfs_fileops = {
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
+	.vop_poll = vopnoblock_poll,
 	.vop_fsync = sfs_fsync,
 	.vop_mmap = sfs_mmap,
 	.vop_truncate = sfs_truncate,
@@ -628,6 +706,7 @@ const struct vnode_ops sfs_dirops = {
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
+	.vop_poll = vopnoblock_poll,
 	.vop_fsync = sfs_fsync,
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
@@ -0,0 +1,798 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * SFS filesystem
+ *
+ * Delayed writes.
+ *
+ * sfs_writeblock doesn't go to the disk; it copies the block into one
+ * of a set of per-volume buffers and marks it dirty. sfs_readblock
+ * looks in the buffers first, and keeps what it reads there, so
+ * partial-block writes and metadata updates (inodes, directories,
+ * indirect blocks, the freemap) are read-modify-written in memory.
+ *
+ * Dirty buffers go to disk when:
+ *    - the volume is synced; the syncer thread, which runs once a
+ *      second, syncs it if any buffer has been dirty for
+ *      SFS_WB_MAXAGE passes or the freemap has changed;
+ *    - more than SFS_WB_HIWAT buffers are dirty, in which case the
+ *      writer flushes the oldest down to SFS_WB_LOWAT;
+ *    - a buffer is needed and there are no clean ones.
+ *
+ * If the volume has no journal, only file data is delayed. Metadata
+ * (inodes, directories, indirect blocks, the freemap, and the
+ * superblock) is written through as soon as it changes, in the same
+ * order SFS has always written it, since that order is all that
+ * keeps the volume consistent across a crash; the buffer just keeps
+ * a clean copy. Flushes then write file data in ascending order.
+ * File data in a newly allocated block that was never cleared on
+ * disk is written through too, since the inode pointing at it might
+ * otherwise be written first; see sfs_bmap.
+ *
+ * If the volume has a journal (see sfs_journal.c), blocks are never
+ * written home piecemeal like that. Every flush writes all the dirty
+ * buffers to the journal as one transaction first, and since a
+ * transaction must hold only whole operations, flushes happen only
+ * between operations: from sfs_sync, under the big lock. Instead of
+ * flushing at SFS_WB_HIWAT, the writer asks the syncer to sync soon.
+ * Each operation calls sfs_wb_opbegin before it changes anything, to
+ * claim room in the transaction for the buffers it may dirty; if
+ * there isn't enough, the pool grows, up to the size of a
+ * transaction, or failing that the volume is synced right then,
+ * before the operation starts.
+ *
+ * Whole-block file writes in sfs_blockio still go straight to the
+ * disk; they discard any buffer for the block first. That can't land
+ * on a block something on disk still points to, because freed blocks
+ * aren't reused until the sync that frees them is done; see sfs_bfree.
+ *
+ * A buffer is marked busy while it's being written; it must not be
+ * changed or discarded until the write finishes. For journaled
+ * volumes that's until the journal header has moved past it, so a
+ * direct write can't be undone by replaying a stale transaction.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <vfs.h>
+#include <sfs.h>
+#include "sfsprivate.h"
+
+#define SFS_WB_BUFS	64	/* number of buffers per volume */
+#define SFS_WB_MAXBUFS	SFS_JNL_MAXBLOCKS /* ...if journaled, up to this */
+#define SFS_WB_HIWAT	48	/* too many dirty buffers */
+#define SFS_WB_LOWAT	32	/* flush down to this many */
+#define SFS_WB_MAXAGE	2	/* syncer passes before writing */
+
+struct sfs_wbuf {
+	daddr_t wb_block;		/* disk block */
+	bool wb_valid;			/* holds a block */
+	bool wb_dirty;			/* needs writing */
+	bool wb_busy;			/* being written */
+	unsigned wb_dirtied;		/* syncer pass when it got dirty */
+	unsigned wb_lastuse;		/* for LRU replacement */
+	char *wb_data;			/* SFS_BLOCKSIZE bytes */
+};
+
+struct sfs_writeback {
+	struct lock *wb_lock;		/* protects everything here */
+	struct cv *wb_cv;		/* signaled when a write finishes */
+	bool wb_shutdown;		/* syncer should exit */
+	bool wb_wantsync;		/* syncer should sync now */
+	unsigned wb_opdepth;		/* operations in progress (nested) */
+	unsigned wb_claimed;		/* buffers claimed since last commit */
+	unsigned wb_base;		/* buffers sfs_sync itself may need */
+	unsigned wb_ndirty;		/* number of dirty buffers */
+	unsigned wb_pass;		/* syncer pass count */
+	unsigned wb_clock;		/* counter for wb_lastuse */
+	unsigned wb_nbufs;		/* number of buffers allocated */
+	struct sfs_wbuf wb_bufs[SFS_WB_MAXBUFS];
+
+	/* the transaction being committed */
+	struct sfs_wbuf *wb_txbufs[SFS_WB_MAXBUFS];
+	daddr_t wb_txblocks[SFS_WB_MAXBUFS];
+	char *wb_txdata[SFS_WB_MAXBUFS];
+};
+
+/* True if the volume is journaled */
+#define SFS_WB_JOURNALED(sfs) ((sfs)->sfs_sb.sb_journalblocks > 0)
+
+/*
+ * Find the buffer holding BLOCK.
+ */
+static
+struct sfs_wbuf *
+sfs_wb_find(struct sfs_writeback *wb, daddr_t block)
+{
+	unsigned i;
+
+	for (i=0; i<wb->wb_nbufs; i++) {
+		if (wb->wb_bufs[i].wb_valid &&
+		    wb->wb_bufs[i].wb_block == block) {
+			return &wb->wb_bufs[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Find the least recently used clean buffer, or NULL.
+ */
+static
+struct sfs_wbuf *
+sfs_wb_victim(struct sfs_writeback *wb)
+{
+	struct sfs_wbuf *b, *ret = NULL;
+	unsigned i;
+
+	for (i=0; i<wb->wb_nbufs; i++) {
+		b = &wb->wb_bufs[i];
+		if (!b->wb_valid) {
+			return b;
+		}
+		if (!b->wb_dirty && !b->wb_busy &&
+		    (ret == NULL || b->wb_lastuse < ret->wb_lastuse)) {
+			ret = b;
+		}
+	}
+	return ret;
+}
+
+/*
+ * Flush order: ordinary blocks, then the freemap, then the superblock.
+ */
+static
+unsigned
+sfs_wb_class(struct sfs_fs *sfs, daddr_t block)
+{
+	if (block == SFS_SUPER_BLOCK) {
+		return 2;
+	}
+	if (block >= SFS_FREEMAP_START &&
+	    block < SFS_FREEMAP_START + SFS_FS_FREEMAPBLOCKS(sfs)) {
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Write a dirty buffer to disk. Called with the lock held; releases
+ * it during the I/O.
+ */
+static
+int
+sfs_wb_writeout(struct sfs_fs *sfs, struct sfs_wbuf *b)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(lock_do_i_hold(wb->wb_lock));
+	KASSERT(b->wb_valid && b->wb_dirty && !b->wb_busy);
+
+	b->wb_busy = true;
+	lock_release(wb->wb_lock);
+
+	SFSUIO(&iov, &ku, b->wb_data, b->wb_block, UIO_WRITE);
+	result = sfs_devio(sfs, &ku);
+	sfs_ra_invalidate(sfs, b->wb_block);
+
+	lock_acquire(wb->wb_lock);
+	b->wb_busy = false;
+	if (result == 0) {
+		b->wb_dirty = false;
+		wb->wb_ndirty--;
+	}
+	cv_broadcast(wb->wb_cv, wb->wb_lock);
+	return result;
+}
+
+/*
+ * Find the next dirty buffer to write: the lowest in flush order,
+ * or if OLDEST is set, the one that's been dirty longest. Only
+ * buffers dirty for at least MAXAGE passes are considered.
+ */
+static
+struct sfs_wbuf *
+sfs_wb_next(struct sfs_fs *sfs, bool oldest, unsigned maxage)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	struct sfs_wbuf *b, *ret = NULL;
+	unsigned i, c, retc = 0;
+
+	for (i=0; i<wb->wb_nbufs; i++) {
+		b = &wb->wb_bufs[i];
+		if (!b->wb_valid || !b->wb_dirty || b->wb_busy ||
+		    wb->wb_pass - b->wb_dirtied < maxage) {
+			continue;
+		}
+		if (oldest) {
+			if (ret == NULL || b->wb_dirtied < ret->wb_dirtied) {
+				ret = b;
+			}
+			continue;
+		}
+		c = sfs_wb_class(sfs, b->wb_block);
+		if (ret == NULL || c < retc ||
+		    (c == retc && b->wb_block < ret->wb_block)) {
+			ret = b;
+			retc = c;
+		}
+	}
+	return ret;
+}
+
+/*
+ * Add a buffer to the pool, if it isn't already as big as it gets.
+ */
+static
+struct sfs_wbuf *
+sfs_wb_grow(struct sfs_writeback *wb)
+{
+	struct sfs_wbuf *b;
+
+	if (wb->wb_nbufs >= SFS_WB_MAXBUFS) {
+		return NULL;
+	}
+	b = &wb->wb_bufs[wb->wb_nbufs];
+	b->wb_data = kmalloc(SFS_BLOCKSIZE);
+	if (b->wb_data == NULL) {
+		return NULL;
+	}
+	b->wb_valid = false;
+	b->wb_dirty = false;
+	b->wb_busy = false;
+	wb->wb_nbufs++;
+	return b;
+}
+
+/*
+ * Journaled flush: write every dirty buffer to the journal as one
+ * transaction, then home, then checkpoint the journal. Called with
+ * the lock held; releases it during the I/O.
+ */
+static
+int
+sfs_wb_commit(struct sfs_fs *sfs)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	struct sfs_wbuf *b;
+	struct iovec iov;
+	struct uio ku;
+	unsigned i, n;
+	int result;
+
+	/* The big lock keeps commits from overlapping */
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(lock_do_i_hold(wb->wb_lock));
+
+	/* ...and from landing in the middle of an operation */
+	KASSERT(wb->wb_opdepth == 0);
+
+	/* Everything goes in one transaction; wait for stragglers */
+	for (i=0; i<wb->wb_nbufs; i++) {
+		while (wb->wb_bufs[i].wb_busy) {
+			cv_wait(wb->wb_cv, wb->wb_lock);
+		}
+	}
+
+	/* Collect the dirty buffers in flush order */
+	n = 0;
+	while ((b = sfs_wb_next(sfs, false, 0)) != NULL) {
+		b->wb_busy = true;
+		wb->wb_txbufs[n] = b;
+		wb->wb_txblocks[n] = b->wb_block;
+		wb->wb_txdata[n] = b->wb_data;
+		n++;
+	}
+	if (n == 0) {
+		wb->wb_claimed = 0;
+		return 0;
+	}
+	lock_release(wb->wb_lock);
+
+	result = sfs_jnl_commit(sfs, n, wb->wb_txblocks, wb->wb_txdata);
+	for (i=0; i<n && result == 0; i++) {
+		b = wb->wb_txbufs[i];
+		SFSUIO(&iov, &ku, b->wb_data, b->wb_block, UIO_WRITE);
+		result = sfs_devio(sfs, &ku);
+		sfs_ra_invalidate(sfs, b->wb_block);
+	}
+	if (result == 0) {
+		result = sfs_jnl_checkpoint(sfs);
+	}
+
+	lock_acquire(wb->wb_lock);
+	for (i=0; i<n; i++) {
+		b = wb->wb_txbufs[i];
+		b->wb_busy = false;
+		if (result == 0) {
+			b->wb_dirty = false;
+			wb->wb_ndirty--;
+		}
+	}
+	cv_broadcast(wb->wb_cv, wb->wb_lock);
+
+	if (result == 0) {
+		/* sfs_sync put everything in; the next one starts empty */
+		wb->wb_claimed = 0;
+	}
+	else {
+		kprintf("sfs: %s: journal transaction %u failed: %s\n",
+			sfs->sfs_sb.sb_volname, sfs->sfs_jseq,
+			strerror(result));
+	}
+	return result;
+}
+
+/*
+ * Write out all the dirty buffers, in flush order, and wait for
+ * writes already in progress. On a journaled volume, commit them.
+ */
+static
+int
+sfs_wb_flushlocked(struct sfs_fs *sfs)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	struct sfs_wbuf *b;
+	int result;
+
+	if (SFS_WB_JOURNALED(sfs)) {
+		return sfs_wb_commit(sfs);
+	}
+
+	while (1) {
+		b = sfs_wb_next(sfs, false, 0);
+		if (b == NULL) {
+			if (wb->wb_ndirty > 0) {
+				/* Someone else is writing the rest */
+				cv_wait(wb->wb_cv, wb->wb_lock);
+				continue;
+			}
+			break;
+		}
+		result = sfs_wb_writeout(sfs, b);
+		if (result) {
+			/* Stop rather than retry the same block forever */
+			kprintf("sfs: %s: block %u: delayed write failed: "
+				"%s\n", sfs->sfs_sb.sb_volname, b->wb_block,
+				strerror(result));
+			return result;
+		}
+	}
+	return 0;
+}
+
+int
+sfs_wb_flush(struct sfs_fs *sfs)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	int result;
+
+	if (wb == NULL) {
+		return 0;
+	}
+
+	lock_acquire(wb->wb_lock);
+	result = sfs_wb_flushlocked(sfs);
+	lock_release(wb->wb_lock);
+	return result;
+}
+
+/*
+ * If BLOCK is buffered, copy it into BUF and return true.
+ */
+bool
+sfs_wb_read(struct sfs_fs *sfs, daddr_t block, void *buf)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	struct sfs_wbuf *b;
+
+	if (wb == NULL) {
+		return false;
+	}
+
+	lock_acquire(wb->wb_lock);
+	b = sfs_wb_find(wb, block);
+	if (b != NULL) {
+		memcpy(buf, b->wb_data, SFS_BLOCKSIZE);
+		b->wb_lastuse = wb->wb_clock++;
+	}
+	lock_release(wb->wb_lock);
+	return b != NULL;
+}
+
+/*
+ * Remember the contents of BLOCK, just read from disk, if there's a
+ * clean buffer to put it in.
+ */
+void
+sfs_wb_insert(struct sfs_fs *sfs, daddr_t block, const void *buf)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	struct sfs_wbuf *b;
+
+	if (wb == NULL) {
+		return;
+	}
+
+	lock_acquire(wb->wb_lock);
+	if (sfs_wb_find(wb, block) == NULL) {
+		b = sfs_wb_victim(wb);
+		if (b != NULL) {
+			b->wb_block = block;
+			b->wb_valid = true;
+			b->wb_dirty = false;
+			b->wb_lastuse = wb->wb_clock++;
+			memcpy(b->wb_data, buf, SFS_BLOCKSIZE);
+		}
+	}
+	lock_release(wb->wb_lock);
+}
+
+/*
+ * Delayed write of BLOCK. META is true unless it's file data; if the
+ * volume has no journal, metadata is written through.
+ */
+int
+sfs_wb_write(struct sfs_fs *sfs, daddr_t block, const void *buf, bool meta)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	struct sfs_wbuf *b;
+	int result;
+
+	KASSERT(wb != NULL);
+
+	lock_acquire(wb->wb_lock);
+	while (1) {
+		b = sfs_wb_find(wb, block);
+		if (b != NULL) {
+			if (b->wb_busy) {
+				cv_wait(wb->wb_cv, wb->wb_lock);
+				continue;
+			}
+			break;
+		}
+		b = sfs_wb_victim(wb);
+		if (b == NULL && SFS_WB_JOURNALED(sfs)) {
+			b = sfs_wb_grow(wb);
+		}
+		if (b != NULL) {
+			b->wb_block = block;
+			b->wb_valid = true;
+			b->wb_dirty = false;
+			break;
+		}
+
+		if (SFS_WB_JOURNALED(sfs)) {
+			/* sfs_wb_opbegin should have made sure of room */
+			panic("sfs: %s: operation dirtied more blocks than it "
+			      "claimed\n", sfs->sfs_sb.sb_volname);
+		}
+
+		/* No clean buffers; write one out and try again */
+		b = sfs_wb_next(sfs, true, 0);
+		if (b == NULL) {
+			/* All being written; wait */
+			cv_wait(wb->wb_cv, wb->wb_lock);
+			continue;
+		}
+		result = sfs_wb_writeout(sfs, b);
+		if (result) {
+			lock_release(wb->wb_lock);
+			return result;
+		}
+	}
+
+	memcpy(b->wb_data, buf, SFS_BLOCKSIZE);
+	b->wb_lastuse = wb->wb_clock++;
+	if (!b->wb_dirty) {
+		b->wb_dirty = true;
+		b->wb_dirtied = wb->wb_pass;
+		wb->wb_ndirty++;
+	}
+
+	if (meta && !SFS_WB_JOURNALED(sfs)) {
+		result = sfs_wb_writeout(sfs, b);
+		lock_release(wb->wb_lock);
+		return result;
+	}
+
+	/* Too many dirty; push out the oldest, or have the syncer do it */
+	result = 0;
+	if (wb->wb_ndirty > SFS_WB_HIWAT && SFS_WB_JOURNALED(sfs)) {
+		wb->wb_wantsync = true;
+	}
+	else if (wb->wb_ndirty > SFS_WB_HIWAT) {
+		while (result == 0 && wb->wb_ndirty > SFS_WB_LOWAT &&
+		       (b = sfs_wb_next(sfs, true, 0)) != NULL) {
+			result = sfs_wb_writeout(sfs, b);
+		}
+	}
+
+	lock_release(wb->wb_lock);
+	return result;
+}
+
+/*
+ * BLOCK is about to be overwritten directly on disk. Drop our copy,
+ * after waiting for any write of it in progress so that write can't
+ * land on top of the new contents.
+ */
+void
+sfs_wb_discard(struct sfs_fs *sfs, daddr_t block)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	struct sfs_wbuf *b;
+
+	if (wb == NULL) {
+		return;
+	}
+
+	lock_acquire(wb->wb_lock);
+	while ((b = sfs_wb_find(wb, block)) != NULL && b->wb_busy) {
+		cv_wait(wb->wb_cv, wb->wb_lock);
+	}
+	if (b != NULL) {
+		if (b->wb_dirty) {
+			wb->wb_ndirty--;
+		}
+		b->wb_valid = false;
+		b->wb_dirty = false;
+	}
+	lock_release(wb->wb_lock);
+}
+
+/*
+ * Start an operation that may dirty up to NBLOCKS buffers, counting
+ * the inode blocks sfs_sync will write for the inodes it changes.
+ * Called with the big lock held, before the operation changes
+ * anything. On a journaled volume, this makes sure the current
+ * transaction has room for the operation, syncing first if it
+ * doesn't, so the operation never has to commit partway through.
+ * An operation done as part of another one (e.g. sfs_itrunc from
+ * sfs_reclaim) is covered by the outer operation's claim.
+ */
+int
+sfs_wb_opbegin(struct sfs_fs *sfs, unsigned nblocks)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (wb == NULL || !SFS_WB_JOURNALED(sfs)) {
+		return 0;
+	}
+	if (wb->wb_opdepth > 0) {
+		wb->wb_opdepth++;
+		return 0;
+	}
+	KASSERT(wb->wb_base + nblocks <= SFS_WB_MAXBUFS);
+
+	lock_acquire(wb->wb_lock);
+	while (wb->wb_base + wb->wb_claimed + nblocks > wb->wb_nbufs) {
+		if (wb->wb_base + wb->wb_claimed + nblocks <= SFS_WB_MAXBUFS &&
+		    sfs_wb_grow(wb) != NULL) {
+			continue;
+		}
+		if (wb->wb_claimed == 0) {
+			/* Nothing to commit; we're out of memory */
+			lock_release(wb->wb_lock);
+			return ENOMEM;
+		}
+
+		/* The transaction is full; we're between operations */
+		lock_release(wb->wb_lock);
+		result = FSOP_SYNC(&sfs->sfs_absfs);
+		if (result) {
+			return result;
+		}
+		lock_acquire(wb->wb_lock);
+	}
+	wb->wb_claimed += nblocks;
+	wb->wb_opdepth = 1;
+	lock_release(wb->wb_lock);
+	return 0;
+}
+
+/*
+ * Finish an operation started with sfs_wb_opbegin.
+ */
+void
+sfs_wb_opend(struct sfs_fs *sfs)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (wb == NULL || !SFS_WB_JOURNALED(sfs)) {
+		return;
+	}
+	KASSERT(wb->wb_opdepth > 0);
+	wb->wb_opdepth--;
+}
+
+/*
+ * Free everything.
+ */
+static
+void
+sfs_wb_free(struct sfs_writeback *wb)
+{
+	unsigned i;
+
+	for (i=0; i<wb->wb_nbufs; i++) {
+		kfree(wb->wb_bufs[i].wb_data);
+	}
+	if (wb->wb_cv != NULL) {
+		cv_destroy(wb->wb_cv);
+	}
+	if (wb->wb_lock != NULL) {
+		lock_destroy(wb->wb_lock);
+	}
+	kfree(wb);
+}
+
+/*
+ * The syncer thread. It syncs the volume under the big lock, so the
+ * on-disk state (and each journal transaction) reflects whole
+ * operations. It has a thread of its own rather than running as
+ * work, because a sync holds the big lock across a lot of I/O and
+ * would tie up a cpu's workers for all of it.
+ *
+ * Unmount holds the big lock while it shuts us down, so it can't
+ * wait for us to exit; instead it detaches the buffers and leaves
+ * them to us to free, and we must not touch SFS once we see
+ * wb_shutdown.
+ */
+static
+void
+sfs_wb_syncer(void *data1, unsigned long data2)
+{
+	struct sfs_fs *sfs = data1;
+	struct sfs_writeback *wb = sfs->sfs_wb;
+	bool due;
+
+	(void)data2;
+
+	while (1) {
+		clocksleep(1);
+
+		vfs_biglock_acquire();
+		lock_acquire(wb->wb_lock);
+		if (wb->wb_shutdown) {
+			break;
+		}
+		wb->wb_pass++;
+		due = wb->wb_wantsync ||
+			sfs_wb_next(sfs, true, SFS_WB_MAXAGE) != NULL;
+		wb->wb_wantsync = false;
+		lock_release(wb->wb_lock);
+
+		if (due || sfs->sfs_freemapdirty) {
+			/* Errors have already been reported */
+			FSOP_SYNC(&sfs->sfs_absfs);
+		}
+		vfs_biglock_release();
+	}
+	lock_release(wb->wb_lock);
+	vfs_biglock_release();
+
+	sfs_wb_free(wb);
+}
+
+/*
+ * Set up delayed writes for a volume and start its syncer. Called at
+ * the end of mount.
+ */
+int
+sfs_wb_create(struct sfs_fs *sfs)
+{
+	struct sfs_writeback *wb;
+	int result;
+
+	KASSERT(sfs->sfs_wb == NULL);
+
+	if (SFS_WB_JOURNALED(sfs) &&
+	    SFS_FS_FREEMAPBLOCKS(sfs) + 1 + SFS_OPBLOCKS > SFS_WB_MAXBUFS) {
+		kprintf("sfs: %s: volume too big to journal\n",
+			sfs->sfs_sb.sb_volname);
+		return EFBIG;
+	}
+
+	wb = kmalloc(sizeof(*wb));
+	if (wb == NULL) {
+		return ENOMEM;
+	}
+	wb->wb_nbufs = 0;
+	wb->wb_lock = lock_create("sfs-writeback");
+	wb->wb_cv = cv_create("sfs-writeback");
+	if (wb->wb_lock == NULL || wb->wb_cv == NULL) {
+		sfs_wb_free(wb);
+		return ENOMEM;
+	}
+	while (wb->wb_nbufs < SFS_WB_BUFS) {
+		if (sfs_wb_grow(wb) == NULL) {
+			sfs_wb_free(wb);
+			return ENOMEM;
+		}
+	}
+	wb->wb_shutdown = false;
+	wb->wb_wantsync = false;
+	wb->wb_opdepth = 0;
+	wb->wb_claimed = 0;
+	/* Every sync may write the whole freemap and the superblock */
+	wb->wb_base = SFS_FS_FREEMAPBLOCKS(sfs) + 1;
+	wb->wb_ndirty = 0;
+	wb->wb_pass = 0;
+	wb->wb_clock = 0;
+
+	sfs->sfs_wb = wb;
+	result = thread_fork("sfs-syncer", NULL, sfs_wb_syncer, sfs, 0);
+	if (result) {
+		sfs->sfs_wb = NULL;
+		sfs_wb_free(wb);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Write everything out and detach the buffers; the syncer frees them
+ * when it next wakes up. Called during unmount, with the big lock
+ * held, while the device is still attached.
+ */
+void
+sfs_wb_destroy(struct sfs_fs *sfs)
+{
+	struct sfs_writeback *wb = sfs->sfs_wb;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (wb == NULL) {
+		return;
+	}
+
+	lock_acquire(wb->wb_lock);
+	if (sfs_wb_flushlocked(sfs)) {
+		kprintf("sfs: %s: unmounting with unwritten blocks\n",
+			sfs->sfs_sb.sb_volname);
+	}
+	wb->wb_shutdown = true;
+	lock_release(wb->wb_lock);
+
+	sfs->sfs_wb = NULL;
+}
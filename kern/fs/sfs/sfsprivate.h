@@ -37,19 +37,43 @@
 extern const struct vnode_ops sfs_fileops;
 extern const struct vnode_ops sfs_dirops;
 
+/* Shortcuts for the size macros in kern/sfs.h */
+#define SFS_FS_NBLOCKS(sfs)        ((sfs)->sfs_sb.sb_nblocks)
+#define SFS_FS_FREEMAPBITS(sfs)    SFS_FREEMAPBITS(SFS_FS_NBLOCKS(sfs))
+#define SFS_FS_FREEMAPBLOCKS(sfs)  SFS_FREEMAPBLOCKS(SFS_FS_NBLOCKS(sfs))
+
 /* Macro for initializing a uio structure */
 #define SFSUIO(iov, uio, ptr, block, rw) \
     uio_kinit(iov, uio, ptr, SFS_BLOCKSIZE, ((off_t)(block))*SFS_BLOCKSIZE, rw)
 
 
+/* Number of blocks reserved at a time for a growing file */
+#define SFS_PREALLOC 8
+
+/*
+ * Most buffers one operation dirties, counting the inodes it changes,
+ * for sfs_wb_opbegin. Writes are split into operations of at most
+ * SFS_WRITECHUNK bytes, which dirty at most two partial data blocks,
+ * two indirect blocks per level, and the inode.
+ */
+#define SFS_OPBLOCKS 16
+#define SFS_WRITECHUNK (SFS_DBPERIDB * SFS_BLOCKSIZE)
+
 /* Functions in sfs_balloc.c */
-int sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock);
+int sfs_clearblock(struct sfs_fs *sfs, daddr_t block);
+int sfs_balloc(struct sfs_fs *sfs, daddr_t near, daddr_t *diskblock);
+int sfs_breserve(struct sfs_fs *sfs, daddr_t near, unsigned max,
+		daddr_t *start, unsigned *num);
+void sfs_bunreserve(struct sfs_vnode *sv);
+void sfs_bunreserveall(struct sfs_fs *sfs);
 void sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock);
+void sfs_bsynced(struct sfs_fs *sfs);
+bool sfs_bretry(struct sfs_fs *sfs, int result);
 int sfs_bused(struct sfs_fs *sfs, daddr_t diskblock);
 
 /* Functions in sfs_bmap.c */
 int sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
-		daddr_t *diskblock);
+		bool *fresh, daddr_t *diskblock);
 int sfs_itrunc(struct sfs_vnode *sv, off_t len);
 
 /* Functions in sfs_dir.c */
@@ -57,11 +81,40 @@ int sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 		uint32_t *ino, int *slot, int *emptyslot);
 int sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino,
 		int *slot);
-int sfs_dir_unlink(struct sfs_vnode *sv, int slot);
+int sfs_dir_unlink(struct sfs_vnode *sv, const char *name, int slot);
+void sfs_dir_dropindex(struct sfs_vnode *sv);
 int sfs_lookonce(struct sfs_vnode *sv, const char *name,
 		struct sfs_vnode **ret,
 		int *slot);
 
+/* Largest read-ahead window, in blocks */
+#define SFS_RA_MAXWINDOW 16
+
+/* Functions in sfs_readahead.c */
+int sfs_ra_create(struct sfs_fs *sfs);
+void sfs_ra_destroy(struct sfs_fs *sfs);
+void sfs_ra_request(struct sfs_fs *sfs, daddr_t block);
+bool sfs_ra_get(struct sfs_fs *sfs, daddr_t block, void *buf);
+void sfs_ra_invalidate(struct sfs_fs *sfs, daddr_t block);
+
+/* Functions in sfs_writeback.c */
+int sfs_wb_create(struct sfs_fs *sfs);
+void sfs_wb_destroy(struct sfs_fs *sfs);
+bool sfs_wb_read(struct sfs_fs *sfs, daddr_t block, void *buf);
+void sfs_wb_insert(struct sfs_fs *sfs, daddr_t block, const void *buf);
+int sfs_wb_write(struct sfs_fs *sfs, daddr_t block, const void *buf,
+		bool meta);
+void sfs_wb_discard(struct sfs_fs *sfs, daddr_t block);
+int sfs_wb_opbegin(struct sfs_fs *sfs, unsigned nblocks);
+void sfs_wb_opend(struct sfs_fs *sfs);
+int sfs_wb_flush(struct sfs_fs *sfs);
+
+/* Functions in sfs_journal.c */
+int sfs_jnl_replay(struct sfs_fs *sfs);
+int sfs_jnl_commit(struct sfs_fs *sfs, unsigned n,
+		const daddr_t *blocks, char *const *data);
+int sfs_jnl_checkpoint(struct sfs_fs *sfs);
+
 /* Functions in sfs_inode.c */
 int sfs_sync_inode(struct sfs_vnode *sv);
 int sfs_reclaim(struct vnode *v);
@@ -71,6 +124,7 @@ int sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret);
 struct vnode *sfs_getroot(struct fs *fs);
 
 /* Functions in sfs_io.c */
+int sfs_devio(struct sfs_fs *sfs, struct uio *uio);
 int sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
 int sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
 int sfs_io(struct sfs_vnode *sv, struct uio *uio);
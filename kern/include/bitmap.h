@@ -38,6 +38,11 @@
  *                      Returns NULL on error.
  *     bitmap_getdata - return pointer to raw bit data (for I/O).
  *     bitmap_alloc   - locate a cleared bit, set it, and return its index.
+ *                      Searches onward from the last bit allocated.
+ *     bitmap_alloc_near - like bitmap_alloc, but searches onward from
+ *                      bit HINT, so callers can keep related bits together.
+ *     bitmap_recount - recompute internal free counts; call after
+ *                      changing the raw bit data (e.g. reading it in).
  *     bitmap_mark    - set a clear bit by its index.
  *     bitmap_unmark  - clear a set bit by its index.
  *     bitmap_isset   - return whether a particular bit is set or not.
@@ -50,6 +55,9 @@ struct bitmap;  /* Opaque. */
 struct bitmap *bitmap_create(unsigned nbits);
 void          *bitmap_getdata(struct bitmap *);
 int            bitmap_alloc(struct bitmap *, unsigned *index);
+int            bitmap_alloc_near(struct bitmap *, unsigned hint,
+                                 unsigned *index);
+void           bitmap_recount(struct bitmap *);
 void           bitmap_mark(struct bitmap *, unsigned index);
 void           bitmap_unmark(struct bitmap *, unsigned index);
 int            bitmap_isset(struct bitmap *, unsigned index);
@@ -40,8 +40,10 @@
 
 
 /*
- * hardclock() is called on every CPU HZ times a second, possibly only
- * when the CPU is not idle, for scheduling.
+ * hardclock() is called on every CPU HZ times a second, for
+ * scheduling, except while the CPU is idle: then hardclock_idle()
+ * stops the clock until the CPU's next timer is due, and the ticks
+ * skipped are made up when it wakes.
  */
 
 /* hardclocks per second */
@@ -56,6 +58,7 @@
 
 void hardclock_bootstrap(void);
 void hardclock(void);
+void hardclock_idle(void);
 
 /*
  * timerclock() is called on one CPU once a second to allow simple
@@ -82,11 +85,26 @@ void timespec_sub(const struct timespec *t1,
 		  const struct timespec *t2,
 		  struct timespec *ret);
 
+/*
+ * conversion to and from hardclock ticks (1/HZ seconds)
+ *
+ * timespec_to_ticks rounds up, so a sleep of that many ticks lasts
+ * at least as long as the interval.
+ */
+unsigned timespec_to_ticks(const struct timespec *ts);
+void ticks_to_timespec(unsigned ticks, struct timespec *ret);
+
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
  */
 void clocksleep(int seconds);
 
+/*
+ * clocknanosleep() suspends execution for the interval DURATION, to
+ * the resolution of hardclock, like userlevel nanosleep(2).
+ */
+void clocknanosleep(const struct timespec *duration);
+
 
 #endif /* _CLOCK_H_ */
@@ -33,6 +33,9 @@
 
 #include <spinlock.h>
 #include <threadlist.h>
+#include <timer.h>
+#include <workqueue.h>
+#include <trace.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
@@ -59,7 +62,11 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadpool;	/* Recycled threads, with stacks */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_idleticks;		/* Ticks being skipped while idle */
+	uint32_t c_randstate[4];	/* State for random() */
+	unsigned c_randleft;		/* random() calls until reseed */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
 
 	/*
@@ -70,6 +77,19 @@ struct cpu {
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * Accessed by other cpus.
+	 * Protected by its own lock.
+	 */
+	struct timerwheel c_timers;	/* Pending timers for this cpu */
+	struct workqueue c_workq;	/* Deferred work for this cpu */
+
+	/*
+	 * Read by other cpus without locking; written only by this
+	 * cpu, with interrupts off.
+	 */
+	struct tracering c_trace;	/* Recent TRACE() records */
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -115,6 +135,13 @@ void cpu_hatch(unsigned software_number);
  */
 void cpu_identify(char *buf, size_t max);
 
+/*
+ * Read the current CPU's cycle counter. It wraps, so only the
+ * difference between two nearby readings on the same CPU means
+ * anything.
+ */
+uint32_t cpu_cycles(void);
+
 /*
  * Hardware-level interrupt on/off, for the current CPU.
  *
@@ -36,6 +36,7 @@
 
 
 struct uio;  /* in <uio.h> */
+struct pollwait;  /* in <poll.h> */
 
 /*
  * Filesystem-namespace-accessible device.
@@ -56,11 +57,13 @@ struct device {
  *      devop_eachopen - called on each open call to allow denying the open
  *      devop_io - for both reads and writes (the uio indicates the direction)
  *      devop_ioctl - miscellaneous control operations
+ *      devop_poll - check readiness for poll/select (see vop_poll)
  */
 struct device_ops {
 	int (*devop_eachopen)(struct device *, int flags_from_open);
 	int (*devop_io)(struct device *, struct uio *);
 	int (*devop_ioctl)(struct device *, int op, userptr_t data);
+	int (*devop_poll)(struct device *, struct pollwait *pw, int *revents);
 };
 
 /*
@@ -69,6 +72,7 @@ struct device_ops {
 #define DEVOP_EACHOPEN(d, f)	((d)->d_ops->devop_eachopen(d, f))
 #define DEVOP_IO(d, u)		((d)->d_ops->devop_io(d, u))
 #define DEVOP_IOCTL(d, op, p)	((d)->d_ops->devop_ioctl(d, op, p))
+#define DEVOP_POLL(d, pw, r)	((d)->d_ops->devop_poll(d, pw, r))
 
 
 /* Create vnode for a vfs-level device. */
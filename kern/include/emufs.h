@@ -37,14 +37,41 @@
 #include <fs.h>
 #include <vnode.h>
 
+/*
+ * Number of pages of file data cached per file.
+ */
+#define EMUFS_CACHEPAGES 8
+
 /*
  * Our structures
  */
 
+/*
+ * One cached page of file data. If ep_len is less than PAGE_SIZE, the
+ * page held the end of the file when it was read.
+ */
+struct emufs_page {
+	char *ep_data;			/* PAGE_SIZE bytes, or NULL if unused */
+	off_t ep_pageno;		/* which page of the file */
+	unsigned ep_len;		/* bytes of file data in the page */
+	unsigned ep_lastuse;		/* for LRU replacement; 0 if invalid */
+	bool ep_valid;			/* holds good data */
+};
+
 struct emufs_vnode {
 	struct vnode ev_v;		/* abstract vnode structure */
 	struct emu_softc *ev_emu;	/* device */
 	uint32_t ev_handle;		/* file handle */
+	bool ev_isdir;			/* is a directory */
+
+	/* File data and attribute cache (not used for directories) */
+	struct lock *ev_lock;		/* protects the following */
+	bool ev_sizevalid;		/* ev_size is known */
+	off_t ev_size;			/* file size */
+	off_t ev_nextread;		/* where a sequential read would go */
+	unsigned ev_readahead;		/* read-ahead window, in pages */
+	unsigned ev_clock;		/* counter for ep_lastuse */
+	struct emufs_page ev_pages[EMUFS_CACHEPAGES];
 };
 
 struct emufs_fs {
@@ -34,6 +34,19 @@
  * ioctl operation codes
  */
 
-/* (none yet) */
+/*
+ * Access an operation needs, or'd into its code. Like read and
+ * write, ioctl fails with EBADF unless the file handle was opened
+ * for reading (IOC_READ) or writing (IOC_WRITE) respectively.
+ */
+#define IOC_READ	0x100
+#define IOC_WRITE	0x200
+
+/*
+ * semfs semaphores: P or V by a count, without the cost of read or
+ * write. The argument points to an unsigned int holding the count.
+ */
+#define SEMIOC_P	(1 | IOC_READ)
+#define SEMIOC_V	(2 | IOC_WRITE)
 
 #endif /* _KERN_IOCTL_H_*/
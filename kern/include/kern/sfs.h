@@ -41,14 +41,15 @@
 #define SFS_VOLNAME_SIZE  32            /* max length of volume name */
 #define SFS_NDIRECT       15            /* # of direct blocks in inode */
 #define SFS_NINDIRECT     1             /* # of indirect blocks in inode */
-#define SFS_NDINDIRECT    0             /* # of 2x indirect blocks in inode */
-#define SFS_NTINDIRECT    0             /* # of 3x indirect blocks in inode */
+#define SFS_NDINDIRECT    1             /* # of 2x indirect blocks in inode */
+#define SFS_NTINDIRECT    1             /* # of 3x indirect blocks in inode */
 #define SFS_DBPERIDB      128           /* # direct blks per indirect blk */
 #define SFS_NAMELEN       60            /* max length of filename */
 #define SFS_SUPER_BLOCK   0             /* block the superblock lives in */
 #define SFS_FREEMAP_START 2             /* 1st block of the freemap */
 #define SFS_NOINO         0             /* inode # for free dir entry */
 #define SFS_ROOTDIR_INO   1             /* loc'n of the root dir inode */
+#define SFS_JOURNALSIZE   128           /* # of blocks in the journal */
 
 /* Number of bits in a block */
 #define SFS_BITSPERBLOCK (SFS_BLOCKSIZE * CHAR_BIT)
@@ -62,6 +63,24 @@
 /* Size of free block bitmap (in blocks) */
 #define SFS_FREEMAPBLOCKS(nblocks)  (SFS_FREEMAPBITS(nblocks)/SFS_BITSPERBLOCK)
 
+/*
+ * The journal, if there is one, follows the freemap. Its first block
+ * is a header naming the sequence number of the transaction that
+ * starts in the second block. A transaction is a descriptor record
+ * listing up to SFS_JNL_MAXBLOCKS home block numbers, then the new
+ * contents of those blocks in order, then a commit record with a
+ * checksum. The header is advanced once the blocks have been written
+ * home, so at most one transaction is ever live.
+ */
+#define SFS_JNL_MAGIC     0x5f5a4a4e    /* magic number for records */
+#define SFS_JNL_HEADER    1             /* journal header record */
+#define SFS_JNL_DESC      2             /* transaction descriptor */
+#define SFS_JNL_COMMIT    3             /* transaction commit */
+#define SFS_JNL_MAXBLOCKS 123           /* max # of blocks in a transaction */
+
+/* Smallest volume mksfs gives a journal */
+#define SFS_JNL_MINVOLUME (SFS_JOURNALSIZE * 8)
+
 /* File types for sfi_type */
 #define SFS_TYPE_INVAL    0       /* Should not appear on disk */
 #define SFS_TYPE_FILE     1
@@ -74,7 +93,9 @@ struct sfs_superblock {
 	uint32_t sb_magic;		/* Magic number; should be SFS_MAGIC */
 	uint32_t sb_nblocks;			/* Number of blocks in fs */
 	char sb_volname[SFS_VOLNAME_SIZE];	/* Name of this volume */
-	uint32_t reserved[118];			/* unused, set to 0 */
+	uint32_t sb_journalstart;		/* First block of journal */
+	uint32_t sb_journalblocks;		/* Journal size; 0 if none */
+	uint32_t reserved[116];			/* unused, set to 0 */
 };
 
 /*
@@ -86,7 +107,21 @@ struct sfs_dinode {
 	uint16_t sfi_linkcount;			/* # hard links to this file */
 	uint32_t sfi_direct[SFS_NDIRECT];	/* Direct blocks */
 	uint32_t sfi_indirect;			/* Indirect block */
-	uint32_t sfi_waste[128-3-SFS_NDIRECT];	/* unused space, set to 0 */
+	uint32_t sfi_dindirect;			/* Double indirect block */
+	uint32_t sfi_tindirect;			/* Triple indirect block */
+	uint32_t sfi_waste[128-5-SFS_NDIRECT];	/* unused space, set to 0 */
+};
+
+/*
+ * On-disk journal record (header, descriptor, or commit)
+ */
+struct sfs_jrecord {
+	uint32_t jr_magic;			/* SFS_JNL_MAGIC */
+	uint32_t jr_type;			/* One of SFS_JNL_* above */
+	uint32_t jr_seq;			/* Transaction sequence number */
+	uint32_t jr_nblocks;			/* # of blocks in transaction */
+	uint32_t jr_sum;			/* Checksum (commit only) */
+	uint32_t jr_blocks[SFS_JNL_MAXBLOCKS];	/* Home blocks (desc only) */
 };
 
 /*
@@ -111,7 +111,14 @@ extern uint32_t dbflags;
 #define DEBUG(d, ...) ((dbflags & (d)) ? kprintf(__VA_ARGS__) : 0)
 
 /*
- * Random number generator, using the random device.
+ * TRACE() in <trace.h> takes the same flags but records into a ring
+ * buffer instead of printing on the spot; use it in hot paths.
+ */
+
+/*
+ * Random number generator, seeded from the random device. It is
+ * fast and callable from interrupt handlers, but not suitable for
+ * anything cryptographic.
  *
  * random() returns a number between 0 and randmax() inclusive.
  */
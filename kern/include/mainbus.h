@@ -55,6 +55,21 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Tickless idle, for the current cpu, with interrupts off.
+ *
+ * mainbus_timer_skip makes the next hardclock interrupt come TICKS
+ * ticks from the last one instead of one tick, and returns the
+ * number of ticks actually set, which may be fewer, or 0 if a tick
+ * interrupt is already pending and nothing was changed.
+ *
+ * mainbus_timer_resume, called if something else ends the idle
+ * first, goes back to interrupting every tick and returns how many
+ * hardclocks were missed. TICKS is what mainbus_timer_skip returned.
+ */
+unsigned mainbus_timer_skip(unsigned ticks);
+unsigned mainbus_timer_resume(unsigned ticks);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Kernel support for poll() and select().
+ *
+ * Every object whose I/O can block (a pipe, the console, a semfs
+ * semaphore) keeps a struct pollhead listing the poll calls currently
+ * waiting on it. Its vop_poll function first calls pollhead_register
+ * to join that list and then reports the events that are ready right
+ * now; from then on, whenever the object's state changes in a way
+ * that might make an event ready, it calls pollhead_wakeup. Because
+ * registration happens before the check, a change that races with
+ * the check still wakes the poller and nothing is lost.
+ *
+ * A struct pollwait is one poll() or select() call in progress. It
+ * can be registered on many pollheads at once (one per file handle
+ * polled) and sleeps until any of them wakes it or its deadline
+ * passes. The pollwait is passed to vop_poll only on the first scan;
+ * later scans pass NULL, as the registrations are already in place.
+ */
+
+#include <kern/poll.h>
+#include <spinlock.h>
+
+struct timespec;	/* in <kern/time.h> */
+struct pollentry;	/* Opaque. */
+struct pollwait;	/* Opaque. */
+
+struct pollhead {
+	struct spinlock ph_lock;	/* protects ph_entries */
+	struct pollentry *ph_entries;	/* pollers waiting on this object */
+};
+
+/*
+ * Pollhead ops, for objects that support poll:
+ *
+ * init -     Initialize a pollhead (embedded in some other object).
+ * cleanup -  Clean it up. Nobody may be registered on it; this is
+ *            guaranteed if the object is only destroyed from
+ *            VOP_RECLAIM, since pollers hold a vnode reference.
+ * register - Add the poll call PW to the list of those waiting on PH.
+ *            Does nothing if PW is NULL.
+ * wakeup -   Wake every poll call waiting on PH. Callable with
+ *            spinlocks held and from interrupt handlers.
+ */
+void pollhead_init(struct pollhead *ph);
+void pollhead_cleanup(struct pollhead *ph);
+void pollhead_register(struct pollhead *ph, struct pollwait *pw);
+void pollhead_wakeup(struct pollhead *ph);
+
+/*
+ * Pollwait ops, for the poll and select system calls:
+ *
+ * create -  Make a pollwait that can be registered on up to
+ *           MAXENTRIES pollheads.
+ * destroy - Remove it from all the pollheads it's on, and free it.
+ * sleep -   Wait until woken by one of the pollheads, or until the
+ *           time DEADLINE, if not NULL, arrives. Returns immediately
+ *           if a wakeup has happened since the last sleep. Returns
+ *           true if the deadline passed.
+ */
+struct pollwait *pollwait_create(unsigned maxentries);
+void pollwait_destroy(struct pollwait *pw);
+bool pollwait_sleep(struct pollwait *pw, const struct timespec *deadline);
+
+
+#endif /* _POLL_H_ */
@@ -48,6 +48,10 @@
  */
 #include <kern/sfs.h>
 
+struct sfs_dirindex;	/* Opaque; in sfs_dir.c */
+struct sfs_readahead;	/* Opaque; in sfs_readahead.c */
+struct sfs_writeback;	/* Opaque; in sfs_writeback.c */
+
 /*
  * In-memory inode
  */
@@ -56,6 +60,12 @@ struct sfs_vnode {
 	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	struct sfs_dirindex *sv_dirindex; /* name index (dirs only) or NULL */
+	daddr_t sv_resstart;            /* first block reserved for growth */
+	unsigned sv_reslen;             /* number of blocks reserved */
+	off_t sv_nextread;              /* where a sequential read would be */
+	unsigned sv_rawindow;           /* blocks to read ahead */
+	uint32_t sv_ranext;             /* next file block to read ahead */
 };
 
 /*
@@ -69,6 +79,11 @@ struct sfs_fs {
 	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
+	struct bitmap *sfs_freedmap;    /* blocks freed since last sync */
+	unsigned sfs_nfreed;            /* number of blocks in freedmap */
+	struct sfs_readahead *sfs_ra;   /* read-ahead state, or NULL */
+	struct sfs_writeback *sfs_wb;   /* delayed write buffers, or NULL */
+	uint32_t sfs_jseq;              /* next journal transaction */
 };
 
 /*
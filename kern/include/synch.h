@@ -62,6 +62,13 @@ void sem_destroy(struct semaphore *);
 void P(struct semaphore *);
 void V(struct semaphore *);
 
+/*
+ * P_timed is P, but gives up after TICKS hardclocks (1/HZ seconds).
+ * Returns true, without decrementing, if it timed out. With TICKS
+ * of 0 it never blocks.
+ */
+bool P_timed(struct semaphore *, unsigned ticks);
+
 
 /*
  * Simple lock for mutual exclusion.
@@ -138,5 +145,12 @@ void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
+/*
+ * cv_timedwait is cv_wait, but wakes up by itself after TICKS
+ * hardclocks if not signalled first. Returns true if it timed out.
+ * As with cv_wait, the caller must recheck its condition either way.
+ */
+bool cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks);
+
 
 #endif /* _SYNCH_H_ */
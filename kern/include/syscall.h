@@ -51,6 +51,9 @@ void enter_forked_process(void *cur_tf, unsigned long num);
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
 
+/* Set up the futex hash table. */
+void futex_bootstrap(void);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -58,13 +61,25 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
+int sys_futex_wait(userptr_t addr, int val, const_userptr_t timeout);
+int sys_futex_wake(userptr_t addr, int count, int *retval);
 
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
 int sys_close(int fd);
+int sys_pipe(userptr_t fds);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
+int sys_ioctl(int fd, int code, userptr_t data);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
+int sys_select(int nfds, userptr_t readfds, userptr_t writefds,
+	       userptr_t exceptfds, const_userptr_t timeout, int *retval);
 
 int sys_chdir(const_userptr_t path);
 int sys___getcwd(userptr_t buf, size_t buflen, int *retval);
@@ -52,10 +52,14 @@ int threadlisttest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int threadtest4(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int timertest(int, char **);
+int workqueuetest(int, char **);
+int tracetest(int, char **);
 
 /* filesystem tests */
 int fstest(int, char **);
@@ -71,6 +75,7 @@ int malloctest(int, char **);
 int mallocstress(int, char **);
 int malloctest3(int, char **);
 int malloctest4(int, char **);
+int memtest(int, char **);
 int nettest(int, char **);
 
 /* Routine for running a user-level program. */
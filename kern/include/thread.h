@@ -57,6 +57,9 @@ struct cpu;
 /* Macro to test if two addresses are on the same kernel stack */
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
+/* Names shorter than this are kept in the thread instead of kmalloc'd */
+#define THREAD_NAMEBUF 24
+
 
 /* States a thread can be in. */
 typedef enum {
@@ -81,10 +84,13 @@ struct thread {
 	 */
 	struct thread_machdep t_machdep; /* Any machine-dependent goo */
 	struct threadlistnode t_listnode; /* Link for run/sleep/zombie lists */
+	struct wchan *t_wchan;		/* Wait channel we're queued on */
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	bool t_pinned;			/* Never migrate off t_cpu */
+	char t_namebuf[THREAD_NAMEBUF];	/* Storage for short t_names */
 
 	/*
 	 * Interrupt state fields.
@@ -146,6 +152,15 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but the new thread is a kernel thread that stays
+ * on the current cpu for good; thread_consider_migration leaves it
+ * alone. For per-cpu service threads.
+ */
+int thread_fork_pinned(const char *name,
+                       void (*func)(void *, unsigned long),
+                       void *data1, unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
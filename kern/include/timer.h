@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*
+ * Kernel timers.
+ *
+ * A struct timer calls a function from hardclock() a given number of
+ * ticks (1/HZ seconds) in the future. Timers are kept on a per-cpu
+ * hierarchical timer wheel: TIMER_LEVELS levels of TIMER_SLOTS
+ * buckets each, where a bucket on level L covers TIMER_SLOTS^L
+ * ticks. Starting and stopping a timer is O(1); as time advances,
+ * the buckets of each higher level are spread ("cascaded") into the
+ * level below, so each timer is moved at most TIMER_LEVELS-1 times.
+ *
+ * A timer lives on the wheel of the cpu that started it, and its
+ * function runs there, in interrupt context with no locks held. It
+ * may take spinlocks and wake threads, but must not sleep.
+ */
+
+#include <spinlock.h>
+
+struct cpu;	/* in <cpu.h> */
+
+#define TIMER_LEVELS	4
+#define TIMER_SLOTBITS	6
+#define TIMER_SLOTS	(1 << TIMER_SLOTBITS)
+
+struct timer {
+	struct timer *tm_next;		/* next in bucket */
+	struct timer **tm_prevp;	/* pointer that points to us */
+	struct cpu *volatile tm_cpu;	/* wheel we're on; NULL if idle */
+	unsigned tm_expire;		/* tick at which to fire */
+	void (*tm_func)(void *);	/* function to call */
+	void *tm_data;			/* its argument */
+};
+
+/*
+ * Per-cpu timer wheel (embedded in struct cpu).
+ */
+struct timerwheel {
+	struct spinlock tw_lock;	/* protects everything here */
+	unsigned tw_now;		/* next tick to process */
+	unsigned tw_count;		/* number of pending timers */
+	struct timer *tw_slots[TIMER_LEVELS][TIMER_SLOTS];
+};
+
+/*
+ * Timer ops:
+ *
+ * init -    Set up a timer (embedded in some other object) to call
+ *           FUNC(DATA) when it fires.
+ * cleanup - Clean it up. It must not be pending.
+ * start -   Arrange for the timer to fire at the TICKS-th hardclock
+ *           from now (at the next one if TICKS is 0). The timer
+ *           must not already be pending.
+ * stop -    Cancel the timer if it is pending. Returns true if it
+ *           was; false if it was never started or has already been
+ *           taken off the wheel to fire, in which case its function
+ *           may still be running on another cpu.
+ */
+void timer_init(struct timer *t, void (*func)(void *), void *data);
+void timer_cleanup(struct timer *t);
+void timer_start(struct timer *t, unsigned ticks);
+bool timer_stop(struct timer *t);
+
+/*
+ * Timer wheel ops, for the cpu and clock code:
+ *
+ * init -      Initialize a cpu's wheel.
+ * hardclock - Advance the current cpu's wheel by one tick and run
+ *             whatever timers expire. Called from hardclock().
+ * skip -      Same, for TICKS ticks that a tickless idle cpu slept
+ *             through.
+ * idleticks - Return how many hardclocks the current cpu can let go
+ *             by before its wheel needs attention: the timer at the
+ *             returned tick must be processed. Returns 0 if nothing
+ *             is pending at all.
+ */
+void timerwheel_init(struct timerwheel *tw);
+void timer_hardclock(void);
+void timer_skip(unsigned ticks);
+unsigned timer_idleticks(void);
+
+
+#endif /* _TIMER_H_ */
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Kernel event tracing.
+ *
+ * TRACE(d, fmt, ...) is a cheap alternative to DEBUG() that is meant
+ * to be left on everywhere, including interrupt handlers and code
+ * that holds spinlocks. Rather than printing, it stores a binary
+ * record (the format, up to TRACE_MAXARGS word-sized arguments, the
+ * cpu's hardclock count and cycle counter) in a per-cpu ring, which
+ * takes no locks: each ring is only written by its own cpu, with
+ * interrupts off.
+ *
+ * Records whose flags are set in dbflags are printed later, from a
+ * worker thread, with kprintf; the rest just sit in the ring until
+ * overwritten. On panic the most recent records from every cpu are
+ * printed, whatever their flags.
+ *
+ * Since the formatting happens later, the format must be a string
+ * constant and the arguments must be integers or pointers no wider
+ * than a word. %s is only safe for strings that never go away.
+ * Arguments past TRACE_MAXARGS are ignored.
+ */
+
+#include <workqueue.h>
+
+#define TRACE_RECORDS	128	/* per cpu; a power of 2 */
+#define TRACE_MAXARGS	4
+
+struct tracerec {
+	const char *tr_fmt;		/* kprintf format */
+	uint32_t tr_flags;		/* DB_* flags */
+	uint32_t tr_ticks;		/* c_hardclocks when recorded */
+	uint32_t tr_cycles;		/* cpu_cycles() when recorded */
+	uintptr_t tr_args[TRACE_MAXARGS];
+};
+
+/*
+ * Per-cpu trace ring (embedded in struct cpu). tr_head counts
+ * records ever written; the newest is tr_recs[(tr_head - 1) %
+ * TRACE_RECORDS].
+ */
+struct tracering {
+	struct tracering *tr_next;	/* list of all rings */
+	unsigned tr_cpunum;		/* owning cpu */
+	volatile unsigned tr_head;	/* written only by owning cpu */
+	unsigned tr_printed;		/* records up to here considered */
+	struct work tr_printwork;	/* prints wanted records */
+	struct tracerec tr_recs[TRACE_RECORDS];
+};
+
+/*
+ * trace_record always takes TRACE_MAXARGS words after the format;
+ * the extra zeros make sure there are that many.
+ */
+#define TRACE(d, ...) \
+	trace_record((d), __VA_ARGS__, 0, 0, 0, 0)
+
+void trace_record(uint32_t flags, const char *fmt, ...);
+
+/*
+ * tracering_init - set up a cpu's ring; called by cpu_create.
+ * trace_dump     - print the last MAXRECS records from every cpu.
+ * trace_panic    - same, for panic: no locks, no sleeping.
+ */
+void tracering_init(struct tracering *tr, unsigned cpunum);
+void trace_dump(unsigned maxrecs);
+void trace_panic(void);
+
+
+#endif /* _TRACE_H_ */
@@ -81,6 +81,25 @@ int vfs_lookup(char *path, struct vnode **result);
 int vfs_lookparent(char *path, struct vnode **result,
 		   char *buf, size_t buflen);
 
+/*
+ * Name lookup cache, used by vfs_lookup and vfs_lookparent.
+ * All of these require the VFS big lock.
+ *
+ *    vfs_dcache_get     - Look up NAME in DIR. If the answer is cached,
+ *                         return true and hand back a referenced vnode,
+ *                         or NULL if the name is known not to exist.
+ *    vfs_dcache_enter   - Remember that NAME in DIR is VN (or, if VN is
+ *                         NULL, that it doesn't exist).
+ *    vfs_dcache_purge   - Forget NAME in DIR. Must be called after any
+ *                         operation that adds or removes a name.
+ *    vfs_dcache_purgefs - Forget everything on FS, before unmounting.
+ */
+
+bool vfs_dcache_get(struct vnode *dir, const char *name, struct vnode **ret);
+void vfs_dcache_enter(struct vnode *dir, const char *name, struct vnode *vn);
+void vfs_dcache_purge(struct vnode *dir, const char *name);
+void vfs_dcache_purgefs(struct fs *fs);
+
 /*
  * VFS layer high-level operations on pathnames
  * Because lookup may destroy pathnames, these all may too.
@@ -120,6 +139,9 @@ int vfs_getcwd(struct uio *buf);
  *    vfs_bootstrap - Call during system initialization to allocate
  *                    structures.
  *
+ *    vfs_dcache_bootstrap - Initialize the name lookup cache. Called
+ *                    by vfs_bootstrap.
+ *
  *    vfs_setbootfs - Set the filesystem that paths beginning with a
  *                    slash are sent to. If not set, these paths fail
  *                    with ENOENT. The argument should be the device
@@ -160,6 +182,7 @@ int vfs_getcwd(struct uio *buf);
  */
 
 void vfs_bootstrap(void);
+void vfs_dcache_bootstrap(void);
 
 int vfs_setbootfs(const char *fsname);
 void vfs_clearbootfs(void);
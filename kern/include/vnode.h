@@ -33,6 +33,7 @@
 #include <spinlock.h>
 struct uio;
 struct stat;
+struct pollwait;
 
 
 /*
@@ -117,6 +118,13 @@ struct vnode {
  *                      and directories are seekable, but some devices are
  *                      not.
  *
+ *    vop_poll        - Report in REVENTS which of the POLL* conditions
+ *                      from kern/poll.h hold right now. If PW is not
+ *                      NULL, first register it (once) on the object's
+ *                      pollhead, so it will be woken when any of them
+ *                      may have changed; see poll.h. Objects whose
+ *                      I/O never blocks can use vopnoblock_poll.
+ *
  *    vop_fsync       - Force any dirty buffers associated with this file
  *                      to stable storage.
  *
@@ -192,6 +200,8 @@ struct vnode_ops {
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	bool (*vop_isseekable)(struct vnode *object);
+	int (*vop_poll)(struct vnode *object, struct pollwait *pw,
+			int *revents);
 	int (*vop_fsync)(struct vnode *object);
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
@@ -236,6 +246,7 @@ struct vnode_ops {
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
+#define VOP_POLL(vn, pw, result)        (__VOP(vn, poll)(vn, pw, result))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
@@ -312,5 +323,11 @@ int vopfail_lookup_notdir(struct vnode *vn, char *path, struct vnode **result);
 int vopfail_lookparent_notdir(struct vnode *vn, char *path,
 			      struct vnode **result, char *buf, size_t len);
 
+/*
+ * Common stub for vop_poll on objects whose I/O never waits: always
+ * readable and writable.
+ */
+int vopnoblock_poll(struct vnode *vn, struct pollwait *pw, int *revents);
+
 
 #endif /* _VNODE_H_ */
@@ -66,6 +66,13 @@ bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
  */
 void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Same as wchan_sleep, but wake up by ourselves after TICKS calls to
+ * hardclock() (1/HZ seconds each) if nobody else does first. Returns
+ * true if it was the timeout that woke us.
+ */
+bool wchan_timedsleep(struct wchan *wc, struct spinlock *lk, unsigned ticks);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Deferred work.
+ *
+ * A struct work is a function call to be made later, in thread
+ * context, by a kernel worker thread. Each cpu has a work queue
+ * served by WORKQUEUE_WORKERS workers; work goes on the queue of the
+ * cpu that submits it. Submitting is O(1), takes only a spinlock, and
+ * may be done from interrupt handlers, so this is the way to get work
+ * that might sleep out of an interrupt handler, or to get something
+ * done in the background without a thread of one's own.
+ *
+ * Work functions may sleep, but anything queued behind them on the
+ * same cpu waits until a worker is free, so long sleeps are rude;
+ * something that blocks for a long time, or takes a big lock, should
+ * have a thread of its own. Workers never migrate, so work runs on
+ * the cpu it was submitted on.
+ *
+ * A work item is either idle, pending (submitted, maybe with a delay,
+ * and not yet started), or running; it can be pending and running at
+ * once if it is resubmitted while it runs, but the workers of one
+ * queue never run the same item at the same time. Submitting work
+ * that is already pending does nothing.
+ */
+
+#include <spinlock.h>
+#include <timer.h>
+
+#define WORKQUEUE_WORKERS 2
+
+struct workqueue;
+
+struct work {
+	struct work *wk_next;		/* next on queue */
+	struct work **wk_prevp;		/* pointer to us; NULL if not queued */
+	struct workqueue *wk_queue;	/* queue we were last put on */
+	volatile spinlock_data_t wk_pending; /* submitted, not started */
+	struct timer wk_timer;		/* for delayed submission */
+	void (*wk_func)(void *);	/* function to call */
+	void *wk_data;			/* its argument */
+};
+
+/*
+ * Per-cpu work queue (embedded in struct cpu).
+ */
+struct workqueue {
+	struct spinlock wq_lock;	/* protects everything here */
+	struct work *wq_head;		/* pending work, oldest first */
+	struct work **wq_tailp;		/* end of that list */
+	struct work *wq_running[WORKQUEUE_WORKERS]; /* per worker */
+	struct wchan *wq_wchan;		/* idle workers sleep here */
+	struct wchan *wq_donewchan;	/* work_wait sleeps here */
+};
+
+/*
+ * Work ops:
+ *
+ * init -           Set up a work item (embedded in some other object)
+ *                  to call FUNC(DATA).
+ * cleanup -        Clean it up. It must be idle.
+ * submit -         Queue it on the current cpu. Returns false, doing
+ *                  nothing, if it was already pending.
+ * submit_delayed - Same, but only after TICKS hardclocks (1/HZ s).
+ * cancel -         If it's pending, unqueue it and return true.
+ *                  Otherwise return false; it may be running, or
+ *                  (if its delay has just run out) about to run.
+ * wait -           Wait until it's neither pending nor running. This
+ *                  waits out any delay, so cancel first if that's not
+ *                  wanted. Must not be called from the work itself.
+ *
+ * All but wait may be called from interrupt handlers.
+ */
+void work_init(struct work *w, void (*func)(void *), void *data);
+void work_cleanup(struct work *w);
+bool work_submit(struct work *w);
+bool work_submit_delayed(struct work *w, unsigned ticks);
+bool work_cancel(struct work *w);
+void work_wait(struct work *w);
+
+/*
+ * Work queue setup: init is called by cpu_create, and start, which
+ * forks the workers, by each cpu as it comes up. Work submitted
+ * before then waits for them.
+ */
+void workqueue_init(struct workqueue *wq);
+void workqueue_start(struct workqueue *wq);
+
+
+#endif /* _WORKQUEUE_H_ */
@@ -47,9 +47,24 @@
 #define WORD_TYPE       unsigned char
 #define WORD_ALLBITS    (0xff)
 
+/*
+ * To avoid rescanning long full stretches, the bits are divided into
+ * groups and we keep a count of the clear bits in each group; the
+ * search skips groups with no free bits. Within a group we check four
+ * words at a time, which is safe regardless of byte order because
+ * we only compare against all-ones.
+ *
+ * Allocation is next-fit: it picks up where the last one left off.
+ */
+#define GROUP_BITS      512
+#define GROUP_WORDS     (GROUP_BITS / BITS_PER_WORD)
+
 struct bitmap {
         unsigned nbits;
         WORD_TYPE *v;
+        unsigned ngroups;
+        unsigned *groupfree;    /* clear bits in each group */
+        unsigned rotor;         /* where bitmap_alloc next searches */
 };
 
 
@@ -69,9 +84,17 @@ bitmap_create(unsigned nbits)
                 kfree(b);
                 return NULL;
         }
+        b->ngroups = DIVROUNDUP(words, GROUP_WORDS);
+        b->groupfree = kmalloc(b->ngroups*sizeof(unsigned));
+        if (b->groupfree == NULL) {
+                kfree(b->v);
+                kfree(b);
+                return NULL;
+        }
 
         bzero(b->v, words*sizeof(WORD_TYPE));
         b->nbits = nbits;
+        b->rotor = 0;
 
         /* Mark any leftover bits at the end in use */
         if (words > nbits / BITS_PER_WORD) {
@@ -86,6 +109,8 @@ bitmap_create(unsigned nbits)
                 }
         }
 
+        bitmap_recount(b);
+
         return b;
 }
 
@@ -95,31 +120,178 @@ bitmap_getdata(struct bitmap *b)
         return b->v;
 }
 
-int
-bitmap_alloc(struct bitmap *b, unsigned *index)
+/*
+ * Number of words in the bitmap, and the word range of group G.
+ */
+static
+inline
+unsigned
+bitmap_words(struct bitmap *b)
 {
-        unsigned ix;
-        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
-        unsigned offset;
+        return DIVROUNDUP(b->nbits, BITS_PER_WORD);
+}
+
+static
+inline
+unsigned
+bitmap_groupend(struct bitmap *b, unsigned g)
+{
+        unsigned end = (g+1) * GROUP_WORDS;
 
-        for (ix=0; ix<maxix; ix++) {
-                if (b->v[ix]!=WORD_ALLBITS) {
-                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
-                                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
+        return end < bitmap_words(b) ? end : bitmap_words(b);
+}
+
+void
+bitmap_recount(struct bitmap *b)
+{
+        unsigned g, ix, j, count;
 
-                                if ((b->v[ix] & mask)==0) {
-                                        b->v[ix] |= mask;
-                                        *index = (ix*BITS_PER_WORD)+offset;
-                                        KASSERT(*index < b->nbits);
-                                        return 0;
+        for (g=0; g<b->ngroups; g++) {
+                count = 0;
+                for (ix=g*GROUP_WORDS; ix<bitmap_groupend(b, g); ix++) {
+                        for (j=0; j<BITS_PER_WORD; j++) {
+                                if ((b->v[ix] & ((WORD_TYPE)1 << j))==0) {
+                                        count++;
                                 }
                         }
-                        KASSERT(0);
                 }
+                b->groupfree[g] = count;
+        }
+}
+
+/*
+ * Find first zero: the index of the lowest clear bit in a word that
+ * is not all ones.
+ */
+static
+inline
+unsigned
+bitmap_ffz(WORD_TYPE w)
+{
+        unsigned x = (WORD_TYPE)~w;
+        unsigned bit = 0;
+
+        KASSERT(x != 0);
+        if ((x & 0x0f) == 0) {
+                x >>= 4;
+                bit += 4;
+        }
+        if ((x & 0x03) == 0) {
+                x >>= 2;
+                bit += 2;
+        }
+        if ((x & 0x01) == 0) {
+                bit += 1;
+        }
+        return bit;
+}
+
+/*
+ * Find a clear bit with index in [START, END), both of which must lie
+ * within the same group.
+ */
+static
+int
+bitmap_findzero(struct bitmap *b, unsigned start, unsigned end,
+                unsigned *index)
+{
+        unsigned ix, endix, bit;
+        WORD_TYPE w;
+
+        ix = start / BITS_PER_WORD;
+        endix = DIVROUNDUP(end, BITS_PER_WORD);
+
+        /* Partial first word: pretend the bits before START are set */
+        if (start % BITS_PER_WORD != 0) {
+                w = b->v[ix] | (((WORD_TYPE)1 << (start % BITS_PER_WORD))-1);
+                if (w != WORD_ALLBITS) {
+                        bit = ix*BITS_PER_WORD + bitmap_ffz(w);
+                        if (bit >= end) {
+                                return ENOSPC;
+                        }
+                        *index = bit;
+                        return 0;
+                }
+                ix++;
+        }
+
+        while (ix < endix) {
+                if (ix % sizeof(uint32_t) == 0 &&
+                    ix + sizeof(uint32_t) <= endix &&
+                    *(uint32_t *)&b->v[ix] == 0xffffffff) {
+                        ix += sizeof(uint32_t);
+                        continue;
+                }
+                if (b->v[ix] != WORD_ALLBITS) {
+                        bit = ix*BITS_PER_WORD + bitmap_ffz(b->v[ix]);
+                        if (bit >= end) {
+                                return ENOSPC;
+                        }
+                        *index = bit;
+                        return 0;
+                }
+                ix++;
         }
         return ENOSPC;
 }
 
+int
+bitmap_alloc_near(struct bitmap *b, unsigned hint, unsigned *index)
+{
+        unsigned g0, g, i, groupstart, groupend;
+        int result;
+
+        if (hint >= b->nbits) {
+                hint = 0;
+        }
+        g0 = hint / GROUP_BITS;
+        groupstart = g0 * GROUP_BITS;
+        groupend = bitmap_groupend(b, g0) * BITS_PER_WORD;
+
+        /* The rest of the hint's group */
+        result = ENOSPC;
+        if (b->groupfree[g0] > 0) {
+                result = bitmap_findzero(b, hint, groupend, index);
+        }
+
+        /* Then the following groups, wrapping around */
+        for (i=1; result && i<b->ngroups; i++) {
+                g = (g0 + i) % b->ngroups;
+                if (b->groupfree[g] > 0) {
+                        result = bitmap_findzero(b, g * GROUP_BITS,
+                                bitmap_groupend(b, g) * BITS_PER_WORD,
+                                index);
+                        KASSERT(result == 0);
+                }
+        }
+
+        /* Finally the start of the hint's group */
+        if (result && b->groupfree[g0] > 0) {
+                result = bitmap_findzero(b, groupstart, hint, index);
+        }
+
+        if (result) {
+                return result;
+        }
+
+        KASSERT(*index < b->nbits);
+        bitmap_mark(b, *index);
+        return 0;
+}
+
+int
+bitmap_alloc(struct bitmap *b, unsigned *index)
+{
+        int result;
+
+        result = bitmap_alloc_near(b, b->rotor, index);
+        if (result) {
+                return result;
+        }
+        b->rotor = *index + 1;
+        return 0;
+}
+
 static
 inline
 void
@@ -142,6 +314,7 @@ bitmap_mark(struct bitmap *b, unsigned index)
 
         KASSERT((b->v[ix] & mask)==0);
         b->v[ix] |= mask;
+        b->groupfree[ix / GROUP_WORDS]--;
 }
 
 void
@@ -155,6 +328,7 @@ bitmap_unmark(struct bitmap *b, unsigned index)
 
         KASSERT((b->v[ix] & mask)!=0);
         b->v[ix] &= ~mask;
+        b->groupfree[ix / GROUP_WORDS]++;
 }
 
 
@@ -171,6 +345,7 @@ bitmap_isset(struct bitmap *b, unsigned index)
 void
 bitmap_destroy(struct bitmap *b)
 {
+        kfree(b->groupfree);
         kfree(b->v);
         kfree(b);
 }
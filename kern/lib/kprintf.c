@@ -38,6 +38,7 @@
 #include <synch.h>
 #include <mainbus.h>
 #include <vfs.h>          // for vfs_sync()
+#include <trace.h>
 
 
 /* Flags word for DEBUG() macro. */
@@ -179,13 +180,20 @@ panic(const char *fmt, ...)
 	if (evil == 3) {
 		evil = 4;
 
-		/* Try to sync the disks. */
-		vfs_sync();
+		/* Show what led up to it. */
+		trace_panic();
 	}
 
 	if (evil == 4) {
 		evil = 5;
 
+		/* Try to sync the disks. */
+		vfs_sync();
+	}
+
+	if (evil == 5) {
+		evil = 6;
+
 		/* Shut down or reboot the system. */
 		mainbus_panic();
 	}
@@ -67,3 +67,32 @@ timespec_sub(const struct timespec *ts1,
 	r.tv_sec -= ts2->tv_sec;
 	*ret = r;
 }
+
+/*
+ * Convert a time interval to hardclock ticks, rounding up. Negative
+ * intervals give 0; absurdly long ones saturate.
+ */
+unsigned
+timespec_to_ticks(const struct timespec *ts)
+{
+	const unsigned nsecpertick = 1000000000 / HZ;
+
+	if (ts->tv_sec < 0) {
+		return 0;
+	}
+	if (ts->tv_sec >= (unsigned)-1 / HZ) {
+		return (unsigned)-1;
+	}
+	return (unsigned)ts->tv_sec * HZ +
+		((unsigned)ts->tv_nsec + nsecpertick - 1) / nsecpertick;
+}
+
+/*
+ * Convert a number of hardclock ticks to a time interval.
+ */
+void
+ticks_to_timespec(unsigned ticks, struct timespec *ret)
+{
+	ret->tv_sec = ticks / HZ;
+	ret->tv_nsec = (ticks % HZ) * (1000000000 / HZ);
+}
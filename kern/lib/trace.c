@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Per-cpu trace rings. See trace.h.
+ */
+
+#include <types.h>
+#include <stdarg.h>
+#include <lib.h>
+#include <spl.h>
+#include <membar.h>
+#include <cpu.h>
+#include <current.h>
+#include <trace.h>
+
+#define TRACE_MASK	(TRACE_RECORDS - 1)
+
+/* How many records per cpu panic prints. */
+#define TRACE_PANICRECS	32
+
+/* Every cpu's ring, and a lock for the list and all tr_printed. */
+static struct tracering *trace_rings;
+static struct spinlock trace_lock = SPINLOCK_INITIALIZER;
+
+static void trace_print(void *data);
+
+void
+tracering_init(struct tracering *tr, unsigned cpunum)
+{
+	tr->tr_cpunum = cpunum;
+	tr->tr_head = 0;
+	tr->tr_printed = 0;
+	work_init(&tr->tr_printwork, trace_print, tr);
+	bzero(tr->tr_recs, sizeof(tr->tr_recs));
+
+	spinlock_acquire(&trace_lock);
+	tr->tr_next = trace_rings;
+	trace_rings = tr;
+	spinlock_release(&trace_lock);
+}
+
+/*
+ * Add a record to the current cpu's ring. Not usable before
+ * thread_bootstrap has set up curcpu.
+ */
+void
+trace_record(uint32_t flags, const char *fmt, ...)
+{
+	struct tracering *tr;
+	struct tracerec *rec;
+	unsigned head, i;
+	va_list ap;
+	int spl;
+
+	spl = splhigh();
+	tr = &curcpu->c_trace;
+	head = tr->tr_head;
+	rec = &tr->tr_recs[head & TRACE_MASK];
+	rec->tr_fmt = fmt;
+	rec->tr_flags = flags;
+	rec->tr_ticks = curcpu->c_hardclocks;
+	rec->tr_cycles = cpu_cycles();
+	va_start(ap, fmt);
+	for (i=0; i<TRACE_MAXARGS; i++) {
+		rec->tr_args[i] = va_arg(ap, uintptr_t);
+	}
+	va_end(ap);
+	/* Readers must not see the new head before the record. */
+	membar_store_store();
+	tr->tr_head = head + 1;
+
+	/*
+	 * If it should be printed, get that done soon. Submitting
+	 * immediate work could mean waking a worker, which needs run
+	 * queue locks our caller might hold; delayed work only needs
+	 * the timer lock.
+	 */
+	if (dbflags & flags) {
+		work_submit_delayed(&tr->tr_printwork, 1);
+	}
+	splx(spl);
+}
+
+/*
+ * Copy record IDX (which must be below tr_head as last read) out of
+ * a ring. Returns false if it's been overwritten since, in which
+ * case the copy may be garbage.
+ */
+static
+bool
+trace_get(struct tracering *tr, unsigned idx, struct tracerec *rec)
+{
+	membar_load_load();
+	*rec = tr->tr_recs[idx & TRACE_MASK];
+	membar_load_load();
+	return tr->tr_head - idx <= TRACE_MASK;
+}
+
+/*
+ * Print one record.
+ */
+static
+void
+trace_show(unsigned cpunum, const struct tracerec *rec)
+{
+	char buf[128];
+
+	snprintf(buf, sizeof(buf), rec->tr_fmt, rec->tr_args[0],
+		 rec->tr_args[1], rec->tr_args[2], rec->tr_args[3]);
+	kprintf("[cpu%u %u.%08x] %s", cpunum, rec->tr_ticks,
+		rec->tr_cycles, buf);
+}
+
+/*
+ * Print the last MAXRECS records from a ring, skipping any that get
+ * overwritten while we're at it.
+ */
+static
+void
+trace_showlast(struct tracering *tr, unsigned maxrecs)
+{
+	struct tracerec rec;
+	unsigned head, idx;
+
+	head = tr->tr_head;
+	if (maxrecs > TRACE_RECORDS) {
+		maxrecs = TRACE_RECORDS;
+	}
+	idx = head > maxrecs ? head - maxrecs : 0;
+	for (; idx != head; idx++) {
+		if (trace_get(tr, idx, &rec)) {
+			trace_show(tr->tr_cpunum, &rec);
+		}
+	}
+}
+
+/*
+ * Work function: print the records added to a ring since last time
+ * whose flags are set in dbflags.
+ */
+static
+void
+trace_print(void *data)
+{
+	struct tracering *tr = data;
+	struct tracerec rec;
+	unsigned start, head, idx, lost;
+
+	/* Claim the new records, so nobody else prints them too. */
+	spinlock_acquire(&trace_lock);
+	head = tr->tr_head;
+	start = tr->tr_printed;
+	tr->tr_printed = head;
+	spinlock_release(&trace_lock);
+
+	lost = 0;
+	if (head - start > TRACE_RECORDS) {
+		lost = head - start - TRACE_RECORDS;
+		start = head - TRACE_RECORDS;
+	}
+	for (idx = start; idx != head; idx++) {
+		if (!trace_get(tr, idx, &rec)) {
+			lost++;
+			continue;
+		}
+		if (dbflags & rec.tr_flags) {
+			trace_show(tr->tr_cpunum, &rec);
+		}
+	}
+	if (lost > 0) {
+		kprintf("[cpu%u] trace: %u records lost\n",
+			tr->tr_cpunum, lost);
+	}
+}
+
+void
+trace_dump(unsigned maxrecs)
+{
+	struct tracering *tr;
+
+	/* Rings are never removed, so we needn't hold the lock. */
+	for (tr = trace_rings; tr != NULL; tr = tr->tr_next) {
+		trace_showlast(tr, maxrecs);
+	}
+}
+
+/*
+ * On panic, show what every cpu was doing last. Other cpus have
+ * been told to stop but may not have yet, so this is best effort.
+ */
+void
+trace_panic(void)
+{
+	kprintf("Last trace records:\n");
+	trace_dump(TRACE_PANICRECS);
+}
@@ -119,6 +119,7 @@ boot(void)
 	thread_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
+	futex_bootstrap();
 	
 	kheap_nextgeneration();
 
@@ -41,6 +41,7 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <trace.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -393,6 +394,23 @@ cmd_kheapgeneration(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_trace(int nargs, char **args)
+{
+	if (nargs == 1) {
+		trace_dump(TRACE_RECORDS);
+	}
+	else if (nargs == 2) {
+		trace_dump(atoi(args[1]));
+	}
+	else {
+		kprintf("Usage: tr [records]\n");
+	}
+
+	return 0;
+}
+
 static
 int
 cmd_kheapdump(int nargs, char **args)
@@ -473,12 +491,17 @@ static const char *testmenu[] = {
 	"[km2] kmalloc stress test           ",
 	"[km3] Large kmalloc test            ",
 	"[km4] Multipage kmalloc test        ",
+	"[mem1] memcpy/memset benchmark      ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread fork benchmark         ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
+	"[tm1] Timer test                    ",
+	"[wq1] Work queue test               ",
+	"[tr1] Trace ring test               ",
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
@@ -516,6 +539,7 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[tr] Dump kernel trace rings        ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -570,6 +594,7 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "tr",         cmd_trace },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -579,12 +604,17 @@ static struct {
 	{ "km2",	mallocstress },
 	{ "km3",	malloctest3 },
 	{ "km4",	malloctest4 },
+	{ "mem1",	memtest },
 #if OPT_NET
 	{ "net",	nettest },
 #endif
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadtest4 },
+	{ "tm1",	timertest },
+	{ "wq1",	workqueuetest },
+	{ "tr1",	tracetest },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
@@ -34,6 +34,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/ioctl.h>
 #include <kern/limits.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
@@ -47,6 +48,7 @@
 #include <vnode.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pipe.h>
 #include <syscall.h>
 
 /*
@@ -105,20 +107,22 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Common logic for all the read and write calls.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on the uio, which
+ * the caller has set up except for the offset. If POSITIONAL is
+ * true, do the I/O at POS and leave the seek position alone, which
+ * means we don't need to take the offset lock at all. Otherwise use
+ * (and update) the seek position.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_readwrite_uio(int fd, struct uio *useruio, bool positional, off_t pos,
+		  int badaccmode, ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
-	off_t pos;
-	struct iovec iov;
-	struct uio useruio;
+	size_t size;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -128,8 +132,19 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	}
 
 	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
+	locked = false;
+	if (positional) {
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			result = ESPIPE;
+			goto fail;
+		}
+		if (pos < 0) {
+			result = EINVAL;
+			goto fail;
+		}
+	}
+	else if (VOP_ISSEEKABLE(file->of_vnode)) {
+		locked = true;
 		lock_acquire(file->of_offsetlock);
 		pos = file->of_offset;
 	}
@@ -142,20 +157,21 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	/* set the offset in the uio */
+	useruio->uio_offset = pos;
+	size = useruio->uio_resid;
 
 	/* do the read or write */
-	result = (rw == UIO_READ) ?
-		VOP_READ(file->of_vnode, &useruio) :
-		VOP_WRITE(file->of_vnode, &useruio);
+	result = (useruio->uio_rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, useruio) :
+		VOP_WRITE(file->of_vnode, useruio);
 	if (result) {
 		goto fail;
 	}
 
 	if (locked) {
 		/* set the offset to the updated offset in the uio */
-		file->of_offset = useruio.uio_offset;
+		file->of_offset = useruio->uio_offset;
 		lock_release(file->of_offsetlock);
 	}
 
@@ -165,7 +181,7 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	 * The amount read (or written) is the original buffer size,
 	 * minus how much is left in it.
 	 */
-	*retval = size - useruio.uio_resid;
+	*retval = size - useruio->uio_resid;
 
 	return 0;
 
@@ -177,13 +193,86 @@ fail:
 	return result;
 }
 
+/*
+ * Common logic for read, write, pread, and pwrite: set up a uio with
+ * the buffer and its size, then use sys_readwrite_uio.
+ */
+static
+int
+sys_readwrite(int fd, userptr_t buf, size_t size, bool positional, off_t pos,
+	      enum uio_rw rw, int badaccmode, ssize_t *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, 0, rw);
+	return sys_readwrite_uio(fd, &useruio, positional, pos,
+				 badaccmode, retval);
+}
+
+/*
+ * Common logic for readv and writev: copy in the iovecs, check them,
+ * and set up a uio that points to all of them.
+ */
+static
+int
+sys_readwritev(int fd, const_userptr_t iovptr, int iovcnt, enum uio_rw rw,
+	       int badaccmode, ssize_t *retval)
+{
+	/* We should just use SSIZE_MAX but we don't have it in the kernel */
+	const size_t max = ((size_t)-1) >> 1;
+
+	struct iovec *iovs;
+	struct uio useruio;
+	size_t total;
+	int i, result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	iovs = kmalloc(iovcnt * sizeof(struct iovec));
+	if (iovs == NULL) {
+		return ENOMEM;
+	}
+
+	result = copyin(iovptr, iovs, iovcnt * sizeof(struct iovec));
+	if (result) {
+		kfree(iovs);
+		return result;
+	}
+
+	/* the total length has to fit in the return value */
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iovs[i].iov_len > max - total) {
+			kfree(iovs);
+			return EINVAL;
+		}
+		total += iovs[i].iov_len;
+	}
+
+	useruio.uio_iov = iovs;
+	useruio.uio_iovcnt = iovcnt;
+	useruio.uio_offset = 0;
+	useruio.uio_resid = total;
+	useruio.uio_segflg = UIO_USERSPACE;
+	useruio.uio_rw = rw;
+	useruio.uio_space = curproc->p_addrspace;
+
+	result = sys_readwrite_uio(fd, &useruio, false, 0, badaccmode, retval);
+	kfree(iovs);
+	return result;
+}
+
 /*
  * read() - use sys_readwrite
  */
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	return sys_readwrite(fd, buf, size, false, 0,
+			     UIO_READ, O_WRONLY, retval);
 }
 
 /*
@@ -192,7 +281,108 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	return sys_readwrite(fd, buf, size, false, 0,
+			     UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * pread() - use sys_readwrite
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_readwrite(fd, buf, size, true, pos,
+			     UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - use sys_readwrite
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	return sys_readwrite(fd, buf, size, true, pos,
+			     UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * pipe() - make a pipe, wrap both ends in openfiles, and put them in
+ * the file table. The read end goes in fds[0] and the write end in
+ * fds[1].
+ */
+int
+sys_pipe(userptr_t fdsptr)
+{
+	struct filetable *ft;
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile;
+	struct openfile *junk;
+	int fds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_fromvnode(readvn, O_RDONLY, &readfile);
+	if (result) {
+		vfs_close(readvn);
+		vfs_close(writevn);
+		return result;
+	}
+
+	result = openfile_fromvnode(writevn, O_WRONLY, &writefile);
+	if (result) {
+		openfile_decref(readfile);
+		vfs_close(writevn);
+		return result;
+	}
+
+	result = filetable_place(ft, readfile, &fds[0]);
+	if (result) {
+		goto fail;
+	}
+
+	result = filetable_place(ft, writefile, &fds[1]);
+	if (result) {
+		filetable_placeat(ft, NULL, fds[0], &junk);
+		goto fail;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		filetable_placeat(ft, NULL, fds[1], &junk);
+		filetable_placeat(ft, NULL, fds[0], &junk);
+		goto fail;
+	}
+
+	return 0;
+
+ fail:
+	openfile_decref(writefile);
+	openfile_decref(readfile);
+	return result;
 }
 
 /*
@@ -288,6 +478,33 @@ sys_lseek(int fd, off_t offset, int whence, off_t *retval)
 	return 0;
 }
 
+/*
+ * ioctl() - object-specific operations; pass them to the vnode.
+ */
+int
+sys_ioctl(int fd, int code, userptr_t data)
+{
+	struct openfile *file;
+	int result;
+
+	result = filetable_get(curproc->p_filetable, fd, &file);
+	if (result) {
+		return result;
+	}
+
+	/* Check the access mode the same way read and write do. */
+	if (((code & IOC_READ) && file->of_accmode == O_WRONLY) ||
+	    ((code & IOC_WRITE) && file->of_accmode == O_RDONLY)) {
+		filetable_put(curproc->p_filetable, fd, file);
+		return EBADF;
+	}
+
+	result = VOP_IOCTL(file->of_vnode, code, data);
+
+	filetable_put(curproc->p_filetable, fd, file);
+	return result;
+}
+
 /*
  * dup2() - clone a file descriptor.
  */
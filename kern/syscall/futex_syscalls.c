@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futex_wait() and futex_wake().
+ *
+ * A futex is just a word of user memory. Userlevel code does the
+ * fast path itself with atomic operations and only calls in here to
+ * sleep when it finds the word in the "contended" state, or to wake
+ * sleepers after changing it.
+ *
+ * Sleepers are identified by (address space, virtual address) and
+ * hashed into a fixed set of buckets. Each bucket has a sleep lock,
+ * not a spinlock, because futex_wait has to read the user word with
+ * the bucket locked (so a wake can't slip in between the check and
+ * the sleep) and copyin can fault.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <clock.h>
+#include <copyinout.h>
+#include <synch.h>
+#include <current.h>
+#include <proc.h>
+#include <syscall.h>
+
+/* Number of hash buckets; a power of 2 */
+#define FUTEX_BUCKETS 64
+
+struct futex_waiter {
+	struct addrspace *fw_as;	/* key: address space */
+	vaddr_t fw_addr;		/* key: user address */
+	bool fw_woken;			/* set by futex_wake */
+	struct futex_waiter *fw_next;	/* next in bucket */
+	struct futex_waiter **fw_prevp;	/* pointer to us */
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;		/* protects the list */
+	struct cv *fb_cv;		/* all sleepers in the bucket */
+	struct futex_waiter *fb_head;	/* sleepers, oldest first */
+	struct futex_waiter **fb_tailp;	/* end of that list */
+};
+
+static struct futex_bucket futex_buckets[FUTEX_BUCKETS];
+
+/*
+ * Setup.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_BUCKETS; i++) {
+		futex_buckets[i].fb_lock = lock_create("futex");
+		futex_buckets[i].fb_cv = cv_create("futex");
+		if (futex_buckets[i].fb_lock == NULL ||
+		    futex_buckets[i].fb_cv == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_buckets[i].fb_head = NULL;
+		futex_buckets[i].fb_tailp = &futex_buckets[i].fb_head;
+	}
+}
+
+static
+struct futex_bucket *
+futex_hash(struct addrspace *as, vaddr_t addr)
+{
+	uint32_t h;
+
+	h = (uint32_t)(uintptr_t)as ^ (uint32_t)addr;
+	h ^= h >> 16;
+	h *= 0x45d9f3b;
+	h ^= h >> 16;
+	return &futex_buckets[h & (FUTEX_BUCKETS - 1)];
+}
+
+/*
+ * Take a waiter off its bucket. The bucket must be locked.
+ */
+static
+void
+futex_unlink(struct futex_bucket *fb, struct futex_waiter *fw)
+{
+	KASSERT(lock_do_i_hold(fb->fb_lock));
+
+	*fw->fw_prevp = fw->fw_next;
+	if (fw->fw_next != NULL) {
+		fw->fw_next->fw_prevp = fw->fw_prevp;
+	}
+	else {
+		fb->fb_tailp = fw->fw_prevp;
+	}
+	fw->fw_next = NULL;
+	fw->fw_prevp = NULL;
+}
+
+/*
+ * Sleep until woken, if the word at USER_ADDR still holds VAL. With
+ * a non-null USER_TIMEOUT, give up with ETIMEDOUT after that
+ * relative interval.
+ */
+int
+sys_futex_wait(userptr_t user_addr, int val, const_userptr_t user_timeout)
+{
+	struct timespec timeout, now, deadline, left;
+	struct futex_bucket *fb;
+	struct futex_waiter fw;
+	vaddr_t addr = (vaddr_t)user_addr;
+	int cur, result;
+
+	if (addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+	if (user_timeout != NULL) {
+		result = copyin(user_timeout, &timeout, sizeof(timeout));
+		if (result) {
+			return result;
+		}
+		if (timeout.tv_sec < 0 || timeout.tv_nsec < 0 ||
+		    timeout.tv_nsec >= 1000000000) {
+			return EINVAL;
+		}
+		gettime(&now);
+		timespec_add(&now, &timeout, &deadline);
+	}
+
+	fw.fw_as = proc_getas();
+	fw.fw_addr = addr;
+	fw.fw_woken = false;
+	fb = futex_hash(fw.fw_as, addr);
+
+	lock_acquire(fb->fb_lock);
+	result = copyin(user_addr, &cur, sizeof(cur));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	fw.fw_next = NULL;
+	fw.fw_prevp = fb->fb_tailp;
+	*fb->fb_tailp = &fw;
+	fb->fb_tailp = &fw.fw_next;
+
+	/*
+	 * The cv is shared by the whole bucket, so we can be woken
+	 * for someone else; go back to sleep until it's us, keeping
+	 * the original deadline.
+	 */
+	result = 0;
+	while (!fw.fw_woken) {
+		if (user_timeout == NULL) {
+			cv_wait(fb->fb_cv, fb->fb_lock);
+			continue;
+		}
+		gettime(&now);
+		timespec_sub(&deadline, &now, &left);
+		if (left.tv_sec < 0 ||
+		    (left.tv_sec == 0 && left.tv_nsec == 0)) {
+			futex_unlink(fb, &fw);
+			result = ETIMEDOUT;
+			break;
+		}
+		cv_timedwait(fb->fb_cv, fb->fb_lock,
+			     timespec_to_ticks(&left));
+	}
+	lock_release(fb->fb_lock);
+	return result;
+}
+
+/*
+ * Wake up to COUNT sleepers on the word at USER_ADDR, oldest first,
+ * and return how many were woken.
+ */
+int
+sys_futex_wake(userptr_t user_addr, int count, int *retval)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter *fw, *next;
+	struct addrspace *as;
+	vaddr_t addr = (vaddr_t)user_addr;
+	int woken;
+
+	if (addr % sizeof(int) != 0 || count < 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	fb = futex_hash(as, addr);
+	woken = 0;
+
+	lock_acquire(fb->fb_lock);
+	for (fw = fb->fb_head; fw != NULL && woken < count; fw = next) {
+		next = fw->fw_next;
+		if (fw->fw_as == as && fw->fw_addr == addr) {
+			futex_unlink(fb, fw);
+			fw->fw_woken = true;
+			woken++;
+		}
+	}
+	if (woken > 0) {
+		cv_broadcast(fb->fb_cv, fb->fb_lock);
+	}
+	lock_release(fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
@@ -116,6 +116,26 @@ openfile_open(char *filename, int openflags, mode_t mode,
 	return 0;
 }
 
+/*
+ * Wrap a vnode that didn't come from vfs_open (e.g. one end of a
+ * pipe) in an openfile object. On success the openfile takes over the
+ * caller's reference to the vnode, and will release it with
+ * vfs_close like any other.
+ */
+int
+openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret)
+{
+	struct openfile *file;
+
+	file = openfile_create(vn, accmode);
+	if (file == NULL) {
+		return ENOMEM;
+	}
+
+	*ret = file;
+	return 0;
+}
+
 /*
  * Increment the reference count on an openfile.
  */
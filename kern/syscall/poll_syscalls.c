@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * poll() and select().
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <kern/select.h>
+#include <kern/time.h>
+#include <limits.h>
+#include <lib.h>
+#include <clock.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <poll.h>
+#include <syscall.h>
+
+/*
+ * Common logic for poll and select: check the NFDS file handles in
+ * FDS, filling in their revents, until at least one of them reports
+ * something or TIMEOUT (unless it's NULL) has passed. Hand back the
+ * number of file handles with nonzero revents.
+ *
+ * The first scan registers us with every object as it goes; after
+ * that we sleep until one of them (or the clock) wakes us, and
+ * rescan. We hold a reference to each vnode throughout so that none
+ * of them can go away while we're registered with it, even if the
+ * file handle is closed.
+ */
+static
+int
+dopoll(struct pollfd *fds, unsigned nfds, const struct timespec *timeout,
+       unsigned *retval)
+{
+	struct vnode **vns;
+	struct openfile *file;
+	struct pollwait *pw;
+	struct timespec deadline;
+	bool timedout, first;
+	unsigned i, nready;
+	int revents, result;
+
+	vns = NULL;
+	if (nfds > 0) {
+		vns = kmalloc(nfds * sizeof(vns[0]));
+		if (vns == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	for (i=0; i<nfds; i++) {
+		vns[i] = NULL;
+		if (fds[i].fd < 0) {
+			/* negative file handles are ignored */
+			continue;
+		}
+		result = filetable_get(curproc->p_filetable, fds[i].fd, &file);
+		if (result) {
+			/* not open; reported as POLLNVAL below */
+			continue;
+		}
+		vns[i] = file->of_vnode;
+		VOP_INCREF(vns[i]);
+		filetable_put(curproc->p_filetable, fds[i].fd, file);
+	}
+
+	/* With a zero timeout, just scan once without registering. */
+	timedout = timeout != NULL &&
+		timeout->tv_sec == 0 && timeout->tv_nsec == 0;
+	pw = NULL;
+	if (!timedout) {
+		pw = pollwait_create(nfds);
+		if (pw == NULL) {
+			result = ENOMEM;
+			goto out;
+		}
+		if (timeout != NULL) {
+			gettime(&deadline);
+			timespec_add(&deadline, timeout, &deadline);
+		}
+	}
+
+	first = true;
+	while (1) {
+		nready = 0;
+		for (i=0; i<nfds; i++) {
+			if (fds[i].fd < 0) {
+				revents = 0;
+			}
+			else if (vns[i] == NULL) {
+				revents = POLLNVAL;
+			}
+			else {
+				result = VOP_POLL(vns[i], first ? pw : NULL,
+						  &revents);
+				if (result) {
+					goto out;
+				}
+				revents &= fds[i].events | POLLERR | POLLHUP;
+			}
+			fds[i].revents = revents;
+			if (revents != 0) {
+				nready++;
+			}
+		}
+		first = false;
+
+		if (nready > 0 || timedout) {
+			break;
+		}
+		timedout = pollwait_sleep(pw, timeout != NULL ?
+					  &deadline : NULL);
+	}
+
+	*retval = nready;
+	result = 0;
+
+ out:
+	/* Unregister before dropping the vnodes. */
+	if (pw != NULL) {
+		pollwait_destroy(pw);
+	}
+	for (i=0; i<nfds; i++) {
+		if (vns[i] != NULL) {
+			VOP_DECREF(vns[i]);
+		}
+	}
+	kfree(vns);
+	return result;
+}
+
+/*
+ * poll() - copy in the array, use dopoll, copy it back out.
+ */
+int
+sys_poll(userptr_t fdsptr, unsigned nfds, int timeout_ms, int *retval)
+{
+	struct pollfd *fds;
+	struct timespec timeout;
+	unsigned nready;
+	int result;
+
+	/*
+	 * Each file handle can only appear once usefully, so more than
+	 * OPEN_MAX entries is probably a mistake; rejecting it also
+	 * bounds how much memory we allocate.
+	 */
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	fds = NULL;
+	if (nfds > 0) {
+		fds = kmalloc(nfds * sizeof(fds[0]));
+		if (fds == NULL) {
+			return ENOMEM;
+		}
+		result = copyin(fdsptr, fds, nfds * sizeof(fds[0]));
+		if (result) {
+			kfree(fds);
+			return result;
+		}
+	}
+
+	/* a negative timeout means wait forever */
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+	result = dopoll(fds, nfds, timeout_ms < 0 ? NULL : &timeout,
+			&nready);
+	if (result == 0 && nfds > 0) {
+		result = copyout(fds, fdsptr, nfds * sizeof(fds[0]));
+	}
+	kfree(fds);
+	if (result) {
+		return result;
+	}
+
+	*retval = nready;
+	return 0;
+}
+
+/*
+ * Bit operations on struct __fd_set.
+ */
+static
+bool
+fdset_isset(const struct __fd_set *set, int fd)
+{
+	return (set->fds_bits[fd / __NFDBITS] & (1U << (fd % __NFDBITS))) != 0;
+}
+
+static
+void
+fdset_set(struct __fd_set *set, int fd)
+{
+	set->fds_bits[fd / __NFDBITS] |= 1U << (fd % __NFDBITS);
+}
+
+/*
+ * Copy in an fd_set, which may be NULL (meaning empty).
+ */
+static
+int
+fdset_copyin(const_userptr_t uset, struct __fd_set *set)
+{
+	if (uset == NULL) {
+		bzero(set, sizeof(*set));
+		return 0;
+	}
+	return copyin(uset, set, sizeof(*set));
+}
+
+/*
+ * select() - convert the fd_sets to an array of struct pollfd, use
+ * dopoll, and convert the results back.
+ *
+ * Following the usual Unix practice, a file handle that hung up or
+ * got an error counts as readable (and an error also as writable), so
+ * that the read or write call that follows sees what happened.
+ */
+int
+sys_select(int nfds, userptr_t ureadfds, userptr_t uwritefds,
+	   userptr_t uexceptfds, const_userptr_t utimeout, int *retval)
+{
+	struct __fd_set readfds, writefds, exceptfds;
+	struct pollfd fds[__FD_SETSIZE];
+	struct timeval tv;
+	struct timespec timeout;
+	unsigned num, nready, i;
+	int fd, result;
+
+	if (nfds < 0 || nfds > __FD_SETSIZE) {
+		return EINVAL;
+	}
+
+	result = fdset_copyin(ureadfds, &readfds);
+	if (result) {
+		return result;
+	}
+	result = fdset_copyin(uwritefds, &writefds);
+	if (result) {
+		return result;
+	}
+	result = fdset_copyin(uexceptfds, &exceptfds);
+	if (result) {
+		return result;
+	}
+
+	if (utimeout != NULL) {
+		result = copyin(utimeout, &tv, sizeof(tv));
+		if (result) {
+			return result;
+		}
+		if (tv.tv_sec < 0 || tv.tv_usec < 0 || tv.tv_usec >= 1000000) {
+			return EINVAL;
+		}
+		timeout.tv_sec = tv.tv_sec;
+		timeout.tv_nsec = tv.tv_usec * 1000;
+	}
+
+	num = 0;
+	for (fd=0; fd<nfds; fd++) {
+		fds[num].fd = fd;
+		fds[num].events = 0;
+		fds[num].revents = 0;
+		if (fdset_isset(&readfds, fd)) {
+			fds[num].events |= POLLIN;
+		}
+		if (fdset_isset(&writefds, fd)) {
+			fds[num].events |= POLLOUT;
+		}
+		if (fdset_isset(&exceptfds, fd)) {
+			fds[num].events |= POLLPRI;
+		}
+		if (fds[num].events != 0) {
+			num++;
+		}
+	}
+
+	result = dopoll(fds, num, utimeout == NULL ? NULL : &timeout,
+			&nready);
+	if (result) {
+		return result;
+	}
+
+	bzero(&readfds, sizeof(readfds));
+	bzero(&writefds, sizeof(writefds));
+	bzero(&exceptfds, sizeof(exceptfds));
+	nready = 0;
+	for (i=0; i<num; i++) {
+		fd = fds[i].fd;
+		if (fds[i].revents & POLLNVAL) {
+			return EBADF;
+		}
+		if ((fds[i].events & POLLIN) &&
+		    (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+			fdset_set(&readfds, fd);
+			nready++;
+		}
+		if ((fds[i].events & POLLOUT) &&
+		    (fds[i].revents & (POLLOUT | POLLERR))) {
+			fdset_set(&writefds, fd);
+			nready++;
+		}
+		if ((fds[i].events & POLLPRI) &&
+		    (fds[i].revents & POLLPRI)) {
+			fdset_set(&exceptfds, fd);
+			nready++;
+		}
+	}
+
+	if (ureadfds != NULL) {
+		result = copyout(&readfds, ureadfds, sizeof(readfds));
+		if (result) {
+			return result;
+		}
+	}
+	if (uwritefds != NULL) {
+		result = copyout(&writefds, uwritefds, sizeof(writefds));
+		if (result) {
+			return result;
+		}
+	}
+	if (uexceptfds != NULL) {
+		result = copyout(&exceptfds, uexceptfds, sizeof(exceptfds));
+		if (result) {
+			return result;
+		}
+	}
+
+	*retval = nready;
+	return 0;
+}
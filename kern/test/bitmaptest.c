@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <bitmap.h>
 #include <test.h>
@@ -101,6 +102,15 @@ bitmaptest(int nargs, char **args)
 		KASSERT(data[i]==0);
 	}
 
+	/* Searching from a hint goes onward, then wraps around */
+	bitmap_unmark(b, 3);
+	bitmap_unmark(b, 100);
+	bitmap_unmark(b, TESTSIZE-1);
+	KASSERT(bitmap_alloc_near(b, 101, &x)==0 && x == TESTSIZE-1);
+	KASSERT(bitmap_alloc_near(b, 101, &x)==0 && x == 3);
+	KASSERT(bitmap_alloc_near(b, 100, &x)==0 && x == 100);
+	KASSERT(bitmap_alloc_near(b, 0, &x)==ENOSPC);
+
 	kprintf("Bitmap test complete\n");
 	return 0;
 }
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Test and benchmark for memcpy, memmove, memset, and bzero.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <vm.h> /* for PAGE_SIZE */
+#include <test.h>
+
+/* Largest size benchmarked, and how far off alignment we go */
+#define MAXSIZE   (16 * PAGE_SIZE)
+#define SLOP      8
+#define BUFSIZE   (MAXSIZE + 2 * PAGE_SIZE)
+
+/* Amount of data moved per benchmark entry */
+#define TOTALBYTES (1024 * 1024)
+
+/* Sizes checked for correctness at every pair of alignments */
+#define CHECKMAX  80
+
+/* Operations benchmarked */
+#define OP_MEMCPY  0
+#define OP_MEMMOVE 1
+#define OP_MEMSET  2
+#define OP_BZERO   3
+#define NOPS       4
+
+static const char *const opnames[NOPS] = {
+	"memcpy", "memmove", "memset", "bzero",
+};
+
+static
+void
+fillbuf(unsigned char *buf, size_t len, unsigned seed)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		buf[i] = (unsigned char)(seed + i * 7 + (i >> 8));
+	}
+}
+
+/*
+ * Return nonzero if the first LEN bytes of A and B differ.
+ */
+static
+int
+bufdiffer(const unsigned char *a, const unsigned char *b, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (a[i] != b[i]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Compare the optimized routines against byte-at-a-time reference
+ * results, at every head and tail alignment. Returns 0 on success.
+ */
+static
+int
+memcheck(unsigned char *a, unsigned char *b)
+{
+	unsigned char *ref = b + PAGE_SIZE;
+	unsigned so, dof, len;
+	size_t i;
+
+	for (so=0; so<SLOP; so++) {
+		for (dof=0; dof<SLOP; dof++) {
+			for (len=0; len<CHECKMAX; len++) {
+				/* memcpy */
+				fillbuf(a, CHECKMAX + SLOP, so + len);
+				fillbuf(b, CHECKMAX + SLOP, dof);
+				fillbuf(ref, CHECKMAX + SLOP, dof);
+				for (i=0; i<len; i++) {
+					ref[dof + i] = a[so + i];
+				}
+				memcpy(b + dof, a + so, len);
+				if (bufdiffer(b, ref, CHECKMAX + SLOP)) {
+					kprintf("memcpy: wrong result (src+%u, "
+						"dst+%u, len %u)\n",
+						so, dof, len);
+					return 1;
+				}
+
+				/* memmove, overlapping in both directions */
+				fillbuf(a, CHECKMAX + 2*SLOP, len);
+				fillbuf(ref, CHECKMAX + 2*SLOP, len);
+				if (dof > so) {
+					for (i=len; i>0; i--) {
+						ref[dof + i-1] = ref[so + i-1];
+					}
+				}
+				else {
+					for (i=0; i<len; i++) {
+						ref[dof + i] = ref[so + i];
+					}
+				}
+				memmove(a + dof, a + so, len);
+				if (bufdiffer(a, ref, CHECKMAX + 2*SLOP)) {
+					kprintf("memmove: wrong result "
+						"(src+%u, dst+%u, len %u)\n",
+						so, dof, len);
+					return 1;
+				}
+
+				/* memset */
+				fillbuf(b, CHECKMAX + SLOP, so);
+				fillbuf(ref, CHECKMAX + SLOP, so);
+				for (i=0; i<len; i++) {
+					ref[dof + i] = 0xa5;
+				}
+				memset(b + dof, 0xa5, len);
+				if (bufdiffer(b, ref, CHECKMAX + SLOP)) {
+					kprintf("memset: wrong result "
+						"(dst+%u, len %u)\n",
+						dof, len);
+					return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Print BYTES per CYCLES as a decimal with two places.
+ */
+static
+void
+printrate(const char *name, size_t size, unsigned off,
+	  uint64_t bytes, uint64_t cycles)
+{
+	uint64_t rate;
+
+	rate = cycles > 0 ? (bytes * 100) / cycles : 0;
+	kprintf("%-8s %6lu bytes  +%u: %3lu.%02lu bytes/cycle\n",
+		name, (unsigned long)size, off,
+		(unsigned long)(rate / 100), (unsigned long)(rate % 100));
+}
+
+/*
+ * Run one benchmark: repeat an operation of SIZE bytes at offset OFF
+ * until TOTALBYTES have been moved, and report bytes per cycle.
+ */
+static
+void
+membench(unsigned op, unsigned char *a, unsigned char *b,
+	 size_t size, unsigned off)
+{
+	unsigned i, reps;
+	uint32_t start, end;
+
+	reps = TOTALBYTES / size;
+
+	start = cpu_cycles();
+	for (i=0; i<reps; i++) {
+		switch (op) {
+		    case OP_MEMCPY:
+			memcpy(b, a + off, size);
+			break;
+		    case OP_MEMMOVE:
+			memmove(a + off, a, size);
+			break;
+		    case OP_MEMSET:
+			memset(b + off, i, size);
+			break;
+		    default:
+			bzero(b + off, size);
+			break;
+		}
+	}
+	end = cpu_cycles();
+
+	/* unsigned subtraction handles one wrap of the counter */
+	printrate(opnames[op], size, off, (uint64_t)reps * size, end - start);
+}
+
+int
+memtest(int nargs, char **args)
+{
+	static const size_t sizes[] = {
+		16, 64, 512, PAGE_SIZE, MAXSIZE,
+	};
+	unsigned char *a, *b;
+	unsigned i, j;
+
+	(void)nargs;
+	(void)args;
+
+	a = kmalloc(BUFSIZE);
+	b = kmalloc(BUFSIZE);
+	if (a == NULL || b == NULL) {
+		kprintf("memtest: Out of memory\n");
+		kfree(a);
+		kfree(b);
+		return ENOMEM;
+	}
+	/* Multipage kmalloc blocks are page-aligned. */
+	KASSERT((vaddr_t)a % PAGE_SIZE == 0);
+	KASSERT((vaddr_t)b % PAGE_SIZE == 0);
+
+	kprintf("Checking memcpy/memmove/memset...\n");
+	if (memcheck(a, b)) {
+		kfree(a);
+		kfree(b);
+		kprintf("memtest: FAILED\n");
+		return 0;
+	}
+
+	kprintf("Benchmarking (aligned, then off by 1 and 3)...\n");
+	for (i=0; i<NOPS; i++) {
+		for (j=0; j<sizeof(sizes)/sizeof(sizes[0]); j++) {
+			membench(i, a, b, sizes[j], 0);
+			membench(i, a, b, sizes[j], 1);
+			membench(i, a, b, sizes[j], 3);
+		}
+	}
+
+	kfree(a);
+	kfree(b);
+	kprintf("memtest done\n");
+	return 0;
+}
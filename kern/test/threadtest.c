@@ -32,11 +32,13 @@
  */
 #include <types.h>
 #include <lib.h>
+#include <cpu.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
 
 #define NTHREADS  8
+#define NFORKS    1000
 
 static struct semaphore *tsem = NULL;
 
@@ -144,3 +146,50 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+static
+void
+emptythread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+/*
+ * Time thread_fork. Each thread is waited for before the next one is
+ * forked, so after the first few, forks should be served from the
+ * thread pool.
+ */
+int
+threadtest4(int nargs, char **args)
+{
+	uint32_t start, forkcycles, totalcycles;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	init_sem();
+	kprintf("Starting thread test 4...\n");
+
+	forkcycles = totalcycles = 0;
+	for (i=0; i<NFORKS; i++) {
+		start = cpu_cycles();
+		result = thread_fork("forkbench", NULL, emptythread, NULL, i);
+		forkcycles += cpu_cycles() - start;
+		if (result) {
+			panic("threadtest4: thread_fork failed %s)\n",
+			      strerror(result));
+		}
+		P(tsem);
+		totalcycles += cpu_cycles() - start;
+	}
+
+	kprintf("thread_fork: %u cycles; fork, run, and exit: %u cycles\n",
+		forkcycles / NFORKS, totalcycles / NFORKS);
+	kprintf("Thread test 4 done.\n");
+	return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Test for kernel timers, timed sleeps, and clocknanosleep.
+ */
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <clock.h>
+#include <synch.h>
+#include <timer.h>
+#include <test.h>
+
+/*
+ * Delays tried, in ticks. These straddle the level 0/level 1
+ * boundary so that cascading gets exercised.
+ */
+static const unsigned delays[] = {
+	1, 2, 3, 17, 63, 64, 65, 100, 127, 128, 129, 200,
+};
+#define NDELAYS (sizeof(delays) / sizeof(delays[0]))
+
+struct testtimer {
+	struct timer tt_timer;
+	unsigned tt_start;		/* c_hardclocks when started */
+	unsigned tt_fired;		/* c_hardclocks when fired */
+	struct semaphore *tt_done;	/* V'd when fired */
+};
+
+static
+void
+testtimer_fire(void *data)
+{
+	struct testtimer *tt = data;
+
+	tt->tt_fired = curcpu->c_hardclocks;
+	V(tt->tt_done);
+}
+
+/*
+ * Start a timer. Keep interrupts off so the timer goes on this cpu's
+ * wheel and no hardclock sneaks in between reading the count and
+ * starting it.
+ */
+static
+void
+testtimer_start(struct testtimer *tt, unsigned ticks)
+{
+	int spl;
+
+	spl = splhigh();
+	tt->tt_start = curcpu->c_hardclocks;
+	tt->tt_fired = 0;
+	timer_start(&tt->tt_timer, ticks);
+	splx(spl);
+}
+
+/*
+ * Start timers for all the delays at once, then check that each one
+ * fired exactly on its tick. Returns 0 on success.
+ */
+static
+int
+wheeltest(struct semaphore *done)
+{
+	struct testtimer tts[NDELAYS];
+	unsigned i;
+	int bad = 0;
+
+	for (i=0; i<NDELAYS; i++) {
+		timer_init(&tts[i].tt_timer, testtimer_fire, &tts[i]);
+		tts[i].tt_done = done;
+		testtimer_start(&tts[i], delays[i]);
+	}
+	for (i=0; i<NDELAYS; i++) {
+		P(done);
+	}
+	for (i=0; i<NDELAYS; i++) {
+		if (tts[i].tt_fired - tts[i].tt_start != delays[i]) {
+			kprintf("Timer for %u ticks fired after %u\n",
+				delays[i], tts[i].tt_fired - tts[i].tt_start);
+			bad = 1;
+		}
+		timer_cleanup(&tts[i].tt_timer);
+	}
+	return bad;
+}
+
+/*
+ * Check that a stopped timer doesn't fire. This also checks that
+ * P_timed gives up. Returns 0 on success.
+ */
+static
+int
+stoptest(struct semaphore *done)
+{
+	struct testtimer tt;
+	int bad = 0;
+
+	timer_init(&tt.tt_timer, testtimer_fire, &tt);
+	tt.tt_done = done;
+	testtimer_start(&tt, 20);
+	if (!timer_stop(&tt.tt_timer)) {
+		kprintf("timer_stop missed a pending timer\n");
+		bad = 1;
+	}
+	if (timer_stop(&tt.tt_timer)) {
+		kprintf("timer_stop stopped a stopped timer\n");
+		bad = 1;
+	}
+	if (!P_timed(done, 30)) {
+		kprintf("Stopped timer fired anyway\n");
+		bad = 1;
+	}
+	timer_cleanup(&tt.tt_timer);
+	return bad;
+}
+
+/*
+ * Check that P_timed and cv_timedwait come back early when woken,
+ * and time out when not. Returns 0 on success.
+ */
+static
+int
+timedwaittest(struct semaphore *done)
+{
+	struct testtimer tt;
+	struct lock *lk;
+	struct cv *cv;
+	int bad = 0;
+
+	timer_init(&tt.tt_timer, testtimer_fire, &tt);
+	tt.tt_done = done;
+	testtimer_start(&tt, 5);
+	if (P_timed(done, 10 * HZ)) {
+		kprintf("P_timed timed out despite a V\n");
+		bad = 1;
+	}
+	if (!P_timed(done, 0)) {
+		kprintf("P_timed with no ticks got a phantom V\n");
+		bad = 1;
+	}
+	timer_cleanup(&tt.tt_timer);
+
+	lk = lock_create("timertest");
+	cv = cv_create("timertest");
+	if (lk == NULL || cv == NULL) {
+		panic("timertest: Out of memory\n");
+	}
+	lock_acquire(lk);
+	if (!cv_timedwait(cv, lk, 5)) {
+		kprintf("cv_timedwait woke up with nobody signalling\n");
+		bad = 1;
+	}
+	KASSERT(lock_do_i_hold(lk));
+	lock_release(lk);
+	cv_destroy(cv);
+	lock_destroy(lk);
+	return bad;
+}
+
+/*
+ * Check that clocknanosleep sleeps at least as long as asked.
+ * Returns 0 on success.
+ */
+static
+int
+nanosleeptest(void)
+{
+	struct timespec req, before, after, slept;
+
+	req.tv_sec = 0;
+	req.tv_nsec = 250000000;
+	gettime(&before);
+	clocknanosleep(&req);
+	gettime(&after);
+	timespec_sub(&after, &before, &slept);
+	kprintf("Asked for 0.250000000 seconds, slept %llu.%09lu\n",
+		(unsigned long long)slept.tv_sec,
+		(unsigned long)slept.tv_nsec);
+	if (slept.tv_sec == 0 && slept.tv_nsec < req.tv_nsec) {
+		kprintf("clocknanosleep returned early\n");
+		return 1;
+	}
+	return 0;
+}
+
+int
+timertest(int nargs, char **args)
+{
+	struct semaphore *done;
+	int bad;
+
+	(void)nargs;
+	(void)args;
+
+	done = sem_create("timertest", 0);
+	if (done == NULL) {
+		panic("timertest: Out of memory\n");
+	}
+
+	kprintf("Starting timer test...\n");
+	bad = wheeltest(done);
+	bad |= stoptest(done);
+	bad |= timedwaittest(done);
+	bad |= nanosleeptest();
+	sem_destroy(done);
+
+	kprintf("Timer test %s\n", bad ? "FAILED" : "done.");
+	return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Test for the trace rings.
+ */
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <trace.h>
+#include <test.h>
+
+/* Not set in dbflags, so nothing gets printed. */
+#define DB_TRACETEST 0x80000000
+
+static const char tracetest_fmt[] = "tracetest: %u %u %u %u\n";
+
+int
+tracetest(int nargs, char **args)
+{
+	struct tracering *tr;
+	struct tracerec *rec;
+	unsigned i, head;
+	int spl, bad = 0;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting trace test...\n");
+
+	/*
+	 * Stay on one cpu with interrupts off so nothing else lands
+	 * in the ring while we look at it.
+	 */
+	spl = splhigh();
+	tr = &curcpu->c_trace;
+	head = tr->tr_head;
+	for (i=0; i<TRACE_RECORDS + 3; i++) {
+		TRACE(DB_TRACETEST, tracetest_fmt, i, i+1, i+2, i+3);
+	}
+	TRACE(DB_TRACETEST, tracetest_fmt, 7);
+	if (tr->tr_head != head + TRACE_RECORDS + 4) {
+		kprintf("Ring head moved by %u, expected %u\n",
+			tr->tr_head - head, TRACE_RECORDS + 4);
+		bad = 1;
+	}
+
+	/* The oldest surviving loop record, and the last one. */
+	rec = &tr->tr_recs[(head + 4) % TRACE_RECORDS];
+	if (rec->tr_fmt != tracetest_fmt || rec->tr_args[0] != 4 ||
+	    rec->tr_args[3] != 7) {
+		kprintf("Wrapped record is wrong\n");
+		bad = 1;
+	}
+	rec = &tr->tr_recs[(head + TRACE_RECORDS + 3) % TRACE_RECORDS];
+	if (rec->tr_flags != DB_TRACETEST || rec->tr_args[0] != 7 ||
+	    rec->tr_args[1] != 0 || rec->tr_args[3] != 0) {
+		kprintf("Short record was not padded\n");
+		bad = 1;
+	}
+	splx(spl);
+
+	trace_dump(2);
+
+	kprintf("Trace test %s\n", bad ? "FAILED" : "done.");
+	return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Test for work queues.
+ */
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <synch.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define NWORK 64
+
+struct testwork {
+	struct work tw_work;
+	unsigned tw_runs;		/* times the function was called */
+	unsigned tw_nap;		/* ticks to sleep in the function */
+	struct semaphore *tw_done;	/* V'd after each call */
+};
+
+static
+void
+testwork_run(void *data)
+{
+	struct testwork *tw = data;
+
+	if (tw->tw_nap > 0) {
+		/* Nobody V's this; it's just a way to sleep. */
+		P_timed(tw->tw_done, tw->tw_nap);
+	}
+	tw->tw_runs++;
+	V(tw->tw_done);
+}
+
+static
+void
+testwork_init(struct testwork *tw, struct semaphore *done, unsigned nap)
+{
+	work_init(&tw->tw_work, testwork_run, tw);
+	tw->tw_runs = 0;
+	tw->tw_nap = nap;
+	tw->tw_done = done;
+}
+
+/*
+ * Submit a batch of work and check that each item runs once.
+ * Returns 0 on success.
+ */
+static
+int
+runtest(struct semaphore *done)
+{
+	static struct testwork tws[NWORK];
+	unsigned i;
+	int bad = 0;
+
+	for (i=0; i<NWORK; i++) {
+		testwork_init(&tws[i], done, 0);
+		if (!work_submit(&tws[i].tw_work)) {
+			kprintf("work_submit refused idle work\n");
+			bad = 1;
+		}
+	}
+	for (i=0; i<NWORK; i++) {
+		P(done);
+	}
+	for (i=0; i<NWORK; i++) {
+		work_wait(&tws[i].tw_work);
+		if (tws[i].tw_runs != 1) {
+			kprintf("Work item %u ran %u times\n",
+				i, tws[i].tw_runs);
+			bad = 1;
+		}
+		work_cleanup(&tws[i].tw_work);
+	}
+	return bad;
+}
+
+/*
+ * Check that delayed work can be cancelled, that pending work can't
+ * be submitted twice, and that cancelled work doesn't run. Returns
+ * 0 on success.
+ */
+static
+int
+canceltest(struct semaphore *done)
+{
+	struct testwork tw;
+	int bad = 0;
+
+	testwork_init(&tw, done, 0);
+	if (!work_submit_delayed(&tw.tw_work, 10 * HZ)) {
+		kprintf("work_submit_delayed refused idle work\n");
+		bad = 1;
+	}
+	if (work_submit(&tw.tw_work)) {
+		kprintf("work_submit accepted pending work\n");
+		bad = 1;
+	}
+	if (!work_cancel(&tw.tw_work)) {
+		kprintf("work_cancel missed delayed work\n");
+		bad = 1;
+	}
+	if (work_cancel(&tw.tw_work)) {
+		kprintf("work_cancel cancelled idle work\n");
+		bad = 1;
+	}
+	work_wait(&tw.tw_work);
+	if (!P_timed(done, 20) || tw.tw_runs != 0) {
+		kprintf("Cancelled work ran anyway\n");
+		bad = 1;
+	}
+	work_cleanup(&tw.tw_work);
+	return bad;
+}
+
+/*
+ * Check that delayed work runs, and that work_wait waits for work
+ * that sleeps. Returns 0 on success.
+ */
+static
+int
+waittest(struct semaphore *done)
+{
+	struct semaphore *napsem;
+	struct testwork tw;
+	int bad = 0;
+
+	napsem = sem_create("wqtest-nap", 0);
+	if (napsem == NULL) {
+		panic("workqueuetest: Out of memory\n");
+	}
+
+	testwork_init(&tw, done, 0);
+	work_submit_delayed(&tw.tw_work, 5);
+	work_wait(&tw.tw_work);
+	if (tw.tw_runs != 1) {
+		kprintf("work_wait returned before delayed work ran\n");
+		bad = 1;
+	}
+	P(done);
+	work_cleanup(&tw.tw_work);
+
+	testwork_init(&tw, napsem, 10);
+	work_submit(&tw.tw_work);
+	work_wait(&tw.tw_work);
+	if (tw.tw_runs != 1) {
+		kprintf("work_wait returned while work was asleep\n");
+		bad = 1;
+	}
+	P(napsem);
+	work_cleanup(&tw.tw_work);
+
+	sem_destroy(napsem);
+	return bad;
+}
+
+int
+workqueuetest(int nargs, char **args)
+{
+	struct semaphore *done;
+	int bad;
+
+	(void)nargs;
+	(void)args;
+
+	done = sem_create("workqueuetest", 0);
+	if (done == NULL) {
+		panic("workqueuetest: Out of memory\n");
+	}
+
+	kprintf("Starting work queue test...\n");
+	bad = runtest(done);
+	bad |= canceltest(done);
+	bad |= waittest(done);
+	sem_destroy(done);
+
+	kprintf("Work queue test %s\n", bad ? "FAILED" : "done.");
+	return 0;
+}
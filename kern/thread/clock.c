@@ -34,6 +34,8 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <timer.h>
+#include <mainbus.h>
 
 /*
  * Time handling.
@@ -59,6 +61,13 @@
 static struct wchan *lbolt;
 static struct spinlock lbolt_lock;
 
+/*
+ * Threads in clocknanosleep sleep here; nobody wakes this channel,
+ * so they only come back when their timeouts fire.
+ */
+static struct wchan *napping;
+static struct spinlock napping_lock;
+
 /*
  * Setup.
  */
@@ -70,6 +79,11 @@ hardclock_bootstrap(void)
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+	spinlock_init(&napping_lock);
+	napping = wchan_create("nanosleep");
+	if (napping == NULL) {
+		panic("Couldn't create nanosleep wchan\n");
+	}
 }
 
 /*
@@ -85,6 +99,17 @@ timerclock(void)
 	spinlock_release(&lbolt_lock);
 }
 
+/*
+ * Account for hardclocks that a tickless idle cpu slept through.
+ */
+static
+void
+hardclock_skip(unsigned ticks)
+{
+	curcpu->c_hardclocks += ticks;
+	timer_skip(ticks);
+}
+
 /*
  * This is called HZ times a second (on each processor) by the timer
  * code.
@@ -96,7 +121,23 @@ hardclock(void)
 	 * Collect statistics here as desired.
 	 */
 
+	if (curcpu->c_idleticks > 0) {
+		/* This is the end of a tickless idle; catch up first. */
+		hardclock_skip(curcpu->c_idleticks - 1);
+		curcpu->c_idleticks = 0;
+	}
+
 	curcpu->c_hardclocks++;
+	timer_hardclock();
+
+	/*
+	 * The rest is only worth doing if some other thread is waiting
+	 * to run here. Peeking at the count without the run queue lock
+	 * is fine; if we miss a thread, we'll see it next tick.
+	 */
+	if (curcpu->c_runqueue.tl_count == 0) {
+		return;
+	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
@@ -106,6 +147,36 @@ hardclock(void)
 	thread_yield();
 }
 
+/*
+ * Called by the idle loop, with interrupts off, to idle until
+ * something happens. Rather than wake up for every tick, stop the
+ * clock until the next timer on this cpu is due, if that's more than
+ * a tick away. If some other interrupt wakes us first, restart the
+ * clock and make up the ticks missed so far.
+ */
+void
+hardclock_idle(void)
+{
+	unsigned ticks;
+
+	KASSERT(curcpu->c_idleticks == 0);
+
+	ticks = timer_idleticks();
+	if (ticks != 1) {
+		/* 0 means no timers at all; sleep as long as we can. */
+		curcpu->c_idleticks = mainbus_timer_skip(ticks > 0 ?
+							 ticks : (unsigned)-1);
+	}
+
+	cpu_idle();
+
+	if (curcpu->c_idleticks > 0) {
+		ticks = mainbus_timer_resume(curcpu->c_idleticks);
+		curcpu->c_idleticks = 0;
+		hardclock_skip(ticks);
+	}
+}
+
 /*
  * Suspend execution for n seconds.
  */
@@ -119,3 +190,28 @@ clocksleep(int num_secs)
 	}
 	spinlock_release(&lbolt_lock);
 }
+
+/*
+ * Suspend execution for an arbitrary interval. Work from a deadline
+ * so that rounding to ticks can never make us return early.
+ */
+void
+clocknanosleep(const struct timespec *duration)
+{
+	struct timespec now, deadline, left;
+
+	gettime(&now);
+	timespec_add(&now, duration, &deadline);
+
+	while (1) {
+		gettime(&now);
+		timespec_sub(&deadline, &now, &left);
+		if (left.tv_sec < 0 || (left.tv_sec == 0 && left.tv_nsec == 0)) {
+			break;
+		}
+		spinlock_acquire(&napping_lock);
+		wchan_timedsleep(napping, &napping_lock,
+				 timespec_to_ticks(&left));
+		spinlock_release(&napping_lock);
+	}
+}
@@ -38,6 +38,7 @@
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
+#include <clock.h>
 #include <synch.h>
 
 ////////////////////////////////////////////////////////////
@@ -120,6 +121,43 @@ P(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+bool
+P_timed(struct semaphore *sem, unsigned ticks)
+{
+	struct timespec now, deadline, left;
+
+	KASSERT(sem != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	ticks_to_timespec(ticks, &left);
+	gettime(&now);
+	timespec_add(&now, &left, &deadline);
+
+	spinlock_acquire(&sem->sem_lock);
+	while (sem->sem_count == 0) {
+		if (wchan_timedsleep(sem->sem_wchan, &sem->sem_lock, ticks)) {
+			if (sem->sem_count == 0) {
+				spinlock_release(&sem->sem_lock);
+				return true;
+			}
+			break;
+		}
+		/*
+		 * Woken up, but someone may have beaten us to the
+		 * count. Go back to sleep only for the time left.
+		 */
+		spinlock_release(&sem->sem_lock);
+		gettime(&now);
+		timespec_sub(&deadline, &now, &left);
+		ticks = timespec_to_ticks(&left);
+		spinlock_acquire(&sem->sem_lock);
+	}
+	KASSERT(sem->sem_count > 0);
+	sem->sem_count--;
+	spinlock_release(&sem->sem_lock);
+	return false;
+}
+
 void
 V(struct semaphore *sem)
 {
@@ -284,6 +322,19 @@ cv_wait(struct cv *cv, struct lock *lock)
 	lock_acquire(lock);
 }
 
+bool
+cv_timedwait(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+	bool timedout;
+
+	spinlock_acquire(&cv->cv_wchanlock);
+	lock_release(lock);
+	timedout = wchan_timedsleep(cv->cv_wchan, &cv->cv_wchanlock, ticks);
+	spinlock_release(&cv->cv_wchanlock);
+	lock_acquire(lock);
+	return timedout;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -38,12 +38,14 @@
 #include <lib.h>
 #include <array.h>
 #include <cpu.h>
+#include <clock.h>
 #include <spl.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <threadlist.h>
 #include <threadprivate.h>
+#include <timer.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
@@ -119,37 +121,55 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Set a thread's name. Short names are copied into the thread
+ * itself, so that recycling a thread usually needs no kmalloc.
  */
 static
-struct thread *
-thread_create(const char *name)
+int
+thread_setname(struct thread *thread, const char *name)
 {
-	struct thread *thread;
-
-	DEBUGASSERT(name != NULL);
-
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
+	if (strlen(name) < sizeof(thread->t_namebuf)) {
+		strcpy(thread->t_namebuf, name);
+		thread->t_name = thread->t_namebuf;
+		return 0;
 	}
-
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
+		return ENOMEM;
+	}
+	return 0;
+}
+
+static
+void
+thread_freename(struct thread *thread)
+{
+	if (thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
 	}
+	thread->t_name = NULL;
+}
+
+/*
+ * Put a thread's fields (other than the name and stack) in the state
+ * of a freshly created thread. Used by thread_create, and when a
+ * thread is recycled through the per-cpu thread pool.
+ */
+static
+void
+thread_reset(struct thread *thread)
+{
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
+	thread->t_wchan = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+	thread->t_pinned = false;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
@@ -157,7 +177,32 @@ thread_create(const char *name)
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
 	/* If you add to struct thread, be sure to initialize here */
-	
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name)
+{
+	struct thread *thread;
+
+	DEBUGASSERT(name != NULL);
+
+	thread = kmalloc(sizeof(*thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	if (thread_setname(thread, name)) {
+		kfree(thread);
+		return NULL;
+	}
+	thread->t_stack = NULL;
+	thread_reset(thread);
+
 	return thread;
 }
 
@@ -175,6 +220,7 @@ cpu_create(unsigned hardware_number)
 	struct cpu *c;
 	int result;
 	char namebuf[16];
+	unsigned i;
 
 	c = kmalloc(sizeof(*c));
 	if (c == NULL) {
@@ -186,13 +232,22 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadpool);
 	c->c_hardclocks = 0;
+	c->c_idleticks = 0;
+	for (i=0; i<4; i++) {
+		c->c_randstate[i] = 0;
+	}
+	c->c_randleft = 0;
 	c->c_spinlocks = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
 
+	timerwheel_init(&c->c_timers);
+	workqueue_init(&c->c_workq);
+
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
@@ -201,6 +256,7 @@ cpu_create(unsigned hardware_number)
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	tracering_init(&c->c_trace, c->c_number);
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -266,15 +322,107 @@ thread_destroy(struct thread *thread)
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
+	thread_freename(thread);
 	kfree(thread);
 }
 
+/*
+ * Thread pool.
+ *
+ * Each cpu keeps up to THREADPOOL_MAX dead threads, stacks and all,
+ * for thread_fork to reuse, so forking normally needs no kmalloc at
+ * all. Exited threads go back into the pool of the cpu they died on
+ * when exorcise() reaps them; the pool starts with THREADPOOL_PREFILL
+ * threads so the first forks are fast too.
+ *
+ * Only the owning cpu touches its pool, so having interrupts off is
+ * all the locking it needs.
+ */
+#define THREADPOOL_MAX		8
+#define THREADPOOL_PREFILL	2
+
+/*
+ * Create a thread complete with a stack, ready for thread_fork.
+ */
+static
+struct thread *
+thread_create_withstack(const char *name)
+{
+	struct thread *thread;
+
+	thread = thread_create(name);
+	if (thread == NULL) {
+		return NULL;
+	}
+	thread->t_stack = kmalloc(STACK_SIZE);
+	if (thread->t_stack == NULL) {
+		thread_destroy(thread);
+		return NULL;
+	}
+	thread_checkstack_init(thread);
+	return thread;
+}
+
+/*
+ * Fill cpu C's pool up to THREADPOOL_PREFILL threads. It's not a
+ * problem if we run out of memory; forks will just be slower.
+ */
+static
+void
+threadpool_fill(struct cpu *c)
+{
+	struct thread *t;
+	int spl;
+
+	while (c->c_threadpool.tl_count < THREADPOOL_PREFILL) {
+		t = thread_create_withstack("pooled");
+		if (t == NULL) {
+			break;
+		}
+		t->t_wchan_name = "POOLED";
+		t->t_state = S_ZOMBIE;
+		spl = splhigh();
+		threadlist_addtail(&c->c_threadpool, t);
+		splx(spl);
+	}
+}
+
+/*
+ * Get a thread with a stack for thread_fork, from the current cpu's
+ * pool if possible.
+ */
+static
+struct thread *
+threadpool_get(const char *name)
+{
+	struct thread *t;
+	int spl;
+
+	spl = splhigh();
+	t = threadlist_remhead(&curcpu->c_threadpool);
+	splx(spl);
+
+	if (t == NULL) {
+		return thread_create_withstack(name);
+	}
+
+	thread_freename(t);
+	if (thread_setname(t, name)) {
+		/* thread_destroy copes with the missing name */
+		thread_destroy(t);
+		return NULL;
+	}
+	thread_reset(t);
+	thread_checkstack_init(t);
+	return t;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to be recycled or destroyed.) Keep as many as the thread pool
+ * has room for, and destroy the rest.
  *
- * The list of zombies is per-cpu.
+ * The list of zombies is per-cpu. Called with interrupts off.
  */
 static
 void
@@ -285,7 +433,15 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		thread_checkstack(z);
+		if (z->t_stack != NULL &&
+		    curcpu->c_threadpool.tl_count < THREADPOOL_MAX) {
+			z->t_wchan_name = "POOLED";
+			threadlist_addtail(&curcpu->c_threadpool, z);
+		}
+		else {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -417,6 +573,8 @@ cpu_hatch(unsigned software_number)
 
 	kprintf("cpu%u: %s\n", software_number, buf);
 
+	workqueue_start(&curcpu->c_workq);
+
 	V(cpu_startup_sem);
 	thread_exit();
 }
@@ -433,6 +591,12 @@ thread_start_cpus(void)
 	cpu_identify(buf, sizeof(buf));
 	kprintf("cpu0: %s\n", buf);
 
+	/* Stock the thread pools before anyone else can touch them. */
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		threadpool_fill(cpuarray_get(&allcpus, i));
+	}
+	workqueue_start(&curcpu->c_workq);
+
 	cpu_startup_sem = sem_create("cpu_hatch", 0);
 	mainbus_start_cpus();
 
@@ -490,36 +654,32 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
  *
  * The new thread is created in the process P. If P is null, the
  * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * as the caller, unless the scheduler intervenes first. If PINNED is
+ * set, the scheduler never moves it.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_internal(const char *name,
+		     struct proc *proc,
+		     void (*entrypoint)(void *data1, unsigned long data2),
+		     void *data1, unsigned long data2,
+		     bool pinned)
 {
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	newthread = threadpool_get(name);
 	if (newthread == NULL) {
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
-	}
-	thread_checkstack_init(newthread);
-
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_pinned = pinned;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -548,6 +708,25 @@ thread_fork(const char *name,
 	return 0;
 }
 
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_internal(name, proc, entrypoint, data1, data2,
+				    false);
+}
+
+int
+thread_fork_pinned(const char *name,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1, unsigned long data2)
+{
+	return thread_fork_internal(name, kproc, entrypoint, data1, data2,
+				    true);
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -613,6 +792,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		 * on the list.
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
+		cur->t_wchan = wc;
 		spinlock_release(lk);
 		break;
 	    case S_ZOMBIE:
@@ -623,10 +803,11 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	cur->t_state = newstate;
 
 	/*
-	 * Get the next thread. While there isn't one, call md_idle().
-	 * curcpu->c_isidle must be true when md_idle is
-	 * called. Unlock the runqueue while idling too, to make sure
-	 * things can be added to it.
+	 * Get the next thread. While there isn't one, call
+	 * hardclock_idle(), which idles with the clock stopped.
+	 * curcpu->c_isidle must be true when it is called. Unlock the
+	 * runqueue while idling too, to make sure things can be added
+	 * to it.
 	 *
 	 * Note that we don't need to unlock the runqueue atomically
 	 * with idling; becoming unidle requires receiving an
@@ -645,7 +826,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			hardclock_idle();
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
@@ -896,7 +1077,7 @@ thread_consider_migration(void)
 	unsigned my_count, total_count, one_share, to_send;
 	unsigned i, numcpus;
 	struct cpu *c;
-	struct threadlist victims;
+	struct threadlist victims, pinned;
 	struct thread *t;
 
 	my_count = total_count = 0;
@@ -918,12 +1099,26 @@ thread_consider_migration(void)
 
 	to_send = my_count - one_share;
 	threadlist_init(&victims);
+	threadlist_init(&pinned);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
+	i = 0;
+	while (i < to_send &&
+	       (t = threadlist_remtail(&curcpu->c_runqueue)) != NULL) {
+		if (t->t_pinned) {
+			/* Not ours to move; look further up the queue */
+			threadlist_addhead(&pinned, t);
+			continue;
+		}
 		threadlist_addhead(&victims, t);
+		i++;
+	}
+	to_send = i;
+	/* Pinned threads go back where they were, at the end */
+	while ((t = threadlist_remhead(&pinned)) != NULL) {
+		threadlist_addtail(&curcpu->c_runqueue, t);
 	}
 	spinlock_release(&curcpu->c_runqueue_lock);
+	threadlist_cleanup(&pinned);
 
 	for (i=0; i < numcpus && to_send > 0; i++) {
 		c = cpuarray_get(&allcpus, i);
@@ -963,9 +1158,9 @@ thread_consider_migration(void)
 
 			t->t_cpu = c;
 			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
+			TRACE(DB_THREADS,
+			      "Migrated thread %p: cpu %u -> %u\n",
+			      t, curcpu->c_number, c->c_number);
 			to_send--;
 			if (c->c_isidle) {
 				/*
@@ -1086,6 +1281,89 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	spinlock_acquire(lk);
 }
 
+/*
+ * State shared between wchan_timedsleep and its timeout, which runs
+ * in interrupt context, possibly on another cpu.
+ */
+struct timedsleep {
+	struct thread *ts_thread;	/* the sleeper */
+	struct wchan *ts_wchan;		/* what it's sleeping on */
+	struct spinlock *ts_lock;	/* the wchan's spinlock */
+	bool ts_timedout;		/* set if the timeout woke it */
+	volatile bool ts_done;		/* set when the timeout is finished */
+};
+
+/*
+ * Timeout for wchan_timedsleep. If the thread is still on the
+ * channel, take it off and wake it. The struct is on the sleeper's
+ * stack and may vanish as soon as ts_done is set and the lock is
+ * dropped, so fetch the lock pointer first.
+ */
+static
+void
+wchan_timeout(void *data)
+{
+	struct timedsleep *ts = data;
+	struct spinlock *lk = ts->ts_lock;
+
+	spinlock_acquire(lk);
+	if (ts->ts_thread->t_wchan == ts->ts_wchan) {
+		threadlist_remove(&ts->ts_wchan->wc_threads, ts->ts_thread);
+		ts->ts_thread->t_wchan = NULL;
+		ts->ts_timedout = true;
+		thread_make_runnable(ts->ts_thread, false);
+	}
+	ts->ts_done = true;
+	spinlock_release(lk);
+}
+
+/*
+ * Like wchan_sleep, but give up after TICKS hardclocks. Returns true
+ * if the timeout, rather than a wakeup, ended the sleep. If TICKS is
+ * 0, returns true at once without sleeping.
+ */
+bool
+wchan_timedsleep(struct wchan *wc, struct spinlock *lk, unsigned ticks)
+{
+	struct timedsleep ts;
+	struct timer timer;
+
+	KASSERT(!curthread->t_in_interrupt);
+	KASSERT(spinlock_do_i_hold(lk));
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	if (ticks == 0) {
+		return true;
+	}
+
+	ts.ts_thread = curthread;
+	ts.ts_wchan = wc;
+	ts.ts_lock = lk;
+	ts.ts_timedout = false;
+	ts.ts_done = false;
+	timer_init(&timer, wchan_timeout, &ts);
+	timer_start(&timer, ticks);
+
+	thread_switch(S_SLEEP, wc, lk);
+
+	if (!timer_stop(&timer)) {
+		/*
+		 * The timeout fired, or is firing right now on some
+		 * other cpu. Wait for it to let go of TS.
+		 */
+		spinlock_acquire(lk);
+		while (!ts.ts_done) {
+			spinlock_release(lk);
+			spinlock_acquire(lk);
+		}
+	}
+	else {
+		spinlock_acquire(lk);
+	}
+	timer_cleanup(&timer);
+	return ts.ts_timedout;
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1103,6 +1381,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 		/* Nobody was sleeping. */
 		return;
 	}
+	target->t_wchan = NULL;
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1133,6 +1412,7 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * private list.
 	 */
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 
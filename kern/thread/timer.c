@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Per-cpu hierarchical timer wheel.
+ *
+ * Level 0 has one bucket per tick for the next TIMER_SLOTS ticks.
+ * A timer further out goes on the lowest level whose buckets reach
+ * it, in the bucket for its expiry time at that level's granularity.
+ * Whenever the low bits of the clock roll over to zero, the current
+ * bucket of the next level up is emptied and its timers reinserted,
+ * which drops each of them at least one level closer to level 0.
+ *
+ * Timers more than TIMER_MAXDELTA ticks out are parked in the
+ * farthest level 3 bucket and simply reinserted when it comes
+ * around, until they get close enough.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <timer.h>
+
+#define TIMER_SLOTMASK	(TIMER_SLOTS - 1)
+#define TIMER_MAXDELTA	(1U << (TIMER_SLOTBITS * TIMER_LEVELS))
+#define TIMER_MAXTICKS	0x7fffffffU
+
+void
+timer_init(struct timer *t, void (*func)(void *), void *data)
+{
+	t->tm_next = NULL;
+	t->tm_prevp = NULL;
+	t->tm_cpu = NULL;
+	t->tm_expire = 0;
+	t->tm_func = func;
+	t->tm_data = data;
+}
+
+void
+timer_cleanup(struct timer *t)
+{
+	KASSERT(t->tm_cpu == NULL);
+}
+
+void
+timerwheel_init(struct timerwheel *tw)
+{
+	unsigned level, slot;
+
+	spinlock_init(&tw->tw_lock);
+	tw->tw_now = 0;
+	tw->tw_count = 0;
+	for (level = 0; level < TIMER_LEVELS; level++) {
+		for (slot = 0; slot < TIMER_SLOTS; slot++) {
+			tw->tw_slots[level][slot] = NULL;
+		}
+	}
+}
+
+/*
+ * Put a timer in the right bucket for its expiry time. A timer that
+ * is already due goes in the bucket for the next tick.
+ */
+static
+void
+timerwheel_insert(struct timerwheel *tw, struct timer *t)
+{
+	unsigned expire, delta, level;
+	struct timer **head;
+
+	KASSERT(spinlock_do_i_hold(&tw->tw_lock));
+
+	expire = t->tm_expire;
+	delta = expire - tw->tw_now;
+	if ((int)delta < 0) {
+		expire = tw->tw_now;
+		delta = 0;
+	}
+	else if (delta >= TIMER_MAXDELTA) {
+		expire = tw->tw_now + TIMER_MAXDELTA - 1;
+		delta = TIMER_MAXDELTA - 1;
+	}
+
+	for (level = 0; level < TIMER_LEVELS - 1; level++) {
+		if (delta < (1U << (TIMER_SLOTBITS * (level + 1)))) {
+			break;
+		}
+	}
+	head = &tw->tw_slots[level]
+		[(expire >> (TIMER_SLOTBITS * level)) & TIMER_SLOTMASK];
+
+	t->tm_next = *head;
+	if (t->tm_next != NULL) {
+		t->tm_next->tm_prevp = &t->tm_next;
+	}
+	t->tm_prevp = head;
+	*head = t;
+}
+
+/*
+ * Empty one bucket of a higher level into the levels below it.
+ */
+static
+void
+timerwheel_cascade(struct timerwheel *tw, unsigned level, unsigned slot)
+{
+	struct timer *list, *t;
+
+	list = tw->tw_slots[level][slot];
+	tw->tw_slots[level][slot] = NULL;
+	while ((t = list) != NULL) {
+		list = t->tm_next;
+		timerwheel_insert(tw, t);
+	}
+}
+
+void
+timer_start(struct timer *t, unsigned ticks)
+{
+	struct cpu *c;
+	struct timerwheel *tw;
+	int s;
+
+	KASSERT(t->tm_cpu == NULL);
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+	else if (ticks > TIMER_MAXTICKS) {
+		ticks = TIMER_MAXTICKS;
+	}
+
+	s = splhigh();
+	c = curcpu->c_self;
+	tw = &c->c_timers;
+
+	spinlock_acquire(&tw->tw_lock);
+	t->tm_expire = tw->tw_now + ticks - 1;
+	t->tm_cpu = c;
+	timerwheel_insert(tw, t);
+	tw->tw_count++;
+	spinlock_release(&tw->tw_lock);
+
+	/*
+	 * If the wheel's cpu has its clock stopped for a tickless idle,
+	 * it may be set to sleep past this timer. Poke it so that
+	 * hardclock_idle restarts the clock and looks again.
+	 */
+	if (c->c_idleticks > 0) {
+		ipi_send(c, IPI_UNIDLE);
+	}
+	splx(s);
+}
+
+bool
+timer_stop(struct timer *t)
+{
+	struct cpu *c;
+	struct timerwheel *tw;
+
+	/*
+	 * tm_cpu can only change under the lock of the wheel it names,
+	 * so lock that wheel and then make sure it's still the one.
+	 */
+	while (1) {
+		c = t->tm_cpu;
+		if (c == NULL) {
+			return false;
+		}
+		tw = &c->c_timers;
+		spinlock_acquire(&tw->tw_lock);
+		if (t->tm_cpu == c) {
+			break;
+		}
+		spinlock_release(&tw->tw_lock);
+	}
+
+	*t->tm_prevp = t->tm_next;
+	if (t->tm_next != NULL) {
+		t->tm_next->tm_prevp = t->tm_prevp;
+	}
+	t->tm_next = NULL;
+	t->tm_prevp = NULL;
+	t->tm_cpu = NULL;
+	KASSERT(tw->tw_count > 0);
+	tw->tw_count--;
+	spinlock_release(&tw->tw_lock);
+	return true;
+}
+
+/*
+ * Advance a wheel by one tick, running whatever expires. Called and
+ * returns with the wheel locked, but drops the lock around each
+ * timer function.
+ */
+static
+void
+timerwheel_tick(struct timerwheel *tw)
+{
+	struct timer *expired, *t;
+	unsigned slot, level, idx;
+
+	slot = tw->tw_now & TIMER_SLOTMASK;
+	if (slot == 0) {
+		for (level = 1; level < TIMER_LEVELS; level++) {
+			idx = (tw->tw_now >> (TIMER_SLOTBITS * level))
+				& TIMER_SLOTMASK;
+			timerwheel_cascade(tw, level, idx);
+			if (idx != 0) {
+				break;
+			}
+		}
+	}
+	tw->tw_now++;
+
+	/*
+	 * Move the due bucket to a private list. The timers stay
+	 * linked through tm_prevp, so timer_stop can still cancel one
+	 * while the lock is dropped to run another.
+	 */
+	expired = tw->tw_slots[0][slot];
+	tw->tw_slots[0][slot] = NULL;
+	if (expired != NULL) {
+		expired->tm_prevp = &expired;
+	}
+
+	while ((t = expired) != NULL) {
+		expired = t->tm_next;
+		if (expired != NULL) {
+			expired->tm_prevp = &expired;
+		}
+		t->tm_next = NULL;
+		t->tm_prevp = NULL;
+		t->tm_cpu = NULL;
+		tw->tw_count--;
+
+		spinlock_release(&tw->tw_lock);
+		t->tm_func(t->tm_data);
+		spinlock_acquire(&tw->tw_lock);
+	}
+}
+
+void
+timer_hardclock(void)
+{
+	timer_skip(1);
+}
+
+void
+timer_skip(unsigned ticks)
+{
+	struct timerwheel *tw;
+
+	tw = &curcpu->c_timers;
+
+	spinlock_acquire(&tw->tw_lock);
+	while (ticks > 0) {
+		if (tw->tw_count == 0) {
+			/* Nothing to cascade or run; just keep time. */
+			tw->tw_now += ticks;
+			break;
+		}
+		timerwheel_tick(tw);
+		ticks--;
+	}
+	spinlock_release(&tw->tw_lock);
+}
+
+unsigned
+timer_idleticks(void)
+{
+	struct timerwheel *tw;
+	unsigned ticks, slot;
+
+	tw = &curcpu->c_timers;
+
+	spinlock_acquire(&tw->tw_lock);
+	if (tw->tw_count == 0) {
+		spinlock_release(&tw->tw_lock);
+		return 0;
+	}
+
+	/*
+	 * Look for the first full level 0 bucket. Stop at the next
+	 * cascade, since it may bring later timers down into level 0;
+	 * we need to be awake for it.
+	 */
+	for (ticks = 1; ; ticks++) {
+		slot = (tw->tw_now + ticks - 1) & TIMER_SLOTMASK;
+		if (slot == 0 || tw->tw_slots[0][slot] != NULL) {
+			break;
+		}
+	}
+	spinlock_release(&tw->tw_lock);
+	return ticks;
+}
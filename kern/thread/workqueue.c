@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Per-cpu work queues and their worker threads.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <wchan.h>
+#include <workqueue.h>
+
+void
+work_init(struct work *w, void (*func)(void *), void *data)
+{
+	w->wk_next = NULL;
+	w->wk_prevp = NULL;
+	w->wk_queue = NULL;
+	spinlock_data_set(&w->wk_pending, 0);
+	timer_init(&w->wk_timer, NULL, NULL);
+	w->wk_func = func;
+	w->wk_data = data;
+}
+
+void
+work_cleanup(struct work *w)
+{
+	KASSERT(spinlock_data_get(&w->wk_pending) == 0);
+	KASSERT(w->wk_prevp == NULL);
+	timer_cleanup(&w->wk_timer);
+}
+
+void
+workqueue_init(struct workqueue *wq)
+{
+	unsigned i;
+
+	spinlock_init(&wq->wq_lock);
+	wq->wq_head = NULL;
+	wq->wq_tailp = &wq->wq_head;
+	for (i=0; i<WORKQUEUE_WORKERS; i++) {
+		wq->wq_running[i] = NULL;
+	}
+	wq->wq_wchan = NULL;
+	wq->wq_donewchan = NULL;
+}
+
+/*
+ * Put pending work on the end of its queue (wk_queue) and wake a
+ * worker, if there are any yet.
+ */
+static
+void
+workqueue_add(struct work *w)
+{
+	struct workqueue *wq;
+
+	wq = w->wk_queue;
+	spinlock_acquire(&wq->wq_lock);
+	KASSERT(w->wk_prevp == NULL);
+	w->wk_next = NULL;
+	w->wk_prevp = wq->wq_tailp;
+	*wq->wq_tailp = w;
+	wq->wq_tailp = &w->wk_next;
+	if (wq->wq_wchan != NULL) {
+		wchan_wakeone(wq->wq_wchan, &wq->wq_lock);
+	}
+	spinlock_release(&wq->wq_lock);
+}
+
+/*
+ * Take work off its queue. Queue must be locked.
+ */
+static
+void
+workqueue_remove(struct workqueue *wq, struct work *w)
+{
+	KASSERT(spinlock_do_i_hold(&wq->wq_lock));
+
+	*w->wk_prevp = w->wk_next;
+	if (w->wk_next != NULL) {
+		w->wk_next->wk_prevp = w->wk_prevp;
+	}
+	else {
+		wq->wq_tailp = w->wk_prevp;
+	}
+	w->wk_next = NULL;
+	w->wk_prevp = NULL;
+}
+
+bool
+work_submit(struct work *w)
+{
+	if (spinlock_data_testandset(&w->wk_pending) != 0) {
+		return false;
+	}
+	w->wk_queue = &curcpu->c_workq;
+	workqueue_add(w);
+	return true;
+}
+
+/*
+ * Timer callback for work_submit_delayed.
+ */
+static
+void
+work_timeout(void *data)
+{
+	workqueue_add(data);
+}
+
+bool
+work_submit_delayed(struct work *w, unsigned ticks)
+{
+	if (spinlock_data_testandset(&w->wk_pending) != 0) {
+		return false;
+	}
+
+	/*
+	 * Pick the queue now rather than when the timer goes off, so
+	 * work_cancel and work_wait know where to look. The timer is
+	 * on this cpu too, so it's normally the same queue anyway.
+	 */
+	w->wk_queue = &curcpu->c_workq;
+	w->wk_timer.tm_func = work_timeout;
+	w->wk_timer.tm_data = w;
+	timer_start(&w->wk_timer, ticks);
+	return true;
+}
+
+bool
+work_cancel(struct work *w)
+{
+	struct workqueue *wq;
+
+	if (timer_stop(&w->wk_timer)) {
+		spinlock_data_set(&w->wk_pending, 0);
+		return true;
+	}
+
+	/*
+	 * wk_queue only changes when the work is resubmitted, which
+	 * can't happen while it's still on a queue; so if it changes
+	 * under us, the work we were after already ran.
+	 */
+	wq = w->wk_queue;
+	if (wq == NULL) {
+		return false;
+	}
+	spinlock_acquire(&wq->wq_lock);
+	if (w->wk_queue != wq || w->wk_prevp == NULL) {
+		spinlock_release(&wq->wq_lock);
+		return false;
+	}
+	workqueue_remove(wq, w);
+	spinlock_data_set(&w->wk_pending, 0);
+	spinlock_release(&wq->wq_lock);
+	return true;
+}
+
+/*
+ * Check if work is running on a queue. Queue must be locked.
+ */
+static
+bool
+workqueue_isrunning(struct workqueue *wq, struct work *w)
+{
+	unsigned i;
+
+	for (i=0; i<WORKQUEUE_WORKERS; i++) {
+		if (wq->wq_running[i] == w) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+work_wait(struct work *w)
+{
+	struct workqueue *wq;
+
+	KASSERT(!curthread->t_in_interrupt);
+
+	/*
+	 * Work only runs on the queue it was last submitted to, and
+	 * the workers clear wk_pending with that queue locked, so it's
+	 * enough to watch that one queue. If the work is resubmitted
+	 * elsewhere while we sleep, we follow it.
+	 */
+	while (1) {
+		wq = w->wk_queue;
+		if (wq == NULL) {
+			return;
+		}
+		spinlock_acquire(&wq->wq_lock);
+		if (w->wk_queue != wq) {
+			spinlock_release(&wq->wq_lock);
+			continue;
+		}
+		if (spinlock_data_get(&w->wk_pending) == 0 &&
+		    !workqueue_isrunning(wq, w)) {
+			spinlock_release(&wq->wq_lock);
+			return;
+		}
+		KASSERT(wq->wq_donewchan != NULL);
+		wchan_sleep(wq->wq_donewchan, &wq->wq_lock);
+		spinlock_release(&wq->wq_lock);
+	}
+}
+
+/*
+ * Worker thread. Runs work off the front of the queue; once a work
+ * function has been called, the work item is its caller's again and
+ * we never look at it, because the function may well have freed it.
+ * (wq_running is only compared against, never dereferenced.)
+ */
+static
+void
+workqueue_worker(void *data1, unsigned long slot)
+{
+	struct workqueue *wq = data1;
+	struct work *w;
+	void (*func)(void *);
+	void *data;
+
+	spinlock_acquire(&wq->wq_lock);
+	while (1) {
+		/*
+		 * Skip work another worker is still running; when that
+		 * worker finishes it comes back here and picks it up.
+		 */
+		for (w = wq->wq_head; w != NULL; w = w->wk_next) {
+			if (!workqueue_isrunning(wq, w)) {
+				break;
+			}
+		}
+		if (w == NULL) {
+			wchan_sleep(wq->wq_wchan, &wq->wq_lock);
+			continue;
+		}
+		workqueue_remove(wq, w);
+		wq->wq_running[slot] = w;
+		func = w->wk_func;
+		data = w->wk_data;
+		spinlock_data_set(&w->wk_pending, 0);
+		spinlock_release(&wq->wq_lock);
+
+		func(data);
+
+		spinlock_acquire(&wq->wq_lock);
+		wq->wq_running[slot] = NULL;
+		wchan_wakeall(wq->wq_donewchan, &wq->wq_lock);
+	}
+}
+
+void
+workqueue_start(struct workqueue *wq)
+{
+	struct wchan *wc, *donewc;
+	char name[32];
+	unsigned i;
+	int result;
+
+	wc = wchan_create("workq");
+	donewc = wchan_create("workdone");
+	if (wc == NULL || donewc == NULL) {
+		panic("workqueue_start: Out of memory\n");
+	}
+
+	spinlock_acquire(&wq->wq_lock);
+	wq->wq_wchan = wc;
+	wq->wq_donewchan = donewc;
+	spinlock_release(&wq->wq_lock);
+
+	/*
+	 * Workers start on the current cpu, which should be wq's, and
+	 * are pinned there so work always runs where it was submitted.
+	 */
+	for (i=0; i<WORKQUEUE_WORKERS; i++) {
+		snprintf(name, sizeof(name), "worker %u.%u",
+			 curcpu->c_number, i);
+		result = thread_fork_pinned(name, workqueue_worker, wq, i);
+		if (result) {
+			panic("workqueue_start: thread_fork_pinned: %s\n",
+			      strerror(result));
+		}
+	}
+}
@@ -33,6 +33,7 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <vfs.h>
@@ -88,10 +89,24 @@ nullioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/* For poll() */
+static
+int
+nullpoll(struct device *dev, struct pollwait *pw, int *revents)
+{
+	/* Never blocks in either direction. */
+	(void)dev;
+	(void)pw;
+
+	*revents = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+	return 0;
+}
+
 static const struct device_ops null_devops = {
 	.devop_eachopen = nullopen,
 	.devop_io = nullio,
 	.devop_ioctl = nullioctl,
+	.devop_poll = nullpoll,
 };
 
 /*
@@ -0,0 +1,561 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Anonymous pipes. See pipe.h.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <synch.h>
+#include <vm.h>
+#include <poll.h>
+#include <vnode.h>
+#include <pipe.h>
+
+/* Size of the ring buffer */
+#define PIPE_SIZE	PAGE_SIZE
+
+/*
+ * The pipe object.
+ *
+ * The buffer state and the open/closed flags are protected by the
+ * spinlock p_lock, and readers and writers wait for data or space on
+ * the wait channels. Readers are serialized with p_readlock and
+ * writers with p_writelock; with at most one of each active, the
+ * reader owns the bytes between p_head and p_head+p_count and the
+ * writer owns the free space, so the data can be copied without
+ * holding p_lock (which we can't hold across uiomove anyway, as it
+ * may fault).
+ *
+ * Pollers on the read end wait on p_readpoll and pollers on the write
+ * end on p_writepoll; these are woken along with the wait channels.
+ */
+struct pipe {
+	struct spinlock p_lock;		/* lock for following */
+	struct wchan *p_readwchan;	/* readers waiting for data */
+	struct wchan *p_writewchan;	/* writers waiting for space */
+	struct pollhead p_readpoll;	/* pollers waiting for data */
+	struct pollhead p_writepoll;	/* pollers waiting for space */
+	unsigned p_head;		/* position of first byte of data */
+	unsigned p_count;		/* number of bytes of data */
+	bool p_readopen;		/* read end still exists */
+	bool p_writeopen;		/* write end still exists */
+
+	struct lock *p_readlock;	/* serializes readers */
+	struct lock *p_writelock;	/* serializes writers */
+	char *p_buf;			/* the ring buffer */
+
+	struct vnode p_readvn;		/* read end */
+	struct vnode p_writevn;		/* write end */
+};
+
+////////////////////////////////////////////////////////////
+// data transfer
+
+/*
+ * Read. Wait until there's some data or the write end has been
+ * closed, then take as much as is available (up to the size of the
+ * request) without waiting for more. If the write end is closed and
+ * the buffer is empty, this is EOF and we return with nothing read.
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	unsigned head, count, len, total;
+	size_t oldresid;
+	int result;
+
+	lock_acquire(p->p_readlock);
+
+	spinlock_acquire(&p->p_lock);
+	while (p->p_count == 0 && p->p_writeopen) {
+		wchan_sleep(p->p_readwchan, &p->p_lock);
+	}
+	head = p->p_head;
+	count = p->p_count;
+	spinlock_release(&p->p_lock);
+
+	/* copy out; at most two pieces, if the data wraps around */
+	result = 0;
+	total = 0;
+	while (count > 0 && uio->uio_resid > 0) {
+		len = PIPE_SIZE - head;
+		if (len > count) {
+			len = count;
+		}
+		oldresid = uio->uio_resid;
+		result = uiomove(p->p_buf + head, len, uio);
+		len = oldresid - uio->uio_resid;
+		head = (head + len) % PIPE_SIZE;
+		count -= len;
+		total += len;
+		if (result) {
+			break;
+		}
+	}
+
+	/* give back the space and wake any writers waiting for it */
+	if (total > 0) {
+		spinlock_acquire(&p->p_lock);
+		p->p_head = head;
+		p->p_count -= total;
+		wchan_wakeall(p->p_writewchan, &p->p_lock);
+		pollhead_wakeup(&p->p_writepoll);
+		spinlock_release(&p->p_lock);
+	}
+
+	lock_release(p->p_readlock);
+	return result;
+}
+
+/*
+ * Write. Writes of PIPE_BUF bytes or less wait until there's room for
+ * the whole thing so readers see them all at once; larger writes go
+ * in whatever space becomes available. (Writes can't interleave with
+ * each other either way, because writers are serialized.)
+ *
+ * If the read end is closed, fail with EPIPE, unless some data was
+ * already written, in which case return a short count.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *p = vn->vn_data;
+	unsigned tail, space, need, len, total;
+	size_t startresid, oldresid;
+	int result;
+
+	lock_acquire(p->p_writelock);
+
+	startresid = uio->uio_resid;
+	result = 0;
+	while (uio->uio_resid > 0) {
+		need = uio->uio_resid <= PIPE_BUF ? uio->uio_resid : 1;
+
+		spinlock_acquire(&p->p_lock);
+		while (p->p_readopen && PIPE_SIZE - p->p_count < need) {
+			wchan_sleep(p->p_writewchan, &p->p_lock);
+		}
+		if (!p->p_readopen) {
+			spinlock_release(&p->p_lock);
+			if (uio->uio_resid == startresid) {
+				result = EPIPE;
+			}
+			break;
+		}
+		tail = (p->p_head + p->p_count) % PIPE_SIZE;
+		space = PIPE_SIZE - p->p_count;
+		spinlock_release(&p->p_lock);
+
+		/* copy in; at most two pieces, if the space wraps around */
+		total = 0;
+		while (space > 0 && uio->uio_resid > 0) {
+			len = PIPE_SIZE - tail;
+			if (len > space) {
+				len = space;
+			}
+			oldresid = uio->uio_resid;
+			result = uiomove(p->p_buf + tail, len, uio);
+			len = oldresid - uio->uio_resid;
+			tail = (tail + len) % PIPE_SIZE;
+			space -= len;
+			total += len;
+			if (result) {
+				break;
+			}
+		}
+
+		/* publish the data and wake any readers waiting for it */
+		if (total > 0) {
+			spinlock_acquire(&p->p_lock);
+			p->p_count += total;
+			wchan_wakeall(p->p_readwchan, &p->p_lock);
+			pollhead_wakeup(&p->p_readpoll);
+			spinlock_release(&p->p_lock);
+		}
+
+		if (result) {
+			break;
+		}
+	}
+
+	lock_release(p->p_writelock);
+	return result;
+}
+
+/*
+ * I/O in the wrong direction. The open file's access mode should
+ * already have rejected this.
+ */
+static
+int
+pipe_badio(struct vnode *vn, struct uio *uio)
+{
+	(void)vn;
+	(void)uio;
+	return EBADF;
+}
+
+////////////////////////////////////////////////////////////
+// poll
+
+/*
+ * The read end is readable when there's data, or when the write end
+ * is closed (as read then returns EOF at once); the latter is also a
+ * hangup.
+ */
+static
+int
+pipe_readpoll(struct vnode *vn, struct pollwait *pw, int *revents)
+{
+	struct pipe *p = vn->vn_data;
+
+	pollhead_register(&p->p_readpoll, pw);
+
+	*revents = 0;
+	spinlock_acquire(&p->p_lock);
+	if (p->p_count > 0 || !p->p_writeopen) {
+		*revents |= POLLIN | POLLRDNORM;
+	}
+	if (!p->p_writeopen) {
+		*revents |= POLLHUP;
+	}
+	spinlock_release(&p->p_lock);
+
+	return 0;
+}
+
+/*
+ * The write end is writable when a write of PIPE_BUF bytes would go
+ * through without waiting. If the read end is closed, that's an
+ * error, and also writable, as write then fails at once with EPIPE.
+ */
+static
+int
+pipe_writepoll(struct vnode *vn, struct pollwait *pw, int *revents)
+{
+	struct pipe *p = vn->vn_data;
+
+	pollhead_register(&p->p_writepoll, pw);
+
+	*revents = 0;
+	spinlock_acquire(&p->p_lock);
+	if (PIPE_SIZE - p->p_count >= PIPE_BUF || !p->p_readopen) {
+		*revents |= POLLOUT | POLLWRNORM;
+	}
+	if (!p->p_readopen) {
+		*revents |= POLLERR;
+	}
+	spinlock_release(&p->p_lock);
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// other ops
+
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	/* pipes don't have names, so nobody should be opening them */
+	(void)vn;
+	(void)openflags;
+	return EINVAL;
+}
+
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+pipe_stat(struct vnode *vn, struct stat *buf)
+{
+	struct pipe *p = vn->vn_data;
+
+	bzero(buf, sizeof(*buf));
+
+	spinlock_acquire(&p->p_lock);
+	buf->st_size = p->p_count;
+	spinlock_release(&p->p_lock);
+
+	buf->st_mode = S_IFIFO | 0600;
+	buf->st_nlink = 0;
+	buf->st_blocks = 0;
+	buf->st_dev = 0;
+	buf->st_ino = 0;
+
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return 0;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+////////////////////////////////////////////////////////////
+// lifecycle
+
+/*
+ * Destructor for struct pipe. Both vnodes must already be gone.
+ */
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	KASSERT(!p->p_readopen);
+	KASSERT(!p->p_writeopen);
+
+	kfree(p->p_buf);
+	pollhead_cleanup(&p->p_writepoll);
+	pollhead_cleanup(&p->p_readpoll);
+	lock_destroy(p->p_writelock);
+	lock_destroy(p->p_readlock);
+	wchan_destroy(p->p_writewchan);
+	wchan_destroy(p->p_readwchan);
+	spinlock_cleanup(&p->p_lock);
+	kfree(p);
+}
+
+/*
+ * Reclaim - called when the last reference to one end goes away.
+ * Mark that end closed and wake up anyone on the other end so they
+ * can notice. Whichever end goes second destroys the pipe.
+ *
+ * Since pipe vnodes can't be looked up, nobody can get a new
+ * reference while we're doing this, so unlike e.g. semfs we don't
+ * need to recheck the reference count.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *p = vn->vn_data;
+	bool destroy;
+
+	vnode_cleanup(vn);
+
+	spinlock_acquire(&p->p_lock);
+	if (vn == &p->p_readvn) {
+		p->p_readopen = false;
+		wchan_wakeall(p->p_writewchan, &p->p_lock);
+		pollhead_wakeup(&p->p_writepoll);
+	}
+	else {
+		KASSERT(vn == &p->p_writevn);
+		p->p_writeopen = false;
+		wchan_wakeall(p->p_readwchan, &p->p_lock);
+		pollhead_wakeup(&p->p_readpoll);
+	}
+	destroy = !p->p_readopen && !p->p_writeopen;
+	spinlock_release(&p->p_lock);
+
+	if (destroy) {
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+/*
+ * Vnode ops tables. The two ends differ only in which direction of
+ * I/O they allow.
+ */
+static const struct vnode_ops pipe_readops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_badio,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_poll = pipe_readpoll,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+static const struct vnode_ops pipe_writeops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_badio,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_poll = pipe_writepoll,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+/*
+ * Constructor. Each vnode starts with one reference, which is handed
+ * to the caller.
+ */
+int
+pipe_create(struct vnode **readvn_ret, struct vnode **writevn_ret)
+{
+	struct pipe *p;
+	int result;
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+
+	p->p_readwchan = wchan_create("pipe-read");
+	if (p->p_readwchan == NULL) {
+		goto fail_free;
+	}
+	p->p_writewchan = wchan_create("pipe-write");
+	if (p->p_writewchan == NULL) {
+		goto fail_readwchan;
+	}
+	p->p_readlock = lock_create("pipe-read");
+	if (p->p_readlock == NULL) {
+		goto fail_writewchan;
+	}
+	p->p_writelock = lock_create("pipe-write");
+	if (p->p_writelock == NULL) {
+		goto fail_readlock;
+	}
+	p->p_buf = kmalloc(PIPE_SIZE);
+	if (p->p_buf == NULL) {
+		goto fail_writelock;
+	}
+
+	spinlock_init(&p->p_lock);
+	pollhead_init(&p->p_readpoll);
+	pollhead_init(&p->p_writepoll);
+	p->p_head = 0;
+	p->p_count = 0;
+	p->p_readopen = true;
+	p->p_writeopen = true;
+
+	result = vnode_init(&p->p_readvn, &pipe_readops, NULL, p);
+	/* vnode_init doesn't actually fail */
+	KASSERT(result == 0);
+	result = vnode_init(&p->p_writevn, &pipe_writeops, NULL, p);
+	KASSERT(result == 0);
+
+	*readvn_ret = &p->p_readvn;
+	*writevn_ret = &p->p_writevn;
+	return 0;
+
+ fail_writelock:
+	lock_destroy(p->p_writelock);
+ fail_readlock:
+	lock_destroy(p->p_readlock);
+ fail_writewchan:
+	wchan_destroy(p->p_writewchan);
+ fail_readwchan:
+	wchan_destroy(p->p_readwchan);
+ fail_free:
+	kfree(p);
+	return ENOMEM;
+}
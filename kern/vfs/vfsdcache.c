@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Name lookup cache.
+ *
+ * Maps (directory vnode, name) to the vnode that name refers to, or
+ * to nothing for names known not to exist. Each entry holds a
+ * reference to the directory and, if positive, to the vnode it names;
+ * this keeps the vnodes from being recycled out from under the cache.
+ * The code in vfspath.c purges entries whenever it changes a
+ * directory, so the filesystems themselves don't need to know about
+ * the cache. (This assumes nothing else changes the namespace; for
+ * emufs that means nothing on the host side while we're running.)
+ *
+ * There is a fixed number of entries, recycled in LRU order. Names
+ * too long for an entry are simply not cached.
+ *
+ * Everything here is protected by the VFS big lock.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <vfs.h>
+#include <vnode.h>
+
+#define DCACHE_SIZE	128	/* number of entries */
+#define DCACHE_BUCKETS	64	/* number of hash chains */
+#define DCACHE_NAMELEN	32	/* longest name cached, plus one */
+
+struct dcentry {
+	struct dcentry *dc_hashnext;	/* hash chain */
+	struct dcentry *dc_prev;	/* LRU list */
+	struct dcentry *dc_next;	/* LRU list */
+	struct vnode *dc_dir;		/* directory, or NULL if unused */
+	struct vnode *dc_vn;		/* vnode, or NULL if negative */
+	char dc_name[DCACHE_NAMELEN];
+};
+
+static struct dcentry dcache_entries[DCACHE_SIZE];
+static struct dcentry *dcache_buckets[DCACHE_BUCKETS];
+
+/* LRU list head; most recently used first, unused entries last */
+static struct dcentry dcache_lru;
+
+/*
+ * Setup function
+ */
+void
+vfs_dcache_bootstrap(void)
+{
+	unsigned i;
+
+	dcache_lru.dc_next = dcache_lru.dc_prev = &dcache_lru;
+	for (i=0; i<DCACHE_SIZE; i++) {
+		dcache_entries[i].dc_dir = NULL;
+		dcache_entries[i].dc_prev = dcache_lru.dc_prev;
+		dcache_entries[i].dc_next = &dcache_lru;
+		dcache_lru.dc_prev->dc_next = &dcache_entries[i];
+		dcache_lru.dc_prev = &dcache_entries[i];
+	}
+	for (i=0; i<DCACHE_BUCKETS; i++) {
+		dcache_buckets[i] = NULL;
+	}
+}
+
+/*
+ * Hash function.
+ */
+static
+unsigned
+dcache_hash(struct vnode *dir, const char *name)
+{
+	uint32_t h = 2166136261U;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+	h ^= (uint32_t)(uintptr_t)dir >> 4;
+	return h % DCACHE_BUCKETS;
+}
+
+/*
+ * Move an entry to the front or back of the LRU list.
+ */
+static
+void
+dcache_move(struct dcentry *dc, bool front)
+{
+	dc->dc_prev->dc_next = dc->dc_next;
+	dc->dc_next->dc_prev = dc->dc_prev;
+	if (front) {
+		dc->dc_prev = &dcache_lru;
+		dc->dc_next = dcache_lru.dc_next;
+	}
+	else {
+		dc->dc_prev = dcache_lru.dc_prev;
+		dc->dc_next = &dcache_lru;
+	}
+	dc->dc_prev->dc_next = dc;
+	dc->dc_next->dc_prev = dc;
+}
+
+/*
+ * Find the entry for NAME in DIR, if any.
+ */
+static
+struct dcentry *
+dcache_find(struct vnode *dir, const char *name)
+{
+	struct dcentry *dc;
+
+	dc = dcache_buckets[dcache_hash(dir, name)];
+	while (dc != NULL) {
+		if (dc->dc_dir == dir && !strcmp(dc->dc_name, name)) {
+			return dc;
+		}
+		dc = dc->dc_hashnext;
+	}
+	return NULL;
+}
+
+/*
+ * Take an entry out of use, dropping its references.
+ */
+static
+void
+dcache_drop(struct dcentry *dc)
+{
+	struct dcentry **dcp;
+	struct vnode *dir, *vn;
+
+	KASSERT(dc->dc_dir != NULL);
+
+	dcp = &dcache_buckets[dcache_hash(dc->dc_dir, dc->dc_name)];
+	while (*dcp != dc) {
+		KASSERT(*dcp != NULL);
+		dcp = &(*dcp)->dc_hashnext;
+	}
+	*dcp = dc->dc_hashnext;
+
+	dir = dc->dc_dir;
+	vn = dc->dc_vn;
+	dc->dc_dir = NULL;
+	dc->dc_vn = NULL;
+	dcache_move(dc, false);
+
+	/* Do this last; it might reclaim the vnodes */
+	if (vn != NULL) {
+		VOP_DECREF(vn);
+	}
+	VOP_DECREF(dir);
+}
+
+/*
+ * Look up NAME in DIR. If the cache knows the answer, return true
+ * and hand back either a referenced vnode or NULL if the name is
+ * known not to exist.
+ */
+bool
+vfs_dcache_get(struct vnode *dir, const char *name, struct vnode **ret)
+{
+	struct dcentry *dc;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	dc = dcache_find(dir, name);
+	if (dc == NULL) {
+		return false;
+	}
+	dcache_move(dc, true);
+	if (dc->dc_vn != NULL) {
+		VOP_INCREF(dc->dc_vn);
+	}
+	*ret = dc->dc_vn;
+	return true;
+}
+
+/*
+ * Remember the result of looking up NAME in DIR: VN, or NULL if the
+ * name doesn't exist.
+ */
+void
+vfs_dcache_enter(struct vnode *dir, const char *name, struct vnode *vn)
+{
+	struct dcentry *dc;
+	unsigned ix;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (strlen(name) >= DCACHE_NAMELEN) {
+		return;
+	}
+
+	dc = dcache_find(dir, name);
+	if (dc != NULL) {
+		/* Replace the old entry */
+		dcache_drop(dc);
+	}
+
+	/* Recycle the least recently used entry */
+	dc = dcache_lru.dc_prev;
+	if (dc->dc_dir != NULL) {
+		dcache_drop(dc);
+		KASSERT(dc->dc_dir == NULL);
+	}
+
+	VOP_INCREF(dir);
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+	dc->dc_dir = dir;
+	dc->dc_vn = vn;
+	strcpy(dc->dc_name, name);
+
+	ix = dcache_hash(dir, name);
+	dc->dc_hashnext = dcache_buckets[ix];
+	dcache_buckets[ix] = dc;
+	dcache_move(dc, true);
+}
+
+/*
+ * Forget NAME in DIR because the directory has changed. If it named
+ * a directory (or might have), also forget everything cached under
+ * that, which keeps removed directories from lingering.
+ */
+void
+vfs_dcache_purge(struct vnode *dir, const char *name)
+{
+	struct dcentry *dc;
+	struct vnode *vn;
+	unsigned i;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	dc = dcache_find(dir, name);
+	if (dc == NULL) {
+		return;
+	}
+	vn = dc->dc_vn;
+	if (vn != NULL) {
+		/* Hold it so it can't be recycled while we look */
+		VOP_INCREF(vn);
+	}
+	dcache_drop(dc);
+
+	if (vn != NULL) {
+		for (i=0; i<DCACHE_SIZE; i++) {
+			if (dcache_entries[i].dc_dir == vn) {
+				dcache_drop(&dcache_entries[i]);
+			}
+		}
+		VOP_DECREF(vn);
+	}
+}
+
+/*
+ * Forget everything on filesystem FS, so it can be unmounted.
+ */
+void
+vfs_dcache_purgefs(struct fs *fs)
+{
+	unsigned i;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	for (i=0; i<DCACHE_SIZE; i++) {
+		if (dcache_entries[i].dc_dir != NULL &&
+		    dcache_entries[i].dc_dir->vn_fs == fs) {
+			dcache_drop(&dcache_entries[i]);
+		}
+	}
+}
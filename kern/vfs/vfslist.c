@@ -109,6 +109,8 @@ vfs_bootstrap(void)
 	}
 	vfs_biglock_depth = 0;
 
+	vfs_dcache_bootstrap();
+
 	devnull_create();
 	semfs_bootstrap();
 }
@@ -572,6 +574,9 @@ vfs_unmount(const char *devname)
 	KASSERT(kd->kd_rawname != NULL);
 	KASSERT(kd->kd_device != NULL);
 
+	/* drop cached names, which hold vnodes */
+	vfs_dcache_purgefs(kd->kd_fs);
+
 	/* sync the fs */
 	result = FSOP_SYNC(kd->kd_fs);
 	if (result) {
@@ -621,6 +626,8 @@ vfs_unmountall(void)
 
 		kprintf("vfs: Unmounting %s:\n", dev->kd_name);
 
+		vfs_dcache_purgefs(dev->kd_fs);
+
 		result = FSOP_SYNC(dev->kd_fs);
 		if (result) {
 			kprintf("vfs: Warning: sync failed for %s: %s, trying "
@@ -223,16 +223,106 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	return 0;
 }
 
+/*
+ * Look up a single path component NAME in DIR, going through the
+ * name cache. "." and ".." are passed straight to the filesystem:
+ * ".." changes when a directory is renamed, and "." isn't worth it.
+ */
+static
+int
+lookup_component(struct vnode *dir, char *name, struct vnode **ret)
+{
+	bool cacheable;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (strlen(name) > NAME_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	cacheable = strcmp(name, ".") != 0 && strcmp(name, "..") != 0;
+	if (cacheable && vfs_dcache_get(dir, name, ret)) {
+		return *ret == NULL ? ENOENT : 0;
+	}
+
+	result = VOP_LOOKUP(dir, name, ret);
+	if (cacheable) {
+		if (result == 0) {
+			vfs_dcache_enter(dir, name, *ret);
+		}
+		else if (result == ENOENT) {
+			vfs_dcache_enter(dir, name, NULL);
+		}
+	}
+	return result;
+}
+
+/*
+ * Walk PATH one component at a time starting from STARTVN, which
+ * must be on a filesystem (not a device). Hands back a reference to
+ * the result. Destroys PATH.
+ */
+static
+int
+lookup_path(struct vnode *startvn, char *path, struct vnode **ret)
+{
+	struct vnode *dir, *next;
+	char *name, *s;
+	int result;
+
+	KASSERT(startvn->vn_fs != NULL);
+
+	VOP_INCREF(startvn);
+	dir = startvn;
+
+	name = path;
+	while (1) {
+		while (*name == '/') {
+			name++;
+		}
+		if (*name == 0) {
+			break;
+		}
+
+		s = strchr(name, '/');
+		if (s != NULL) {
+			*s = 0;
+		}
+
+		result = lookup_component(dir, name, &next);
+		VOP_DECREF(dir);
+		if (result) {
+			return result;
+		}
+		dir = next;
+
+		if (s == NULL) {
+			break;
+		}
+		name = s+1;
+	}
+
+	*ret = dir;
+	return 0;
+}
+
 /*
  * Name-to-vnode translation.
  * (In BSD, both of these are subsumed by namei().)
+ *
+ * For filesystems we walk the path ourselves a component at a time
+ * so we can use the name cache; the filesystem only ever sees
+ * single names. Devices get the whole remaining path as before.
  */
 
 int
 vfs_lookparent(char *path, struct vnode **retval,
 	       char *buf, size_t buflen)
 {
-	struct vnode *startvn;
+	struct vnode *startvn, *dir;
+	char *s;
+	size_t len;
 	int result;
 
 	vfs_biglock_acquire();
@@ -243,6 +333,14 @@ vfs_lookparent(char *path, struct vnode **retval,
 		return result;
 	}
 
+	if (startvn->vn_fs != NULL) {
+		/* Trailing slashes don't change the last component */
+		len = strlen(path);
+		while (len > 0 && path[len-1] == '/') {
+			path[--len] = 0;
+		}
+	}
+
 	if (strlen(path)==0) {
 		/*
 		 * It does not make sense to use just a device name in
@@ -251,9 +349,19 @@ vfs_lookparent(char *path, struct vnode **retval,
 		 */
 		result = EINVAL;
 	}
-	else {
+	else if (startvn->vn_fs == NULL ||
+		 (s = strrchr(path, '/')) == NULL) {
 		result = VOP_LOOKPARENT(startvn, path, retval, buf, buflen);
 	}
+	else {
+		*s = 0;
+		result = lookup_path(startvn, path, &dir);
+		if (result == 0) {
+			result = VOP_LOOKPARENT(dir, s+1, retval,
+						buf, buflen);
+			VOP_DECREF(dir);
+		}
+	}
 
 	VOP_DECREF(startvn);
 
@@ -281,7 +389,12 @@ vfs_lookup(char *path, struct vnode **retval)
 		return 0;
 	}
 
-	result = VOP_LOOKUP(startvn, path, retval);
+	if (startvn->vn_fs == NULL) {
+		result = VOP_LOOKUP(startvn, path, retval);
+	}
+	else {
+		result = lookup_path(startvn, path, retval);
+	}
 
 	VOP_DECREF(startvn);
 	vfs_biglock_release();
@@ -40,6 +40,13 @@
 #include <vnode.h>
 
 
+/*
+ * Each operation here that adds or removes a name purges that name
+ * from the lookup cache. The big lock is held across the operation
+ * and the purge so a concurrent lookup can't cache the old state in
+ * between.
+ */
+
 /* Does most of the work for open(). */
 int
 vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
@@ -73,7 +80,10 @@ vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
 			return result;
 		}
 
+		vfs_biglock_acquire();
 		result = VOP_CREAT(dir, name, excl, mode, &vn);
+		vfs_dcache_purge(dir, name);
+		vfs_biglock_release();
 
 		VOP_DECREF(dir);
 	}
@@ -145,7 +155,11 @@ vfs_remove(char *path)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_REMOVE(dir, name);
+	vfs_dcache_purge(dir, name);
+	vfs_biglock_release();
+
 	VOP_DECREF(dir);
 
 	return result;
@@ -178,7 +192,11 @@ vfs_rename(char *oldpath, char *newpath)
 		return EXDEV;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_RENAME(olddir, oldname, newdir, newname);
+	vfs_dcache_purge(olddir, oldname);
+	vfs_dcache_purge(newdir, newname);
+	vfs_biglock_release();
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(olddir);
@@ -212,7 +230,10 @@ vfs_link(char *oldpath, char *newpath)
 		return EXDEV;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_LINK(newdir, newname, oldfile);
+	vfs_dcache_purge(newdir, newname);
+	vfs_biglock_release();
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(oldfile);
@@ -239,7 +260,11 @@ vfs_symlink(const char *contents, char *path)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_SYMLINK(newdir, newname, contents);
+	vfs_dcache_purge(newdir, newname);
+	vfs_biglock_release();
+
 	VOP_DECREF(newdir);
 
 	return result;
@@ -285,7 +310,10 @@ vfs_mkdir(char *path, mode_t mode)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_MKDIR(parent, name, mode);
+	vfs_dcache_purge(parent, name);
+	vfs_biglock_release();
 
 	VOP_DECREF(parent);
 
@@ -307,7 +335,10 @@ vfs_rmdir(char *path)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_RMDIR(parent, name);
+	vfs_dcache_purge(parent, name);
+	vfs_biglock_release();
 
 	VOP_DECREF(parent);
 
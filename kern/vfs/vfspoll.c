@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Wait queues for poll() and select(). See <poll.h>.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <poll.h>
+
+/*
+ * One registration of a pollwait on a pollhead. These live in an
+ * array in the pollwait and are linked into the pollhead's list.
+ */
+struct pollentry {
+	struct pollwait *pe_wait;	/* who is waiting */
+	struct pollhead *pe_head;	/* what it's waiting on */
+	struct pollentry *pe_next;	/* list on pe_head */
+	struct pollentry **pe_prevp;	/* pointer to us in that list */
+};
+
+struct pollwait {
+	struct spinlock pw_lock;	/* protects pw_woken */
+	struct wchan *pw_wchan;		/* where we sleep */
+	bool pw_woken;			/* a pollhead woke us */
+
+	/* these are used only by the thread doing the poll */
+	struct pollentry *pw_entries;	/* our registrations */
+	unsigned pw_numentries;		/* number of pw_entries in use */
+	unsigned pw_maxentries;		/* size of pw_entries */
+};
+
+////////////////////////////////////////////////////////////
+// pollwait
+
+struct pollwait *
+pollwait_create(unsigned maxentries)
+{
+	struct pollwait *pw;
+
+	pw = kmalloc(sizeof(*pw));
+	if (pw == NULL) {
+		return NULL;
+	}
+	pw->pw_wchan = wchan_create("poll");
+	if (pw->pw_wchan == NULL) {
+		kfree(pw);
+		return NULL;
+	}
+	if (maxentries > 0) {
+		pw->pw_entries = kmalloc(maxentries * sizeof(pw->pw_entries[0]));
+		if (pw->pw_entries == NULL) {
+			wchan_destroy(pw->pw_wchan);
+			kfree(pw);
+			return NULL;
+		}
+	}
+	else {
+		pw->pw_entries = NULL;
+	}
+	spinlock_init(&pw->pw_lock);
+	pw->pw_woken = false;
+	pw->pw_numentries = 0;
+	pw->pw_maxentries = maxentries;
+	return pw;
+}
+
+void
+pollwait_destroy(struct pollwait *pw)
+{
+	struct pollentry *pe;
+	struct pollhead *ph;
+	unsigned i;
+
+	/*
+	 * Unhook from all the pollheads. Once this is done, nobody
+	 * else can find us.
+	 */
+	for (i=0; i<pw->pw_numentries; i++) {
+		pe = &pw->pw_entries[i];
+		ph = pe->pe_head;
+
+		spinlock_acquire(&ph->ph_lock);
+		*pe->pe_prevp = pe->pe_next;
+		if (pe->pe_next != NULL) {
+			pe->pe_next->pe_prevp = pe->pe_prevp;
+		}
+		spinlock_release(&ph->ph_lock);
+	}
+
+	kfree(pw->pw_entries);
+	wchan_destroy(pw->pw_wchan);
+	spinlock_cleanup(&pw->pw_lock);
+	kfree(pw);
+}
+
+/*
+ * Wake a pollwait. Called with the lock of the pollhead that's
+ * waking it held.
+ */
+static
+void
+pollwait_wake(struct pollwait *pw)
+{
+	spinlock_acquire(&pw->pw_lock);
+	pw->pw_woken = true;
+	wchan_wakeall(pw->pw_wchan, &pw->pw_lock);
+	spinlock_release(&pw->pw_lock);
+}
+
+/*
+ * Check if time NOW is at or after time THEN.
+ */
+static
+bool
+timespec_reached(const struct timespec *now, const struct timespec *then)
+{
+	if (now->tv_sec != then->tv_sec) {
+		return now->tv_sec > then->tv_sec;
+	}
+	return now->tv_nsec >= then->tv_nsec;
+}
+
+bool
+pollwait_sleep(struct pollwait *pw, const struct timespec *deadline)
+{
+	struct timespec now, left;
+	bool timedout = false;
+
+	spinlock_acquire(&pw->pw_lock);
+	while (!pw->pw_woken) {
+		if (deadline == NULL) {
+			wchan_sleep(pw->pw_wchan, &pw->pw_lock);
+			continue;
+		}
+
+		/* Read the clock without holding the spinlock. */
+		spinlock_release(&pw->pw_lock);
+		gettime(&now);
+		spinlock_acquire(&pw->pw_lock);
+		if (pw->pw_woken) {
+			break;
+		}
+		if (timespec_reached(&now, deadline)) {
+			timedout = true;
+			break;
+		}
+
+		/*
+		 * Sleep on the timer wheel until the deadline. The tick
+		 * count is rounded up, but check the clock again anyway
+		 * when we wake.
+		 */
+		timespec_sub(deadline, &now, &left);
+		wchan_timedsleep(pw->pw_wchan, &pw->pw_lock,
+				 timespec_to_ticks(&left));
+	}
+	pw->pw_woken = false;
+	spinlock_release(&pw->pw_lock);
+
+	return timedout;
+}
+
+////////////////////////////////////////////////////////////
+// pollhead
+
+void
+pollhead_init(struct pollhead *ph)
+{
+	spinlock_init(&ph->ph_lock);
+	ph->ph_entries = NULL;
+}
+
+void
+pollhead_cleanup(struct pollhead *ph)
+{
+	KASSERT(ph->ph_entries == NULL);
+	spinlock_cleanup(&ph->ph_lock);
+}
+
+void
+pollhead_register(struct pollhead *ph, struct pollwait *pw)
+{
+	struct pollentry *pe;
+
+	if (pw == NULL) {
+		return;
+	}
+
+	KASSERT(pw->pw_numentries < pw->pw_maxentries);
+	pe = &pw->pw_entries[pw->pw_numentries++];
+	pe->pe_wait = pw;
+	pe->pe_head = ph;
+
+	spinlock_acquire(&ph->ph_lock);
+	pe->pe_next = ph->ph_entries;
+	pe->pe_prevp = &ph->ph_entries;
+	if (pe->pe_next != NULL) {
+		pe->pe_next->pe_prevp = &pe->pe_next;
+	}
+	ph->ph_entries = pe;
+	spinlock_release(&ph->ph_lock);
+}
+
+void
+pollhead_wakeup(struct pollhead *ph)
+{
+	struct pollentry *pe;
+
+	spinlock_acquire(&ph->ph_lock);
+	for (pe = ph->ph_entries; pe != NULL; pe = pe->pe_next) {
+		pollwait_wake(pe->pe_wait);
+	}
+	spinlock_release(&ph->ph_lock);
+}
@@ -32,6 +32,7 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
@@ -175,3 +176,18 @@ vnode_check(struct vnode *v, const char *opstr)
 	spinlock_release(&v->vn_countlock);
 	vfs_biglock_release();
 }
+
+/*
+ * vop_poll for objects whose I/O never blocks, such as regular files
+ * and directories: they are always ready, so there's nothing to wait
+ * for and no need to register PW anywhere.
+ */
+int
+vopnoblock_poll(struct vnode *vn, struct pollwait *pw, int *revents)
+{
+	(void)vn;
+	(void)pw;
+
+	*revents = POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM;
+	return 0;
+}
@@ -35,6 +35,7 @@
 #include <current.h>
 #include <vm.h>
 #include <copyinout.h>
+#include <strword.h>
 
 /*
  * User/kernel memory copying functions.
@@ -229,15 +230,50 @@ copyout(const void *src, userptr_t userdest, size_t len)
  * hit STOPLEN it's because the string has run into the end of
  * userspace. Thus in the latter case we return EFAULT, not
  * ENAMETOOLONG.
+ *
+ * The middle of the string is copied a word at a time: once SRC is
+ * word-aligned, each whole word that fits within the limit is loaded
+ * once and checked for a zero byte with HASZERO; words without one
+ * are stored whole (or bytewise, if DEST isn't aligned the same
+ * way). The word holding the terminator is finished by bytes, so
+ * nothing is stored past it.
  */
 static
 int
 copystr(char *dest, const char *src, size_t maxlen, size_t stoplen,
 	size_t *gotlen)
 {
-	size_t i;
+	size_t i, limit;
+	uint32_t w;
+	bool aligned;
+
+	limit = maxlen < stoplen ? maxlen : stoplen;
+
+	for (i=0; i<limit && !WORDALIGNED(src + i); i++) {
+		dest[i] = src[i];
+		if (src[i] == 0) {
+			if (gotlen != NULL) {
+				*gotlen = i+1;
+			}
+			return 0;
+		}
+	}
+
+	aligned = WORDALIGNED(dest + i);
+	for (; limit - i >= sizeof(w); i += sizeof(w)) {
+		w = *(const uint32_t *)(src + i);
+		if (HASZERO(w)) {
+			break;
+		}
+		if (aligned) {
+			*(uint32_t *)(dest + i) = w;
+		}
+		else {
+			memcpy(dest + i, &w, sizeof(w));
+		}
+	}
 
-	for (i=0; i<maxlen && i<stoplen; i++) {
+	for (; i<limit; i++) {
 		dest[i] = src[i];
 		if (src[i] == 0) {
 			if (gotlen != NULL) {
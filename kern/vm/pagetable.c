@@ -154,7 +154,7 @@ int page_free(vaddr_t addr) {
 /* Evict Pagetable_entry from physical memory and write to memory */
 struct pagetable_entry *pagetable_evict(int npages)
 {
-    int evict = (((int)random()) * page_num) % page_num;
+    int evict = random() % page_num;
 
     spinlock_acquire(&pt_lock);
     struct pagetable_entry *start = (&pagetable[evict])->start;
@@ -36,6 +36,10 @@ KLDFLAGS+=-nostdlib
 # Do use the kernel's header files.
 KCFLAGS+=-I$(KTOP)/include -I$(KTOP)/dev -I. -Iincludelinks
 
+# And the private headers of the libc code in src/common that the
+# kernel shares (e.g. <strword.h>, for copyinstr/copyoutstr).
+KCFLAGS+=-I$(TOP)/common/libc/string
+
 # Tell gcc that we're building something other than an ordinary
 # application, so it makes fewer assumptions about standard library
 # functions.
@@ -74,7 +78,8 @@ TAGS_HEADERS=\
 	$(KTOP)/dev/*/*.h \
 	$(KTOP)/arch/$(MACHINE)/*/*.h \
 	$(KTOP)/arch/$(MACHINE)/include/kern/*.h \
-	$(KTOP)/arch/$(PLATFORM)/*/*.h
+	$(KTOP)/arch/$(PLATFORM)/*/*.h \
+	$(TOP)/common/libc/string/*.h
 
 #
 # Rules.
@@ -33,6 +33,9 @@
  * Usage:
  *     sh
  *     sh -c command
+ *
+ * Commands may be connected into a pipeline with "|", as in
+ * "cat file | tac"; the "|" must be a separate word.
  */
 
 #include <sys/types.h>
@@ -355,6 +358,98 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * dopipeline
+ * runs the commands in args, separated by "|" words, with the output
+ * of each piped to the input of the next, and waits for all of them.
+ * the exit status is that of the last command.
+ */
+static
+void
+dopipeline(char **args, int nargs, struct exitinfo *ei)
+{
+	pid_t pids[NARG_MAX / 2 + 1];
+	int ncmds, start, end, j;
+	int infd, fds[2];
+	int status;
+
+	ncmds = 0;
+	infd = -1;
+	for (start = 0; start <= nargs; start = end + 1) {
+		/* find the end of this command and cut it off */
+		for (end = start; end < nargs; end++) {
+			if (!strcmp(args[end], "|")) {
+				break;
+			}
+		}
+		args[end] = NULL;
+		if (end == start) {
+			printf("sh: Missing command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			break;
+		}
+
+		/* make a pipe to the next command, unless this is the last */
+		fds[0] = fds[1] = -1;
+		if (end < nargs && pipe(fds) < 0) {
+			warn("pipe");
+			exitinfo_exit(ei, 255);
+			break;
+		}
+
+		pids[ncmds] = fork();
+		if (pids[ncmds] < 0) {
+			warn("fork");
+			if (fds[0] >= 0) {
+				close(fds[0]);
+				close(fds[1]);
+			}
+			exitinfo_exit(ei, 255);
+			break;
+		}
+		if (pids[ncmds] == 0) {
+			/* child: hook up stdin and stdout, then run */
+			if (infd >= 0) {
+				dup2(infd, STDIN_FILENO);
+				close(infd);
+			}
+			if (fds[1] >= 0) {
+				dup2(fds[1], STDOUT_FILENO);
+				close(fds[0]);
+				close(fds[1]);
+			}
+			execvp(args[start], &args[start]);
+			warn("%s", args[start]);
+			/* see docommand for why this is _exit */
+			_exit(1);
+		}
+		ncmds++;
+
+		/* parent: the next command reads from this pipe */
+		if (infd >= 0) {
+			close(infd);
+		}
+		if (fds[1] >= 0) {
+			close(fds[1]);
+		}
+		infd = fds[0];
+	}
+	if (infd >= 0) {
+		close(infd);
+	}
+
+	/* wait for everything we started */
+	for (j = 0; j < ncmds; j++) {
+		if (waitpid(pids[j], &status, 0) < 0) {
+			warn("waitpid");
+			exitinfo_exit(ei, 255);
+		}
+		else if (j == ncmds - 1 && start > nargs) {
+			readstatus(status, ei);
+		}
+	}
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
@@ -394,6 +489,13 @@ docommand(char *buf, struct exitinfo *ei)
 		return;
 	}
 
+	for (i=0; i<nargs; i++) {
+		if (!strcmp(args[i], "|")) {
+			dopipeline(args, nargs, ei);
+			return;
+		}
+	}
+
 	for (i=0; builtins[i].name; i++) {
 		if (!strcmp(builtins[i].name, args[0])) {
 			builtins[i].func(nargs, args, ei);
@@ -41,6 +41,34 @@
 /* Constant returned by a bunch of stdio functions on error */
 #define EOF (-1)
 
+/* Default buffer size for stdio streams */
+#define BUFSIZ 1024
+
+/* Buffering modes for setvbuf */
+#define _IOFBF 0	/* fully buffered */
+#define _IOLBF 1	/* line buffered */
+#define _IONBF 2	/* unbuffered */
+
+/*
+ * Output stream. Only the three standard streams exist; there is no
+ * fopen. Data written to a stream accumulates in f_buf until it fills
+ * up, until a newline is written in line-buffered mode, or until the
+ * stream is flushed, either explicitly or on exit().
+ */
+typedef struct __file {
+	int f_fd;		/* file descriptor */
+	int f_mode;		/* _IOFBF, _IOLBF, or _IONBF */
+	int f_error;		/* nonzero if a write has failed */
+	int f_mallocd;		/* nonzero if f_buf came from malloc */
+	char *f_buf;		/* buffer */
+	size_t f_bufsize;	/* size of buffer */
+	size_t f_len;		/* amount of buffered data */
+} FILE;
+
+extern FILE *stdin;
+extern FILE *stdout;
+extern FILE *stderr;
+
 /*
  * The actual guts of printf
  * (for libc internal use only)
@@ -50,11 +78,20 @@ int __vprintf(void (*sendfunc)(void *clientdata, const char *, size_t len),
 	      const char *fmt,
 	      __va_list ap);
 
+/*
+ * Buffered output to a stream, and flushing all streams on exit()
+ * and fork() (for libc internal use only)
+ */
+int __stdio_write(FILE *f, const char *data, size_t len);
+void __stdio_flushall(void);
+
 /* Printf calls for user programs */
 int printf(const char *fmt, ...);
 int vprintf(const char *fmt, __va_list ap);
 int snprintf(char *buf, size_t len, const char *fmt, ...);
 int vsnprintf(char *buf, size_t len, const char *fmt, __va_list ap);
+int fprintf(FILE *f, const char *fmt, ...);
+int vfprintf(FILE *f, const char *fmt, __va_list ap);
 
 /* Print the argument string and then a newline. Returns 0 or -1 on error. */
 int puts(const char *);
@@ -66,6 +103,25 @@ int __puts(const char *);
 /* Writes one character. Returns it. */
 int putchar(int);
 
+/* Stream versions of the above, plus fwrite. */
+int fputc(int, FILE *);
+int putc(int, FILE *);
+int fputs(const char *, FILE *);
+size_t fwrite(const void *, size_t, size_t, FILE *);
+
+/*
+ * Write out any buffered data. fflush(NULL) flushes all streams.
+ * Returns 0 or EOF on error.
+ */
+int fflush(FILE *);
+
+/*
+ * Set the buffering mode and buffer of a stream. Must be called
+ * before anything is written to it. If buf is NULL, a buffer of the
+ * requested size is allocated.
+ */
+int setvbuf(FILE *, char *buf, int mode, size_t size);
+
 /* Reads one character (0-255) or returns EOF on error. */
 int getchar(void);
 
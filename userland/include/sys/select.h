@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SYS_SELECT_H_
+#define _SYS_SELECT_H_
+
+#include <sys/types.h>
+
+/*
+ * Get struct timeval and the fd_set layout from the kernel
+ */
+#include <kern/time.h>
+#include <kern/select.h>
+
+typedef struct __fd_set fd_set;
+
+#define FD_SETSIZE	__FD_SETSIZE
+
+#define FD_ZERO(set) \
+	do { \
+		unsigned __i; \
+		for (__i = 0; __i < __FD_SETWORDS; __i++) { \
+			(set)->fds_bits[__i] = 0; \
+		} \
+	} while (0)
+#define FD_SET(fd, set) \
+	((set)->fds_bits[(fd) / __NFDBITS] |= 1U << ((fd) % __NFDBITS))
+#define FD_CLR(fd, set) \
+	((set)->fds_bits[(fd) / __NFDBITS] &= ~(1U << ((fd) % __NFDBITS)))
+#define FD_ISSET(fd, set) \
+	(((set)->fds_bits[(fd) / __NFDBITS] & (1U << ((fd) % __NFDBITS))) != 0)
+
+/*
+ * Wait until one of the first NFDS file handles is ready for reading
+ * (if in READFDS), writing (if in WRITEFDS), or has an exceptional
+ * condition (if in EXCEPTFDS), or until TIMEOUT passes. A null
+ * TIMEOUT means wait forever. On return the sets contain only the
+ * file handles that are ready.
+ */
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+	   struct timeval *timeout);
+
+
+#endif /* _SYS_SELECT_H_ */
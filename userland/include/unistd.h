@@ -57,6 +57,8 @@
  *     fstat:    sys/stat.h
  *     lstat:    sys/stat.h
  *     mkdir:    sys/stat.h
+ *     readv:    sys/uio.h
+ *     writev:   sys/uio.h
  *
  * If this were standard Unix, more prototypes would go in other
  * header files as well, as follows:
@@ -145,8 +147,13 @@ ssize_t getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int futex_wait(volatile int *addr, int val, const struct timespec *timeout);
+int futex_wake(volatile int *addr, int count);
 ssize_t __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * Stdio stream state and buffering.
+ *
+ * There are only the three standard streams. stdout is line
+ * buffered by default, so interactive output still shows up a line
+ * at a time but a printf costs one write() instead of one per
+ * character. stderr is unbuffered, as usual. stdin is declared for
+ * completeness, but input is not buffered (see getchar.c).
+ */
+
+static char stdout_buf[BUFSIZ];
+
+static FILE __stdin  = { STDIN_FILENO,  _IONBF, 0, 0, NULL, 0, 0 };
+static FILE __stdout = { STDOUT_FILENO, _IOLBF, 0, 0, stdout_buf, BUFSIZ, 0 };
+static FILE __stderr = { STDERR_FILENO, _IONBF, 0, 0, NULL, 0, 0 };
+
+FILE *stdin = &__stdin;
+FILE *stdout = &__stdout;
+FILE *stderr = &__stderr;
+
+/*
+ * Write out a block of data directly, coping with short writes.
+ */
+static
+int
+__stdio_writeout(FILE *f, const char *data, size_t len)
+{
+	ssize_t r;
+
+	while (len > 0) {
+		r = write(f->f_fd, data, len);
+		if (r <= 0) {
+			f->f_error = 1;
+			return EOF;
+		}
+		data += r;
+		len -= r;
+	}
+	return 0;
+}
+
+/*
+ * Write out whatever is in the buffer.
+ */
+static
+int
+__stdio_flush(FILE *f)
+{
+	size_t len;
+
+	len = f->f_len;
+	f->f_len = 0;
+	if (len == 0) {
+		return 0;
+	}
+	return __stdio_writeout(f, f->f_buf, len);
+}
+
+/*
+ * Common output routine for all the stream functions.
+ */
+int
+__stdio_write(FILE *f, const char *data, size_t len)
+{
+	size_t i;
+	int result;
+
+	if (f->f_mode == _IONBF || f->f_buf == NULL) {
+		return __stdio_writeout(f, data, len);
+	}
+
+	if (len > f->f_bufsize - f->f_len) {
+		/* Doesn't fit; empty the buffer first. */
+		result = __stdio_flush(f);
+		if (result) {
+			return result;
+		}
+		if (len >= f->f_bufsize) {
+			/* Big enough that copying it is pointless. */
+			return __stdio_writeout(f, data, len);
+		}
+	}
+
+	memcpy(f->f_buf + f->f_len, data, len);
+	f->f_len += len;
+
+	if (f->f_mode == _IOLBF) {
+		for (i=0; i<len; i++) {
+			if (data[i] == '\n') {
+				return __stdio_flush(f);
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * C standard I/O function - flush a stream, or all of them.
+ */
+int
+fflush(FILE *f)
+{
+	int result;
+
+	if (f == NULL) {
+		result = 0;
+		if (fflush(stdout)) {
+			result = EOF;
+		}
+		if (fflush(stderr)) {
+			result = EOF;
+		}
+		return result;
+	}
+	if (f->f_buf == NULL) {
+		return 0;
+	}
+	return __stdio_flush(f);
+}
+
+/*
+ * Flush everything; used by exit() and fork().
+ */
+void
+__stdio_flushall(void)
+{
+	fflush(NULL);
+}
+
+/*
+ * C standard I/O function - set buffering mode.
+ */
+int
+setvbuf(FILE *f, char *buf, int mode, size_t size)
+{
+	if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF) {
+		errno = EINVAL;
+		return EOF;
+	}
+	if (mode != _IONBF && size == 0) {
+		errno = EINVAL;
+		return EOF;
+	}
+
+	/* Don't lose anything that's already been written. */
+	if (fflush(f)) {
+		return EOF;
+	}
+
+	if (mode != _IONBF && buf == NULL) {
+		if (f->f_buf != NULL && f->f_bufsize >= size) {
+			/* Keep the buffer we have. */
+			f->f_mode = mode;
+			return 0;
+		}
+		buf = malloc(size);
+		if (buf == NULL) {
+			return EOF;
+		}
+		if (f->f_mallocd) {
+			free(f->f_buf);
+		}
+		f->f_buf = buf;
+		f->f_bufsize = size;
+		f->f_mallocd = 1;
+		f->f_mode = mode;
+		return 0;
+	}
+
+	if (f->f_mallocd) {
+		free(f->f_buf);
+		f->f_mallocd = 0;
+	}
+	if (mode == _IONBF) {
+		buf = NULL;
+		size = 0;
+	}
+	f->f_buf = buf;
+	f->f_bufsize = size;
+	f->f_mode = mode;
+	return 0;
+}
@@ -41,6 +41,12 @@ getchar(void)
 	char ch;
 	int len;
 
+	/*
+	 * Make sure any prompt that's been printed actually appears
+	 * before we wait for input.
+	 */
+	fflush(stdout);
+
 	len = read(STDIN_FILENO, &ch, 1);
 	if (len<=0) {
 		/* end of file or error */
@@ -35,21 +35,6 @@
  */
 
 
-/*
- * Function passed to __vprintf to do the actual output.
- */
-static
-void
-__printf_send(void *mydata, const char *data, size_t len)
-{
-	unsigned i;
-	(void)mydata;  /* not needed */
-
-	for (i=0; i<len; i++) {
-		putchar(data[i]);
-	}
-}
-
 /* printf: hand off to vprintf */
 int
 printf(const char *fmt, ...)
@@ -62,9 +47,9 @@ printf(const char *fmt, ...)
 	return chars;
 }
 
-/* vprintf: call __vprintf to do the work. */
+/* vprintf: send to stdout with vfprintf. */
 int
 vprintf(const char *fmt, va_list ap)
 {
-	return __vprintf(__printf_send, NULL, fmt, ap);
+	return vfprintf(stdout, fmt, ap);
 }
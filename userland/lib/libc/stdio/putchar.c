@@ -28,22 +28,17 @@
  */
 
 #include <stdio.h>
-#include <unistd.h>
 
 /*
  * C standard function - print a single character.
  *
- * Properly, stdio is supposed to be buffered, but for present purposes
- * writing that code is not really worthwhile.
+ * This goes through the stdout buffer; see __stdio.c.
  */
 
 int
 putchar(int ch)
 {
-	char c = ch;
-	int len;
-	len = write(STDOUT_FILENO, &c, 1);
-	if (len<=0) {
+	if (fputc(ch, stdout) == EOF) {
 		return EOF;
 	}
 	return ch;
@@ -21,5 +21,11 @@ awk '
     }
 ' | awk '{
 	# output something simple that will work in syscalls.S.
-	printf "SYSCALL(%s, %s)\n", $1, $2;
+	# Calls with C wrappers in libc get SYSCALL_WRAPPED instead.
+	if ($1 == "fork") {
+		printf "SYSCALL_WRAPPED(%s, %s)\n", $1, $2;
+	}
+	else {
+		printf "SYSCALL(%s, %s)\n", $1, $2;
+	}
 }'
@@ -84,6 +84,12 @@ __printerr(int use_errno, const char *fmt, va_list ap)
 	 */
 	errmsg = strerror(errno);
 
+	/*
+	 * stderr isn't buffered but stdout is; write out anything
+	 * pending on stdout first so the output comes out in order.
+	 */
+	fflush(stdout);
+
 	/*
 	 * Look up the program name.
 	 * Strictly speaking we should pull off the rightmost
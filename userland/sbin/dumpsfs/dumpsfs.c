@@ -163,6 +163,14 @@ dumpsb(void)
 		 SFS_FREEMAPBLOCKS(SWAP32(sb.sb_nblocks)));
 	dumpvalf("Block size", "%u bytes", SFS_BLOCKSIZE);
 	dumplval("Volume name", sb.sb_volname);
+	if (sb.sb_journalblocks != 0) {
+		dumpvalf("Journal", "%u blocks at %u",
+			 SWAP32(sb.sb_journalblocks),
+			 SWAP32(sb.sb_journalstart));
+	}
+	else {
+		dumpval("Journal", "none");
+	}
 
 	for (i=0; i<ARRAYCOUNT(sb.reserved); i++) {
 		if (sb.reserved[i] != 0) {
@@ -228,9 +236,13 @@ dumpfreemap(uint32_t fsblocks)
 	printf("\n");
 }
 
+/*
+ * Dump indirect block BLOCK, which is at indirection LEVEL, and the
+ * indirect blocks under it.
+ */
 static
 void
-dumpindirect(uint32_t block)
+dumpindirect(uint32_t block, unsigned level)
 {
 	uint32_t ib[SFS_BLOCKSIZE/sizeof(uint32_t)];
 	char tmp[128];
@@ -239,7 +251,12 @@ dumpindirect(uint32_t block)
 	if (block == 0) {
 		return;
 	}
-	printf("Indirect block %u\n", block);
+	if (level > 1) {
+		printf("Level %u indirect block %u\n", level, block);
+	}
+	else {
+		printf("Indirect block %u\n", block);
+	}
 
 	diskread(ib, block);
 	for (i=0; i<ARRAYCOUNT(ib); i++) {
@@ -253,12 +270,17 @@ dumpindirect(uint32_t block)
 			printf("\n");
 		}
 	}
+	if (level > 1) {
+		for (i=0; i<ARRAYCOUNT(ib); i++) {
+			dumpindirect(SWAP32(ib[i]), level-1);
+		}
+	}
 }
 
 static
 uint32_t
 traverse_ib(uint32_t fileblock, uint32_t numblocks, uint32_t block,
-	    void (*doblock)(uint32_t, uint32_t))
+	    unsigned level, void (*doblock)(uint32_t, uint32_t))
 {
 	uint32_t ib[SFS_BLOCKSIZE/sizeof(uint32_t)];
 	unsigned i;
@@ -270,7 +292,14 @@ traverse_ib(uint32_t fileblock, uint32_t numblocks, uint32_t block,
 		diskread(ib, block);
 	}
 	for (i=0; i<ARRAYCOUNT(ib) && fileblock < numblocks; i++) {
-		doblock(fileblock++, SWAP32(ib[i]));
+		if (level > 1) {
+			fileblock = traverse_ib(fileblock, numblocks,
+						SWAP32(ib[i]), level-1,
+						doblock);
+		}
+		else {
+			doblock(fileblock++, SWAP32(ib[i]));
+		}
 	}
 	return fileblock;
 }
@@ -291,7 +320,15 @@ traverse(const struct sfs_dinode *sfi, void (*doblock)(uint32_t, uint32_t))
 	}
 	if (fileblock < numblocks) {
 		fileblock = traverse_ib(fileblock, numblocks,
-					SWAP32(sfi->sfi_indirect), doblock);
+					SWAP32(sfi->sfi_indirect), 1, doblock);
+	}
+	if (fileblock < numblocks) {
+		fileblock = traverse_ib(fileblock, numblocks,
+					SWAP32(sfi->sfi_dindirect), 2, doblock);
+	}
+	if (fileblock < numblocks) {
+		fileblock = traverse_ib(fileblock, numblocks,
+					SWAP32(sfi->sfi_tindirect), 3, doblock);
 	}
 	assert(fileblock == numblocks);
 }
@@ -476,6 +513,10 @@ dumpinode(uint32_t ino, const char *name)
 	}
 	printf("    Indirect block: %u (0x%x)\n",
 	       SWAP32(sfi.sfi_indirect), SWAP32(sfi.sfi_indirect));
+	printf("    Double indirect block: %u (0x%x)\n",
+	       SWAP32(sfi.sfi_dindirect), SWAP32(sfi.sfi_dindirect));
+	printf("    Triple indirect block: %u (0x%x)\n",
+	       SWAP32(sfi.sfi_tindirect), SWAP32(sfi.sfi_tindirect));
 	for (i=0; i<ARRAYCOUNT(sfi.sfi_waste); i++) {
 		if (sfi.sfi_waste[i] != 0) {
 			printf("    Word %u in waste area: 0x%x\n",
@@ -484,7 +525,9 @@ dumpinode(uint32_t ino, const char *name)
 	}
 
 	if (doindirect) {
-		dumpindirect(SWAP32(sfi.sfi_indirect));
+		dumpindirect(SWAP32(sfi.sfi_indirect), 1);
+		dumpindirect(SWAP32(sfi.sfi_dindirect), 2);
+		dumpindirect(SWAP32(sfi.sfi_tindirect), 3);
 	}
 
 	if (SWAP16(sfi.sfi_type) == SFS_TYPE_DIR && dodirs) {
@@ -115,10 +115,10 @@ diskblocks(void)
 }
 
 /*
- * Write a block.
+ * Write N consecutive blocks starting at BLOCK, in one go.
  */
 void
-diskwrite(const void *data, uint32_t block)
+diskwriten(const void *data, uint32_t block, uint32_t n)
 {
 	const char *cdata = data;
 	uint32_t tot=0;
@@ -135,8 +135,8 @@ diskwrite(const void *data, uint32_t block)
 		err(1, "lseek");
 	}
 
-	while (tot < BLOCKSIZE) {
-		len = write(fd, cdata + tot, BLOCKSIZE - tot);
+	while (tot < n*BLOCKSIZE) {
+		len = write(fd, cdata + tot, n*BLOCKSIZE - tot);
 		if (len < 0) {
 			if (errno==EINTR || errno==EAGAIN) {
 				continue;
@@ -151,10 +151,19 @@ diskwrite(const void *data, uint32_t block)
 }
 
 /*
- * Read a block.
+ * Write a block.
  */
 void
-diskread(void *data, uint32_t block)
+diskwrite(const void *data, uint32_t block)
+{
+	diskwriten(data, block, 1);
+}
+
+/*
+ * Read N consecutive blocks starting at BLOCK, in one go.
+ */
+void
+diskreadn(void *data, uint32_t block, uint32_t n)
 {
 	char *cdata = data;
 	uint32_t tot=0;
@@ -171,8 +180,8 @@ diskread(void *data, uint32_t block)
 		err(1, "lseek");
 	}
 
-	while (tot < BLOCKSIZE) {
-		len = read(fd, cdata + tot, BLOCKSIZE - tot);
+	while (tot < n*BLOCKSIZE) {
+		len = read(fd, cdata + tot, n*BLOCKSIZE - tot);
 		if (len < 0) {
 			if (errno==EINTR || errno==EAGAIN) {
 				continue;
@@ -186,6 +195,15 @@ diskread(void *data, uint32_t block)
 	}
 }
 
+/*
+ * Read a block.
+ */
+void
+diskread(void *data, uint32_t block)
+{
+	diskreadn(data, block, 1);
+}
+
 /*
  * Close the disk.
  */
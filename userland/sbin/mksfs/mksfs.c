@@ -56,6 +56,7 @@
 #endif
 
 #include "disk.h"
+#include "populate.h"
 
 /* Maximum size of freemap we support */
 #define MAXFREEMAPBLOCKS 32
@@ -73,6 +74,7 @@ check(void)
 	assert(sizeof(struct sfs_superblock)==SFS_BLOCKSIZE);
 	assert(sizeof(struct sfs_dinode)==SFS_BLOCKSIZE);
 	assert(SFS_BLOCKSIZE % sizeof(struct sfs_direntry) == 0);
+	assert(sizeof(struct sfs_jrecord)==SFS_BLOCKSIZE);
 }
 
 /*
@@ -89,6 +91,24 @@ allocblock(uint32_t block)
 	freemapbuf[mapbyte] |= mask;
 }
 
+/*
+ * Where the journal goes; it follows the freemap. Small volumes
+ * don't get one.
+ */
+static
+uint32_t
+journalblocks(uint32_t fsblocks)
+{
+	return fsblocks < SFS_JNL_MINVOLUME ? 0 : SFS_JOURNALSIZE;
+}
+
+static
+uint32_t
+journalstart(uint32_t fsblocks)
+{
+	return SFS_FREEMAP_START + SFS_FREEMAPBLOCKS(fsblocks);
+}
+
 /*
  * Initialize the free block bitmap.
  */
@@ -114,6 +134,11 @@ initfreemap(uint32_t fsblocks)
 		allocblock(SFS_FREEMAP_START + i);
 	}
 
+	/* so must the journal blocks */
+	for (i=0; i<journalblocks(fsblocks); i++) {
+		allocblock(journalstart(fsblocks) + i);
+	}
+
 	/* all blocks in the freemap but past the volume end are "in use" */
 	for (i=fsblocks; i<freemapbits; i++) {
 		allocblock(i);
@@ -140,6 +165,10 @@ writesuper(const char *volname, uint32_t nblocks)
 	sb.sb_magic = SWAP32(SFS_MAGIC);
 	sb.sb_nblocks = SWAP32(nblocks);
 	strcpy(sb.sb_volname, volname);
+	if (journalblocks(nblocks) > 0) {
+		sb.sb_journalstart = SWAP32(journalstart(nblocks));
+		sb.sb_journalblocks = SWAP32(journalblocks(nblocks));
+	}
 
 	/* and write it out. */
 	diskwrite(&sb, SFS_SUPER_BLOCK);
@@ -164,6 +193,31 @@ writefreemap(uint32_t fsblocks)
 	}
 }
 
+/*
+ * Write out an empty journal: a header expecting transaction 1, and
+ * no transaction.
+ */
+static
+void
+writejournal(uint32_t fsblocks)
+{
+	struct sfs_jrecord jr;
+	uint32_t start;
+
+	if (journalblocks(fsblocks) == 0) {
+		return;
+	}
+	start = journalstart(fsblocks);
+
+	bzero((void *)&jr, sizeof(jr));
+	diskwrite(&jr, start + 1);
+
+	jr.jr_magic = SWAP32(SFS_JNL_MAGIC);
+	jr.jr_type = SWAP32(SFS_JNL_HEADER);
+	jr.jr_seq = SWAP32(1);
+	diskwrite(&jr, start);
+}
+
 /*
  * Write out the root directory inode.
  */
@@ -183,6 +237,25 @@ writerootdir(void)
 	diskwrite(&sfi, SFS_ROOTDIR_INO);
 }
 
+#ifdef HOST
+/*
+ * Write the root directory and everything under it from host
+ * directory SRCDIR, in the blocks following the journal.
+ */
+static
+void
+writetree(const char *srcdir, uint32_t fsblocks)
+{
+	uint32_t first, end, i;
+
+	first = journalstart(fsblocks) + journalblocks(fsblocks);
+	end = populate(srcdir, first, fsblocks);
+	for (i=first; i<end; i++) {
+		allocblock(i);
+	}
+}
+#endif
+
 /*
  * Main.
  */
@@ -191,13 +264,24 @@ main(int argc, char **argv)
 {
 	uint32_t size, blocksize;
 	char *volname, *s;
+	const char *srcdir = NULL;
 
 #ifdef HOST
 	hostcompat_init(argc, argv);
+
+	if (argc==5 && !strcmp(argv[1], "-d")) {
+		srcdir = argv[2];
+		argv += 2;
+		argc -= 2;
+	}
 #endif
 
 	if (argc!=3) {
+#ifdef HOST
+		errx(1, "Usage: mksfs [-d srcdir] diskfile volume-name");
+#else
 		errx(1, "Usage: mksfs device/diskfile volume-name");
+#endif
 	}
 
 	check();
@@ -231,8 +315,17 @@ main(int argc, char **argv)
 	/* Write out the on-disk structures */
 	initfreemap(size);
 	writesuper(volname, size);
+	writejournal(size);
+	if (srcdir != NULL) {
+#ifdef HOST
+		writetree(srcdir, size);
+#endif
+	}
+	else {
+		writerootdir();
+	}
+	/* last, as populating the volume allocates blocks */
 	writefreemap(size);
-	writerootdir();
 
 	closedisk();
 
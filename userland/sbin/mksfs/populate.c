@@ -0,0 +1,476 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Populating a new volume from a host directory tree (mksfs -d).
+ *
+ * The whole tree is laid out in one pass with a single allocation
+ * cursor, so everything ends up contiguous and in the order it is
+ * written: for each directory, its own blocks, then the inodes of
+ * everything in it, then the contents of its files in name order,
+ * then each of its subdirectories in the same fashion. Indirect
+ * blocks go just before the data they map.
+ *
+ * This needs opendir/readdir, so it is only built for the host.
+ */
+
+#ifdef HOST
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+
+#include <netinet/in.h> // for arpa/inet.h
+#include <arpa/inet.h>  // for ntohl
+
+#include "support.h"
+#include "kern/sfs.h"
+#include "disk.h"
+#include "populate.h"
+
+#define SWAP32(x) ntohl(x)
+#define SWAP16(x) ntohs(x)
+
+/* Largest file we can map: direct, single, double, and triple indirect */
+#define MAXFILEBLOCKS \
+	(SFS_NDIRECT + SFS_DBPERIDB + SFS_DBPERIDB * SFS_DBPERIDB + \
+	 SFS_DBPERIDB * SFS_DBPERIDB * SFS_DBPERIDB)
+
+/* An entry in a host directory being copied in. */
+struct child {
+	char name[SFS_NAMELEN];
+	char *path;		/* host path */
+	uint32_t size;		/* file size; unused for dirs */
+	int isdir;
+	uint32_t ino;		/* inode number it gets */
+};
+
+/* Where a file's contents come from: a host file or a memory buffer. */
+struct source {
+	const char *name;	/* for error messages */
+	int fd;
+	const char *mem;	/* used if fd < 0 */
+	size_t memleft;
+};
+
+/* Allocation cursor and volume size */
+static uint32_t nextblock, volblocks;
+
+/* Staging buffer for data: one indirect block's worth */
+static char databuf[SFS_DBPERIDB * SFS_BLOCKSIZE];
+
+/*
+ * Non-failing realloc.
+ */
+static
+void *
+doalloc(void *ptr, size_t len)
+{
+	ptr = realloc(ptr, len);
+	if (ptr == NULL) {
+		err(1, "malloc");
+	}
+	return ptr;
+}
+
+/*
+ * Allocate N consecutive blocks; returns the first.
+ */
+static
+uint32_t
+getblocks(uint32_t n)
+{
+	uint32_t block;
+
+	if (n > volblocks - nextblock) {
+		errx(1, "Volume too small for source tree");
+	}
+	block = nextblock;
+	nextblock += n;
+	return block;
+}
+
+/*
+ * Fill BUF with the next LEN bytes from SRC; past EOF, zero-fill.
+ */
+static
+void
+readsource(struct source *src, char *buf, size_t len)
+{
+	size_t tot = 0;
+	ssize_t r;
+
+	if (src->fd < 0) {
+		tot = len < src->memleft ? len : src->memleft;
+		memcpy(buf, src->mem, tot);
+		src->mem += tot;
+		src->memleft -= tot;
+	}
+	else {
+		while (tot < len) {
+			r = read(src->fd, buf + tot, len - tot);
+			if (r < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				err(1, "%s", src->name);
+			}
+			if (r == 0) {
+				break;
+			}
+			tot += r;
+		}
+	}
+	bzero(buf + tot, len - tot);
+}
+
+/*
+ * Copy the next N blocks of SRC into newly allocated consecutive
+ * blocks, with one write. Returns the first block.
+ */
+static
+uint32_t
+copyblocks(struct source *src, uint32_t n)
+{
+	uint32_t block;
+
+	assert(n > 0 && n <= SFS_DBPERIDB);
+	readsource(src, databuf, n * SFS_BLOCKSIZE);
+	block = getblocks(n);
+	diskwriten(databuf, block, n);
+	return block;
+}
+
+/*
+ * Lay out an indirect block of level LEVEL (1-3) mapping the next
+ * *NBLOCKSP data blocks of SRC, or as many of them as it can cover.
+ * Decrements *NBLOCKSP; returns the indirect block.
+ */
+static
+uint32_t
+layoutindirect(struct source *src, int level, uint32_t *nblocksp)
+{
+	uint32_t entries[SFS_DBPERIDB];
+	uint32_t block, first, n, i;
+
+	block = getblocks(1);
+	bzero(entries, sizeof(entries));
+
+	if (level == 1) {
+		n = *nblocksp < SFS_DBPERIDB ? *nblocksp : SFS_DBPERIDB;
+		first = copyblocks(src, n);
+		for (i=0; i<n; i++) {
+			entries[i] = SWAP32(first + i);
+		}
+		*nblocksp -= n;
+	}
+	else {
+		for (i=0; i<SFS_DBPERIDB && *nblocksp > 0; i++) {
+			entries[i] = SWAP32(layoutindirect(src, level-1,
+							   nblocksp));
+		}
+	}
+
+	diskwrite(entries, block);
+	return block;
+}
+
+/*
+ * Count the indirect blocks layoutindirect() would use for the same
+ * arguments, without writing anything.
+ */
+static
+uint32_t
+countindirect(int level, uint32_t *nblocksp)
+{
+	uint32_t count = 1, i;
+
+	if (level == 1) {
+		*nblocksp -= *nblocksp < SFS_DBPERIDB ?
+			*nblocksp : SFS_DBPERIDB;
+	}
+	else {
+		for (i=0; i<SFS_DBPERIDB && *nblocksp > 0; i++) {
+			count += countindirect(level-1, nblocksp);
+		}
+	}
+	return count;
+}
+
+/*
+ * Total blocks, data plus indirect, for a file of SIZE bytes.
+ */
+static
+uint32_t
+filefootprint(uint32_t size)
+{
+	uint32_t nblocks, n, total;
+	int level;
+
+	nblocks = SFS_ROUNDUP(size, SFS_BLOCKSIZE) / SFS_BLOCKSIZE;
+	total = nblocks;
+	n = nblocks > SFS_NDIRECT ? nblocks - SFS_NDIRECT : 0;
+	for (level=1; level<=3 && n > 0; level++) {
+		total += countindirect(level, &n);
+	}
+	return total;
+}
+
+/*
+ * Lay out SIZE bytes from SRC as a file and set SFI's block pointers.
+ */
+static
+void
+layoutfile(struct source *src, uint32_t size, struct sfs_dinode *sfi)
+{
+	uint32_t nblocks, n, first, i;
+
+	nblocks = SFS_ROUNDUP(size, SFS_BLOCKSIZE) / SFS_BLOCKSIZE;
+	assert(nblocks <= MAXFILEBLOCKS);
+
+	n = nblocks < SFS_NDIRECT ? nblocks : SFS_NDIRECT;
+	if (n > 0) {
+		first = copyblocks(src, n);
+		for (i=0; i<n; i++) {
+			sfi->sfi_direct[i] = SWAP32(first + i);
+		}
+		nblocks -= n;
+	}
+	if (nblocks > 0) {
+		sfi->sfi_indirect = SWAP32(layoutindirect(src, 1, &nblocks));
+	}
+	if (nblocks > 0) {
+		sfi->sfi_dindirect = SWAP32(layoutindirect(src, 2, &nblocks));
+	}
+	if (nblocks > 0) {
+		sfi->sfi_tindirect = SWAP32(layoutindirect(src, 3, &nblocks));
+	}
+	assert(nblocks == 0);
+}
+
+/*
+ * Sort function for children, by name.
+ */
+static
+int
+childcompare(const void *av, const void *bv)
+{
+	const struct child *a = av;
+	const struct child *b = bv;
+
+	return strcmp(a->name, b->name);
+}
+
+/*
+ * Read host directory PATH. Regular files and directories are
+ * returned, sorted by name, in a malloc'd array; anything else is
+ * skipped with a warning.
+ */
+static
+struct child *
+readchildren(const char *path, unsigned *countp)
+{
+	struct child *children = NULL;
+	unsigned count = 0;
+	struct dirent *de;
+	struct stat st;
+	DIR *dir;
+	char *cpath;
+
+	dir = opendir(path);
+	if (dir == NULL) {
+		err(1, "%s", path);
+	}
+	while ((de = readdir(dir)) != NULL) {
+		if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+			continue;
+		}
+
+		cpath = doalloc(NULL, strlen(path) + strlen(de->d_name) + 2);
+		sprintf(cpath, "%s/%s", path, de->d_name);
+		if (lstat(cpath, &st) < 0) {
+			err(1, "%s", cpath);
+		}
+		if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)) {
+			warnx("%s: Not a regular file or directory (skipped)",
+			      cpath);
+			free(cpath);
+			continue;
+		}
+		if (strlen(de->d_name) >= SFS_NAMELEN) {
+			errx(1, "%s: Name too long", cpath);
+		}
+		if (S_ISREG(st.st_mode) &&
+		    (uintmax_t)st.st_size > (uintmax_t)MAXFILEBLOCKS *
+		    SFS_BLOCKSIZE) {
+			errx(1, "%s: File too large", cpath);
+		}
+
+		children = doalloc(children, (count+1) * sizeof(*children));
+		strcpy(children[count].name, de->d_name);
+		children[count].path = cpath;
+		children[count].isdir = S_ISDIR(st.st_mode);
+		children[count].size = children[count].isdir ? 0 : st.st_size;
+		children[count].ino = 0;
+		count++;
+	}
+	closedir(dir);
+
+	qsort(children, count, sizeof(*children), childcompare);
+	*countp = count;
+	return children;
+}
+
+/*
+ * Copy host file CH in as inode CH->ino.
+ */
+static
+void
+populatefile(struct child *ch)
+{
+	struct sfs_dinode sfi;
+	struct source src;
+
+	src.name = ch->path;
+	src.fd = open(ch->path, O_RDONLY);
+	if (src.fd < 0) {
+		err(1, "%s", ch->path);
+	}
+
+	bzero((void *)&sfi, sizeof(sfi));
+	sfi.sfi_size = SWAP32(ch->size);
+	sfi.sfi_type = SWAP16(SFS_TYPE_FILE);
+	sfi.sfi_linkcount = SWAP16(1);
+	layoutfile(&src, ch->size, &sfi);
+
+	close(src.fd);
+	diskwrite(&sfi, ch->ino);
+}
+
+/*
+ * Copy host directory PATH in as directory INO, whose parent is
+ * PARENTINO. INO has already been allocated.
+ */
+static
+void
+populatedir(uint32_t ino, uint32_t parentino, const char *path)
+{
+	struct child *children;
+	struct sfs_direntry *entries;
+	struct sfs_dinode sfi;
+	struct source src;
+	unsigned nchildren, nsubdirs, i;
+	uint32_t dirsize, firstino;
+
+	children = readchildren(path, &nchildren);
+
+	/*
+	 * The child inodes go right after the directory's own blocks,
+	 * so we know their numbers before writing the directory.
+	 */
+	dirsize = (nchildren + 2) * sizeof(struct sfs_direntry);
+	firstino = nextblock + filefootprint(dirsize);
+
+	entries = doalloc(NULL, dirsize);
+	bzero(entries, dirsize);
+	entries[0].sfd_ino = SWAP32(ino);
+	strcpy(entries[0].sfd_name, ".");
+	entries[1].sfd_ino = SWAP32(parentino);
+	strcpy(entries[1].sfd_name, "..");
+	nsubdirs = 0;
+	for (i=0; i<nchildren; i++) {
+		children[i].ino = firstino + i;
+		entries[i+2].sfd_ino = SWAP32(children[i].ino);
+		strcpy(entries[i+2].sfd_name, children[i].name);
+		if (children[i].isdir) {
+			nsubdirs++;
+		}
+	}
+
+	bzero((void *)&sfi, sizeof(sfi));
+	sfi.sfi_size = SWAP32(dirsize);
+	sfi.sfi_type = SWAP16(SFS_TYPE_DIR);
+	sfi.sfi_linkcount = SWAP16(nsubdirs + 2);
+
+	src.name = path;
+	src.fd = -1;
+	src.mem = (const char *)entries;
+	src.memleft = dirsize;
+	layoutfile(&src, dirsize, &sfi);
+	diskwrite(&sfi, ino);
+	free(entries);
+
+	assert(nextblock == firstino);
+	getblocks(nchildren);
+
+	for (i=0; i<nchildren; i++) {
+		if (!children[i].isdir) {
+			populatefile(&children[i]);
+		}
+	}
+	for (i=0; i<nchildren; i++) {
+		if (children[i].isdir) {
+			populatedir(children[i].ino, ino, children[i].path);
+		}
+	}
+
+	for (i=0; i<nchildren; i++) {
+		free(children[i].path);
+	}
+	free(children);
+}
+
+uint32_t
+populate(const char *srcdir, uint32_t firstblock, uint32_t fsblocks)
+{
+	struct stat st;
+
+	if (stat(srcdir, &st) < 0) {
+		err(1, "%s", srcdir);
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		errx(1, "%s: Not a directory", srcdir);
+	}
+
+	nextblock = firstblock;
+	volblocks = fsblocks;
+	populatedir(SFS_ROOTDIR_INO, SFS_ROOTDIR_INO, srcdir);
+	return nextblock;
+}
+
+#endif /* HOST */
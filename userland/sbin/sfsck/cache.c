@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2009, 2013, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#ifdef HOST
+#include <pthread.h>
+#endif
+
+#include "compat.h"
+#include <kern/sfs.h>
+
+#include "disk.h"
+#include "utils.h"
+#include "cache.h"
+
+/*
+ * Runs are CHUNKBLOCKS blocks long and start at multiples of
+ * CHUNKBLOCKS. SFS allocates inodes and their data near each other
+ * and near the directories that name them, so the blocks pass 1 and
+ * pass 2 ask for come in clusters; and the freemap and journal are
+ * contiguous and get read with one or two disk reads.
+ */
+#define CHUNKBLOCKS	64
+
+#ifdef HOST
+#define NCHUNKS		64	/* 2M */
+#else
+#define NCHUNKS		8	/* 256K */
+#endif
+
+struct chunk {
+	uint32_t first;		/* first block */
+	uint32_t nblocks;	/* number of blocks; 0 if unused */
+	unsigned lastuse;	/* for LRU replacement */
+	uint8_t *data;
+};
+
+static struct chunk chunks[NCHUNKS];
+static unsigned cacheclock;
+
+#ifdef HOST
+static pthread_mutex_t cachelock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK()		pthread_mutex_lock(&cachelock)
+#define UNLOCK()	pthread_mutex_unlock(&cachelock)
+#else
+#define LOCK()		((void)0)
+#define UNLOCK()	((void)0)
+#endif
+
+/*
+ * Find the chunk holding BLOCK, or NULL.
+ */
+static
+struct chunk *
+cache_find(uint32_t block)
+{
+	unsigned i;
+
+	for (i=0; i<NCHUNKS; i++) {
+		if (chunks[i].nblocks > 0 &&
+		    block >= chunks[i].first &&
+		    block - chunks[i].first < chunks[i].nblocks) {
+			return &chunks[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Load the run holding BLOCK, replacing the least recently used.
+ */
+static
+struct chunk *
+cache_load(uint32_t block)
+{
+	struct chunk *c;
+	uint32_t first, n;
+	unsigned i;
+
+	c = &chunks[0];
+	for (i=0; i<NCHUNKS; i++) {
+		if (chunks[i].nblocks == 0) {
+			c = &chunks[i];
+			break;
+		}
+		if (chunks[i].lastuse < c->lastuse) {
+			c = &chunks[i];
+		}
+	}
+	if (c->data == NULL) {
+		c->data = domalloc(CHUNKBLOCKS * SFS_BLOCKSIZE);
+	}
+
+	first = block - block % CHUNKBLOCKS;
+	n = CHUNKBLOCKS;
+	if (first + n > diskblocks()) {
+		/* Don't read past the end of the disk */
+		n = block < diskblocks() ? diskblocks() - first : 0;
+	}
+	if (n == 0) {
+		/* Let the disk code complain */
+		diskread(c->data, block);
+		first = block;
+		n = 1;
+	}
+	else {
+		diskreadn(c->data, first, n);
+	}
+
+	c->first = first;
+	c->nblocks = n;
+	return c;
+}
+
+/*
+ * Read a block.
+ */
+void
+cache_read(void *data, uint32_t block)
+{
+	struct chunk *c;
+
+	LOCK();
+	c = cache_find(block);
+	if (c == NULL) {
+		c = cache_load(block);
+	}
+	c->lastuse = ++cacheclock;
+	memcpy(data, c->data + (block - c->first) * SFS_BLOCKSIZE,
+	       SFS_BLOCKSIZE);
+	UNLOCK();
+}
+
+/*
+ * Write a block, updating the cached copy if there is one.
+ */
+void
+cache_write(const void *data, uint32_t block)
+{
+	struct chunk *c;
+
+	LOCK();
+	diskwrite(data, block);
+	c = cache_find(block);
+	if (c != NULL) {
+		memcpy(c->data + (block - c->first) * SFS_BLOCKSIZE, data,
+		       SFS_BLOCKSIZE);
+	}
+	UNLOCK();
+}
@@ -78,6 +78,11 @@ freemap_setup(void)
 	for (i=0; i < mapblocks; i++) {
 		freemap_blockinuse(SFS_FREEMAP_START+i, B_FREEMAPBLOCK, i);
 	}
+
+	/* And the journal */
+	for (i=0; i < sb_journalblocks(); i++) {
+		freemap_blockinuse(sb_journalstart()+i, B_JOURNAL, i);
+	}
 }
 
 /*
@@ -95,6 +100,10 @@ blockusagestr(blockusage_t how, uint32_t howdesc)
 		snprintf(rv, sizeof(rv), "freemap block %lu",
 			 (unsigned long) howdesc);
 		break;
+	    case B_JOURNAL:
+		snprintf(rv, sizeof(rv), "journal block %lu",
+			 (unsigned long) howdesc);
+		break;
 	    case B_INODE:
 		snprintf(rv, sizeof(rv), "inode %lu",
 			 (unsigned long) howdesc);
@@ -129,6 +138,8 @@ freemap_blockinuse(uint32_t block, blockusage_t how, uint32_t howdesc)
 	unsigned index = block/8;
 	uint8_t mask = ((uint8_t)1)<<(block%8);
 
+	checklock();
+
 	if (tofreedata[index] & mask) {
 		/* really using the block, don't free it */
 		tofreedata[index] &= ~mask;
@@ -145,6 +156,8 @@ freemap_blockinuse(uint32_t block, blockusage_t how, uint32_t howdesc)
 	if (how != B_PASTEND) {
 		blocksinuse++;
 	}
+
+	checkunlock();
 }
 
 /*
@@ -164,15 +177,17 @@ freemap_blockfree(uint32_t block)
 	unsigned index = block/8;
 	uint8_t mask = ((uint8_t)1)<<(block%8);
 
+	checklock();
 	if (tofreedata[index] & mask) {
 		/* already marked to free once, ignore */
-		return;
 	}
-	if (freemapdata[index] & mask) {
+	else if (freemapdata[index] & mask) {
 		/* block is used elsewhere, ignore */
-		return;
 	}
-	tofreedata[index] |= mask;
+	else {
+		tofreedata[index] |= mask;
+	}
+	checkunlock();
 }
 
 /*
@@ -27,6 +27,8 @@
  * SUCH DAMAGE.
  */
 
+#include <sys/types.h>	/* for CHAR_BIT */
+#include <limits.h>	/* also for CHAR_BIT */
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -38,6 +40,7 @@
 
 #include "utils.h"
 #include "sfs.h"
+#include "sb.h"
 #include "freemap.h"
 #include "inode.h"
 #include "main.h"
@@ -60,6 +63,9 @@ static unsigned ninodes = 0, maxinodes = 0;
 /* Whether the table is sorted and can be looked up with binary search. */
 static int inodes_sorted = 0;
 
+/* Bitmap (one bit per block) of inode numbers in the table. */
+static uint8_t *inodeseen = NULL;
+
 ////////////////////////////////////////////////////////////
 // inode table ops
 
@@ -169,14 +175,29 @@ inode_find(uint32_t ino)
 /*
  * Add an inode; returns 1 if we've already seen it.
  *
- * Uses linear search because we only sort the table for faster access
- * after all inodes have been added. In the FUTURE this could be
- * changed to a better data structure.
+ * The table is only sorted after all inodes have been added, so
+ * whether we've seen an inode is answered from a bitmap indexed by
+ * inode (block) number. Only on a repeat do we search the table, to
+ * check it's consistent.
  */
 int
 inode_add(uint32_t ino, int type)
 {
-	unsigned i;
+	unsigned i, nbytes;
+	uint8_t mask;
+
+	if (inodeseen == NULL) {
+		nbytes = (sb_totalblocks() + CHAR_BIT - 1) / CHAR_BIT;
+		inodeseen = domalloc(nbytes);
+		memset(inodeseen, 0, nbytes);
+	}
+	assert(ino < sb_totalblocks());
+	mask = ((uint8_t)1) << (ino % CHAR_BIT);
+	if ((inodeseen[ino / CHAR_BIT] & mask) == 0) {
+		inodeseen[ino / CHAR_BIT] |= mask;
+		inode_addtable(ino, type);
+		return 0;
+	}
 
 	for (i=0; i<ninodes; i++) {
 		if (inodes[i].ino==ino) {
@@ -186,8 +207,8 @@ inode_add(uint32_t ino, int type)
 		}
 	}
 
-	inode_addtable(ino, type);
-
+	/* NOTREACHED */
+	assert(0);
 	return 0;
 }
 
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2006, 2009, 2013
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <err.h>
+
+#include "compat.h"
+#include <kern/sfs.h>
+
+#include "cache.h"
+#include "sfs.h"
+#include "sb.h"
+#include "journal.h"
+#include "main.h"
+
+/* FNV-1a, as in the kernel */
+#define HASHINIT  2166136261U
+#define HASHPRIME 16777619U
+
+static
+uint32_t
+hashblock(uint32_t hash, const uint8_t *data)
+{
+	unsigned i;
+
+	for (i=0; i<SFS_BLOCKSIZE; i++) {
+		hash ^= data[i];
+		hash *= HASHPRIME;
+	}
+	return hash;
+}
+
+/*
+ * Check that JR is a record of type TYPE for transaction SEQ.
+ */
+static
+int
+goodrecord(const struct sfs_jrecord *jr, uint32_t type, uint32_t seq)
+{
+	return jr->jr_magic == SFS_JNL_MAGIC && jr->jr_type == type &&
+		jr->jr_seq == seq && jr->jr_nblocks <= SFS_JNL_MAXBLOCKS;
+}
+
+void
+journal_replay(void)
+{
+	struct sfs_jrecord jr;
+	uint32_t homes[SFS_JNL_MAXBLOCKS];
+	uint8_t buf[SFS_BLOCKSIZE];
+	uint32_t start, seq, n, i, hash;
+
+	if (sb_journalblocks() == 0) {
+		return;
+	}
+	start = sb_journalstart();
+
+	sfs_readjrecord(start, &jr);
+	if (jr.jr_magic != SFS_JNL_MAGIC || jr.jr_type != SFS_JNL_HEADER) {
+		/* The kernel won't mount this; start a fresh journal */
+		warnx("Journal header invalid (fixed)");
+		setbadness(EXIT_RECOV);
+		memset(&jr, 0, sizeof(jr));
+		jr.jr_magic = SFS_JNL_MAGIC;
+		jr.jr_type = SFS_JNL_HEADER;
+		jr.jr_seq = 1;
+		sfs_writejrecord(start, &jr);
+		return;
+	}
+	seq = jr.jr_seq;
+
+	sfs_readjrecord(start + 1, &jr);
+	n = jr.jr_nblocks;
+	if (!goodrecord(&jr, SFS_JNL_DESC, seq) || n == 0) {
+		return;
+	}
+	for (i=0; i<n; i++) {
+		homes[i] = jr.jr_blocks[i];
+		if (homes[i] >= sb_totalblocks() ||
+		    (homes[i] >= start && homes[i] < start+sb_journalblocks())) {
+			warnx("Journal transaction %lu has bad block %lu "
+			      "(dropped)", (unsigned long) seq,
+			      (unsigned long) homes[i]);
+			setbadness(EXIT_RECOV);
+			n = 0;
+			break;
+		}
+	}
+
+	hash = HASHINIT;
+	for (i=0; i<n; i++) {
+		cache_read(buf, start + 2 + i);
+		hash = hashblock(hash, buf);
+	}
+	sfs_readjrecord(start + 2 + n, &jr);
+	if (n > 0 && goodrecord(&jr, SFS_JNL_COMMIT, seq) &&
+	    jr.jr_nblocks == n && jr.jr_sum == hash) {
+		/* Complete; write it home */
+		for (i=0; i<n; i++) {
+			cache_read(buf, start + 2 + i);
+			cache_write(buf, homes[i]);
+		}
+		warnx("Replayed journal transaction %lu (%lu blocks)",
+		      (unsigned long) seq, (unsigned long) n);
+		setbadness(EXIT_RECOV);
+	}
+
+	/* Either way the transaction is finished with */
+	memset(&jr, 0, sizeof(jr));
+	jr.jr_magic = SFS_JNL_MAGIC;
+	jr.jr_type = SFS_JNL_HEADER;
+	jr.jr_seq = seq + 1;
+	sfs_writejrecord(start, &jr);
+}
@@ -35,9 +35,11 @@
 #include "compat.h"
 
 #include "disk.h"
+#include "utils.h"
 #include "sfs.h"
 #include "sb.h"
 #include "freemap.h"
+#include "journal.h"
 #include "inode.h"
 #include "passes.h"
 #include "main.h"
@@ -53,9 +55,11 @@ static int badness=0;
 void
 setbadness(int code)
 {
+	checklock();
 	if (badness < code) {
 		badness = code;
 	}
+	checkunlock();
 }
 
 /*
@@ -78,6 +82,7 @@ main(int argc, char **argv)
 	sfs_setup();
 	sb_load();
 	sb_check();
+	journal_replay();
 	freemap_setup();
 
 	printf("Phase 1 -- check blocks and sizes\n");
@@ -33,6 +33,10 @@
 #include <string.h>
 #include <assert.h>
 #include <err.h>
+#ifdef HOST
+#include <unistd.h>
+#include <pthread.h>
+#endif
 
 #include "compat.h"
 #include <kern/sfs.h>
@@ -49,6 +53,32 @@
 
 static unsigned long count_dirs=0, count_files=0;
 
+#ifdef HOST
+/*
+ * Pass 1 worker threads. The directory tree is walked on the main
+ * thread; as each regular file is found, checking its block tree
+ * (which is where nearly all the I/O is for a full volume) is queued
+ * for a worker. Shared state (the freemap, the badness code) is
+ * protected by checklock(); disk access goes through the block cache,
+ * which has its own lock.
+ */
+#define MAXWORKERS 8
+
+struct filejob {
+	struct filejob *next;
+	uint32_t ino;
+	int changed;
+	struct sfs_dinode sfi;
+};
+
+static pthread_mutex_t joblock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobcv = PTHREAD_COND_INITIALIZER;
+static struct filejob *jobhead, *jobtail;
+static int jobsdone;
+static pthread_t workers[MAXWORKERS];
+static unsigned nworkers;
+#endif
+
 /*
  * State for checking indirect blocks.
  */
@@ -247,13 +277,142 @@ check_inode_blocks(uint32_t ino, struct sfs_dinode *sfi, int isdir)
 	return changed;
 }
 
+/*
+ * Check the block tree of regular file INO, whose inode is SFI, and
+ * write the inode back if it or the block tree check changed it.
+ */
+static
+void
+pass1_file(uint32_t ino, struct sfs_dinode *sfi, int changed)
+{
+	if (check_inode_blocks(ino, sfi, 0)) {
+		changed = 1;
+	}
+
+	if (changed) {
+		sfs_writeinode(ino, sfi);
+	}
+}
+
+#ifdef HOST
+/*
+ * Worker thread: run file jobs until the queue is empty and the
+ * directory walk is finished.
+ */
+static
+void *
+pass1_worker(void *arg)
+{
+	struct filejob *job;
+
+	(void)arg;
+
+	while (1) {
+		pthread_mutex_lock(&joblock);
+		while (jobhead == NULL && !jobsdone) {
+			pthread_cond_wait(&jobcv, &joblock);
+		}
+		job = jobhead;
+		if (job == NULL) {
+			pthread_mutex_unlock(&joblock);
+			return NULL;
+		}
+		jobhead = job->next;
+		if (jobhead == NULL) {
+			jobtail = NULL;
+		}
+		pthread_mutex_unlock(&joblock);
+
+		pass1_file(job->ino, &job->sfi, job->changed);
+		free(job);
+	}
+}
+
+/*
+ * Start the workers. If we can't get any, files get checked inline.
+ */
+static
+void
+pass1_startworkers(void)
+{
+	long ncpus;
+	unsigned n;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	n = ncpus < 1 ? 1 : ncpus > MAXWORKERS ? MAXWORKERS : ncpus;
+
+	for (nworkers = 0; nworkers < n; nworkers++) {
+		if (pthread_create(&workers[nworkers], NULL,
+				   pass1_worker, NULL)) {
+			break;
+		}
+	}
+}
+
+/*
+ * Tell the workers the walk is done and wait for them to drain the
+ * queue.
+ */
+static
+void
+pass1_finishworkers(void)
+{
+	unsigned i;
+
+	pthread_mutex_lock(&joblock);
+	jobsdone = 1;
+	pthread_cond_broadcast(&jobcv);
+	pthread_mutex_unlock(&joblock);
+
+	for (i=0; i<nworkers; i++) {
+		pthread_join(workers[i], NULL);
+	}
+	nworkers = 0;
+}
+#endif
+
+/*
+ * Check regular file INO, handing it to a worker if there are any.
+ */
+static
+void
+pass1_queuefile(uint32_t ino, struct sfs_dinode *sfi, int changed)
+{
+#ifdef HOST
+	struct filejob *job;
+
+	if (nworkers > 0) {
+		job = domalloc(sizeof(*job));
+		job->next = NULL;
+		job->ino = ino;
+		job->changed = changed;
+		job->sfi = *sfi;
+
+		pthread_mutex_lock(&joblock);
+		if (jobtail == NULL) {
+			jobhead = job;
+		}
+		else {
+			jobtail->next = job;
+		}
+		jobtail = job;
+		pthread_cond_signal(&jobcv);
+		pthread_mutex_unlock(&joblock);
+		return;
+	}
+#endif
+	pass1_file(ino, sfi, changed);
+}
+
 /*
  * Do the pass1 inode-level checks on inode INO, which has already
  * been loaded into SFI. Note that sfi_type has already been
  * validated.
  *
- * Returns nonzero if SFI has been modified and needs to be written
- * back.
+ * For directories, returns nonzero if SFI has been modified and
+ * needs to be written back. Regular files are finished off by
+ * pass1_queuefile, possibly on another thread; in that case SFI is
+ * not updated.
  */
 static
 int
@@ -277,6 +436,11 @@ pass1_inode(uint32_t ino, struct sfs_dinode *sfi, int alreadychanged)
 		changed = 1;
 	}
 
+	if (!isdir) {
+		pass1_queuefile(ino, sfi, changed);
+		return 0;
+	}
+
 	if (check_inode_blocks(ino, sfi, isdir)) {
 		changed = 1;
 	}
@@ -480,7 +644,13 @@ pass1_rootdir(void)
 void
 pass1(void)
 {
+#ifdef HOST
+	pass1_startworkers();
+#endif
 	pass1_rootdir();
+#ifdef HOST
+	pass1_finishworkers();
+#endif
 }
 
 unsigned long
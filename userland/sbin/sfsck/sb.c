@@ -83,6 +83,24 @@ sb_check(void)
 		setbadness(EXIT_RECOV);
 		schanged = 1;
 	}
+	if (sb.sb_journalblocks != 0 &&
+	    (sb.sb_journalstart != SFS_FREEMAP_START + sb_freemapblocks() ||
+	     sb.sb_journalblocks < SFS_JNL_MAXBLOCKS + 3 ||
+	     sb.sb_journalblocks > sb.sb_nblocks - sb.sb_journalstart)) {
+		warnx("Bad journal location %lu+%lu (journal dropped)",
+		      (unsigned long) sb.sb_journalstart,
+		      (unsigned long) sb.sb_journalblocks);
+		setbadness(EXIT_RECOV);
+		sb.sb_journalstart = 0;
+		sb.sb_journalblocks = 0;
+		schanged = 1;
+	}
+	if (sb.sb_journalblocks == 0 && sb.sb_journalstart != 0) {
+		warnx("Journal start set without a journal (fixed)");
+		setbadness(EXIT_RECOV);
+		sb.sb_journalstart = 0;
+		schanged = 1;
+	}
 	if (checkzeroed(sb.reserved, sizeof(sb.reserved))) {
 		warnx("Reserved section of superblock not zeroed (fixed)");
 		setbadness(EXIT_RECOV);
@@ -114,6 +132,21 @@ sb_freemapblocks(void)
 	return SFS_FREEMAPBLOCKS(sb.sb_nblocks);
 }
 
+/*
+ * Return the journal location; the size is 0 if there is no journal.
+ */
+uint32_t
+sb_journalstart(void)
+{
+	return sb.sb_journalstart;
+}
+
+uint32_t
+sb_journalblocks(void)
+{
+	return sb.sb_journalblocks;
+}
+
 /*
  * Return the volume name.
  */
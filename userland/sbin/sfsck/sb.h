@@ -46,6 +46,10 @@ uint32_t sb_totalblocks(void);
 /* After the superblock is loaded: return number of freemap blocks. */
 uint32_t sb_freemapblocks(void);
 
+/* After the superblock is loaded: return journal location, if any. */
+uint32_t sb_journalstart(void);
+uint32_t sb_journalblocks(void);
+
 /* After the superblock is loaded: return volume name. */
 const char *sb_volname(void);
 
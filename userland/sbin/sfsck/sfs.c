@@ -36,7 +36,7 @@
 #include "compat.h"
 #include <kern/sfs.h>
 
-#include "disk.h"
+#include "cache.h"
 #include "utils.h"
 #include "ibmacros.h"
 #include "sfs.h"
@@ -51,6 +51,7 @@ sfs_setup(void)
 	assert(sizeof(struct sfs_superblock)==SFS_BLOCKSIZE);
 	assert(sizeof(struct sfs_dinode)==SFS_BLOCKSIZE);
 	assert(SFS_BLOCKSIZE % sizeof(struct sfs_direntry) == 0);
+	assert(sizeof(struct sfs_jrecord)==SFS_BLOCKSIZE);
 }
 
 ////////////////////////////////////////////////////////////
@@ -62,6 +63,8 @@ swapsb(struct sfs_superblock *sb)
 {
 	sb->sb_magic = SWAP32(sb->sb_magic);
 	sb->sb_nblocks = SWAP32(sb->sb_nblocks);
+	sb->sb_journalstart = SWAP32(sb->sb_journalstart);
+	sb->sb_journalblocks = SWAP32(sb->sb_journalblocks);
 }
 
 static
@@ -99,6 +102,22 @@ swapinode(struct sfs_dinode *sfi)
 	}
 }
 
+static
+void
+swapjrecord(struct sfs_jrecord *jr)
+{
+	int i;
+
+	jr->jr_magic = SWAP32(jr->jr_magic);
+	jr->jr_type = SWAP32(jr->jr_type);
+	jr->jr_seq = SWAP32(jr->jr_seq);
+	jr->jr_nblocks = SWAP32(jr->jr_nblocks);
+	jr->jr_sum = SWAP32(jr->jr_sum);
+	for (i=0; i<SFS_JNL_MAXBLOCKS; i++) {
+		jr->jr_blocks[i] = SWAP32(jr->jr_blocks[i]);
+	}
+}
+
 static
 void
 swapdir(struct sfs_direntry *sfd)
@@ -138,7 +157,7 @@ ibmap(uint32_t iblock, uint32_t offset, uint32_t entrysize)
 		return 0;
 	}
 
-	diskread(entries, iblock);
+	cache_read(entries, iblock);
 	swapindir(entries);
 
 	if (entrysize > 1) {
@@ -194,7 +213,7 @@ bmap(const struct sfs_dinode *sfi, uint32_t fileblock)
 void
 sfs_readsb(uint32_t blocknum, struct sfs_superblock *sb)
 {
-	diskread(sb, blocknum);
+	cache_read(sb, blocknum);
 	swapsb(sb);
 }
 
@@ -202,7 +221,7 @@ void
 sfs_writesb(uint32_t blocknum, struct sfs_superblock *sb)
 {
 	swapsb(sb);
-	diskwrite(sb, blocknum);
+	cache_write(sb, blocknum);
 	swapsb(sb);
 }
 
@@ -214,7 +233,7 @@ sfs_writesb(uint32_t blocknum, struct sfs_superblock *sb)
 void
 sfs_readfreemapblock(uint32_t whichblock, uint8_t *bits)
 {
-	diskread(bits, SFS_FREEMAP_START + whichblock);
+	cache_read(bits, SFS_FREEMAP_START + whichblock);
 	swapbits(bits);
 }
 
@@ -222,10 +241,29 @@ void
 sfs_writefreemapblock(uint32_t whichblock, uint8_t *bits)
 {
 	swapbits(bits);
-	diskwrite(bits, SFS_FREEMAP_START + whichblock);
+	cache_write(bits, SFS_FREEMAP_START + whichblock);
 	swapbits(bits);
 }
 
+/*
+ *  journal records - blocknum is a disk block number.
+ */
+
+void
+sfs_readjrecord(uint32_t blocknum, struct sfs_jrecord *jr)
+{
+	cache_read(jr, blocknum);
+	swapjrecord(jr);
+}
+
+void
+sfs_writejrecord(uint32_t blocknum, struct sfs_jrecord *jr)
+{
+	swapjrecord(jr);
+	cache_write(jr, blocknum);
+	swapjrecord(jr);
+}
+
 /*
  *  inodes - ino is an inode number, which is a disk block number.
  */
@@ -233,7 +271,7 @@ sfs_writefreemapblock(uint32_t whichblock, uint8_t *bits)
 void
 sfs_readinode(uint32_t ino, struct sfs_dinode *sfi)
 {
-	diskread(sfi, ino);
+	cache_read(sfi, ino);
 	swapinode(sfi);
 }
 
@@ -241,7 +279,7 @@ void
 sfs_writeinode(uint32_t ino, struct sfs_dinode *sfi)
 {
 	swapinode(sfi);
-	diskwrite(sfi, ino);
+	cache_write(sfi, ino);
 	swapinode(sfi);
 }
 
@@ -252,7 +290,7 @@ sfs_writeinode(uint32_t ino, struct sfs_dinode *sfi)
 void
 sfs_readindirect(uint32_t blocknum, uint32_t *entries)
 {
-	diskread(entries, blocknum);
+	cache_read(entries, blocknum);
 	swapindir(entries);
 }
 
@@ -260,7 +298,7 @@ void
 sfs_writeindirect(uint32_t blocknum, uint32_t *entries)
 {
 	swapindir(entries);
-	diskwrite(entries, blocknum);
+	cache_write(entries, blocknum);
 	swapindir(entries);
 }
 
@@ -278,7 +316,7 @@ sfs_readdirblock(struct sfs_direntry *d, uint32_t diskblock)
 	unsigned j;
 
 	if (diskblock != 0) {
-		diskread(d, diskblock);
+		cache_read(d, diskblock);
 		for (j=0; j<atonce; j++) {
 			swapdir(&d[j]);
 		}
@@ -337,7 +375,7 @@ sfs_writedirblock(struct sfs_direntry *d, uint32_t diskblock)
 		for (j=0; j<atonce; j++) {
 			swapdir(&d[j]);
 		}
-		diskwrite(d, diskblock);
+		cache_write(d, diskblock);
 	}
 	else {
 		for (j=bad=0; j<atonce; j++) {
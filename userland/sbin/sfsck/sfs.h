@@ -41,6 +41,7 @@
 struct sfs_superblock;
 struct sfs_dinode;
 struct sfs_direntry;
+struct sfs_jrecord;
 
 /* Call this before anything else in this module */
 void sfs_setup(void);
@@ -57,6 +58,10 @@ void sfs_writesb(uint32_t blocknum, struct sfs_superblock *sb);
 void sfs_readfreemapblock(uint32_t whichblock, uint8_t *bits);
 void sfs_writefreemapblock(uint32_t whichblock, uint8_t *bits);
 
+/* journal header, descriptor, or commit record */
+void sfs_readjrecord(uint32_t blocknum, struct sfs_jrecord *jr);
+void sfs_writejrecord(uint32_t blocknum, struct sfs_jrecord *jr);
+
 /* inode */
 void sfs_readinode(uint32_t inum, struct sfs_dinode *sfi);
 void sfs_writeinode(uint32_t inum, struct sfs_dinode *sfi);
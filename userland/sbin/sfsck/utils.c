@@ -31,6 +31,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <err.h>
+#ifdef HOST
+#include <pthread.h>
+#endif
 
 #include "compat.h"
 #include "utils.h"
@@ -77,6 +80,43 @@ dorealloc(void *op, size_t osz, size_t nsz)
 	return np;
 }
 
+#ifdef HOST
+static pthread_mutex_t checkmutex;
+static pthread_once_t checkonce = PTHREAD_ONCE_INIT;
+
+static
+void
+checklock_init(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&checkmutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+#endif
+
+/*
+ * Lock and unlock the shared checker state.
+ */
+void
+checklock(void)
+{
+#ifdef HOST
+	pthread_once(&checkonce, checklock_init);
+	pthread_mutex_lock(&checkmutex);
+#endif
+}
+
+void
+checkunlock(void)
+{
+#ifdef HOST
+	pthread_mutex_unlock(&checkmutex);
+#endif
+}
+
 /*
  * Get a unique id number. (unique as in for this run of sfsck...)
  */
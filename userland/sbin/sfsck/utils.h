@@ -37,6 +37,14 @@
 void *domalloc(size_t len);
 void *dorealloc(void *op, size_t osz, size_t nsz);
 
+/*
+ * Lock for state shared by pass 1 worker threads (the freemap and
+ * the badness code). Recursive; does nothing unless built for the
+ * host, where pass 1 uses threads.
+ */
+void checklock(void);
+void checkunlock(void);
+
 /* return a fresh id number */
 uint32_t uniqueid(void);
 
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futextest - test futex_wait and futex_wake.
+ *
+ * Checks that futex_wait refuses to sleep when the word has changed,
+ * that its timeout expires, that futex_wake with nobody waiting wakes
+ * nobody, that bad arguments are rejected, and that a wake from a
+ * different process (a different address space, so a different
+ * futex even at the same address) doesn't wake us.
+ *
+ * (The last part also depends on fork and waitpid working.)
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <err.h>
+
+/* how long to wait in the timeout tests, in milliseconds */
+#define TIMEOUT_MS 300
+
+static volatile int word;
+
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status)) {
+		errx(1, "pid %d: Signal %d", (int)pid, WTERMSIG(status));
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: Exit %d", (int)pid, WEXITSTATUS(status));
+	}
+}
+
+static
+long
+elapsed_ms(time_t s1, unsigned long ns1, time_t s2, unsigned long ns2)
+{
+	return (long)(s2 - s1) * 1000 + ((long)ns2 - (long)ns1) / 1000000;
+}
+
+/*
+ * Check that a call failed with the expected error.
+ */
+static
+void
+checkfail(const char *what, int r, int want)
+{
+	if (r >= 0) {
+		errx(1, "%s succeeded", what);
+	}
+	if (errno != want) {
+		err(1, "%s: expected error %d, got", what, want);
+	}
+}
+
+/*
+ * futex_wait on WORD with the timeout, and check that it times out
+ * after about that long.
+ */
+static
+void
+timedwait(const char *what)
+{
+	struct timespec ts;
+	time_t s1, s2;
+	unsigned long ns1, ns2;
+	long ms;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = TIMEOUT_MS * 1000000L;
+
+	__time(&s1, &ns1);
+	checkfail(what, futex_wait(&word, word, &ts), ETIMEDOUT);
+	__time(&s2, &ns2);
+
+	ms = elapsed_ms(s1, ns1, s2, ns2);
+	if (ms < TIMEOUT_MS) {
+		errx(1, "%s: Timeout of %d ms took only %ld ms",
+		     what, TIMEOUT_MS, ms);
+	}
+	if (ms > 10 * TIMEOUT_MS) {
+		errx(1, "%s: Timeout of %d ms took %ld ms",
+		     what, TIMEOUT_MS, ms);
+	}
+}
+
+static
+void
+basictest(void)
+{
+	struct timespec ts;
+	int r;
+
+	printf("Checking futex_wait and futex_wake...\n");
+
+	word = 1;
+	checkfail("futex_wait with a changed value",
+		  futex_wait(&word, 0, NULL), EAGAIN);
+	timedwait("futex_wait with a timeout");
+
+	r = futex_wake(&word, 1);
+	if (r != 0) {
+		errx(1, "futex_wake with nobody waiting woke %d", r);
+	}
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 1000000000;
+	checkfail("futex_wait with a bad timeout",
+		  futex_wait(&word, 1, &ts), EINVAL);
+	checkfail("futex_wait on an unaligned address",
+		  futex_wait((volatile int *)((char *)&word + 1), 0, NULL),
+		  EINVAL);
+	checkfail("futex_wait on a NULL address",
+		  futex_wait(NULL, 0, NULL), EFAULT);
+	checkfail("futex_wake with a negative count",
+		  futex_wake(&word, -1), EINVAL);
+}
+
+/*
+ * A child process has its own copy of WORD, so its futex_wake must
+ * not reach us.
+ */
+static
+void
+forktest(void)
+{
+	time_t s1, s2;
+	unsigned long ns1, ns2;
+	pid_t pid;
+	int r;
+
+	printf("Checking that other processes can't wake us...\n");
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		__time(&s1, &ns1);
+		do {
+			r = futex_wake(&word, 1);
+			if (r < 0) {
+				err(1, "futex_wake");
+			}
+			if (r > 0) {
+				errx(1, "futex_wake woke a sleeper "
+				     "in another process");
+			}
+			__time(&s2, &ns2);
+		} while (elapsed_ms(s1, ns1, s2, ns2) < 2 * TIMEOUT_MS);
+		_exit(0);
+	}
+	timedwait("futex_wait with another process waking");
+	dowait(pid);
+}
+
+int
+main(void)
+{
+	basictest();
+	forktest();
+	printf("Passed.\n");
+	return 0;
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * iovtest - test readv, writev, pread, and pwrite.
+ *
+ * Checks that writev gathers and readv scatters across iovec
+ * boundaries, including zero-length iovecs; that pread and pwrite
+ * use the position given and leave the seek position alone; that
+ * pread past EOF returns 0; and that a bad iovec count is rejected
+ * with EINVAL.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+#define FILENAME "iovtest.tmp"
+
+static const char data[] = "abcdefghijklmnopqrstuvwxyz";
+#define DATALEN (sizeof(data) - 1)
+
+/*
+ * Check the seek position.
+ */
+static
+void
+checkpos(int fd, off_t want)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos < 0) {
+		err(1, "lseek");
+	}
+	if (pos != want) {
+		errx(1, "Seek position is %lld, expected %lld",
+		     (long long)pos, (long long)want);
+	}
+}
+
+/*
+ * Write DATA with writev in uneven pieces, one of them empty, then
+ * read it back with readv into pieces that split it differently,
+ * the last one bigger than what's left.
+ */
+static
+void
+vectortest(int fd)
+{
+	struct iovec iov[5];
+	char a[4], b[1], c[9], d[32];
+	ssize_t r;
+
+	printf("Checking readv and writev...\n");
+
+	iov[0].iov_base = (void *)data;
+	iov[0].iov_len = 3;
+	iov[1].iov_base = (void *)(data + 3);
+	iov[1].iov_len = 0;
+	iov[2].iov_base = (void *)(data + 3);
+	iov[2].iov_len = 10;
+	iov[3].iov_base = (void *)(data + 13);
+	iov[3].iov_len = 1;
+	iov[4].iov_base = (void *)(data + 14);
+	iov[4].iov_len = DATALEN - 14;
+	r = writev(fd, iov, 5);
+	if (r < 0) {
+		err(1, "writev");
+	}
+	if ((size_t)r != DATALEN) {
+		errx(1, "writev: wrote %zd bytes, expected %zu", r, DATALEN);
+	}
+	checkpos(fd, DATALEN);
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	memset(d, 0, sizeof(d));
+	iov[0].iov_base = a;
+	iov[0].iov_len = sizeof(a);
+	iov[1].iov_base = b;
+	iov[1].iov_len = 0;
+	iov[2].iov_base = b;
+	iov[2].iov_len = sizeof(b);
+	iov[3].iov_base = c;
+	iov[3].iov_len = sizeof(c);
+	iov[4].iov_base = d;
+	iov[4].iov_len = sizeof(d);
+	r = readv(fd, iov, 5);
+	if (r < 0) {
+		err(1, "readv");
+	}
+	if ((size_t)r != DATALEN) {
+		errx(1, "readv: read %zd bytes, expected %zu", r, DATALEN);
+	}
+	if (memcmp(a, data, 4) != 0 || memcmp(b, data + 4, 1) != 0 ||
+	    memcmp(c, data + 5, 9) != 0 ||
+	    memcmp(d, data + 14, DATALEN - 14) != 0) {
+		errx(1, "readv: wrong data");
+	}
+	checkpos(fd, DATALEN);
+
+	/* at EOF, readv returns 0 */
+	r = readv(fd, iov, 5);
+	if (r != 0) {
+		errx(1, "readv at EOF returned %zd", r);
+	}
+}
+
+/*
+ * pread and pwrite at assorted positions, including past EOF.
+ */
+static
+void
+positiontest(int fd)
+{
+	char buf[DATALEN];
+	ssize_t r;
+
+	printf("Checking pread and pwrite...\n");
+
+	if (lseek(fd, 5, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+
+	r = pwrite(fd, "XYZ", 3, 10);
+	if (r != 3) {
+		err(1, "pwrite");
+	}
+	checkpos(fd, 5);
+
+	r = pread(fd, buf, 8, 8);
+	if (r != 8) {
+		err(1, "pread");
+	}
+	if (memcmp(buf, "ijXYZnop", 8) != 0) {
+		errx(1, "pread: wrong data");
+	}
+	checkpos(fd, 5);
+
+	/* reading across EOF is short; reading at or past it gives 0 */
+	r = pread(fd, buf, sizeof(buf), DATALEN - 2);
+	if (r != 2) {
+		errx(1, "pread across EOF returned %zd, expected 2", r);
+	}
+	r = pread(fd, buf, sizeof(buf), DATALEN);
+	if (r != 0) {
+		errx(1, "pread at EOF returned %zd", r);
+	}
+	r = pread(fd, buf, sizeof(buf), DATALEN + 1000);
+	if (r != 0) {
+		errx(1, "pread past EOF returned %zd", r);
+	}
+
+	r = pread(fd, buf, 1, -1);
+	if (r >= 0) {
+		errx(1, "pread at negative position succeeded");
+	}
+	if (errno != EINVAL) {
+		err(1, "pread at negative position: expected EINVAL, got");
+	}
+	checkpos(fd, 5);
+}
+
+/*
+ * An iovec count that's not positive or is over IOV_MAX is EINVAL.
+ */
+static
+void
+iovcnttest(int fd)
+{
+	static const int badcounts[] = { 0, -1, IOV_MAX + 1 };
+	struct iovec iov;
+	char buf[1];
+	unsigned i;
+	ssize_t r;
+
+	printf("Checking bad iovec counts...\n");
+
+	iov.iov_base = buf;
+	iov.iov_len = sizeof(buf);
+	for (i=0; i<sizeof(badcounts)/sizeof(badcounts[0]); i++) {
+		r = readv(fd, &iov, badcounts[i]);
+		if (r >= 0) {
+			errx(1, "readv with iovcnt %d succeeded",
+			     badcounts[i]);
+		}
+		if (errno != EINVAL) {
+			err(1, "readv with iovcnt %d: expected EINVAL, got",
+			    badcounts[i]);
+		}
+		r = writev(fd, &iov, badcounts[i]);
+		if (r >= 0) {
+			errx(1, "writev with iovcnt %d succeeded",
+			     badcounts[i]);
+		}
+		if (errno != EINVAL) {
+			err(1, "writev with iovcnt %d: expected EINVAL, got",
+			    badcounts[i]);
+		}
+	}
+}
+
+int
+main(void)
+{
+	int fd;
+
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	vectortest(fd);
+	positiontest(fd);
+	iovcnttest(fd);
+
+	close(fd);
+	if (remove(FILENAME) < 0) {
+		err(1, "remove %s", FILENAME);
+	}
+	printf("Passed.\n");
+	return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipetest - test pipes.
+ *
+ * Checks that data sent through a pipe comes out intact and in order,
+ * that readers see EOF once the write end is closed, that writing
+ * with the read end closed fails with EPIPE, and that writes of
+ * PIPE_BUF bytes from several processes aren't interleaved.
+ *
+ * (This test also depends on fork and waitpid working properly.)
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+/* enough to wrap around the pipe buffer several times */
+#define TOTAL (64*1024)
+
+/* number of writers, and records each, for the atomicity test */
+#define NWRITERS 4
+#define NRECORDS 16
+
+static char buf[8192];
+
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status)) {
+		errx(1, "pid %d: Signal %d", (int)pid, WTERMSIG(status));
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: Exit %d", (int)pid, WEXITSTATUS(status));
+	}
+}
+
+/*
+ * Send TOTAL bytes of a known pattern through a pipe from a child,
+ * in writes of assorted sizes, and check it at the other end.
+ */
+static
+void
+datatest(void)
+{
+	int fds[2];
+	pid_t pid;
+	size_t pos, len, i;
+	ssize_t r;
+
+	printf("Checking data transfer...\n");
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		pos = 0;
+		len = 1;
+		while (pos < TOTAL) {
+			if (len > TOTAL - pos) {
+				len = TOTAL - pos;
+			}
+			for (i=0; i<len; i++) {
+				buf[i] = (pos + i) % 251;
+			}
+			r = write(fds[1], buf, len);
+			if (r < 0) {
+				err(1, "write");
+			}
+			pos += r;
+			/* cycle through assorted sizes */
+			len = (len * 7 + 13) % sizeof(buf) + 1;
+		}
+		close(fds[1]);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	pos = 0;
+	while (1) {
+		r = read(fds[0], buf, sizeof(buf));
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+		for (i=0; i<(size_t)r; i++) {
+			if (buf[i] != (char)((pos + i) % 251)) {
+				errx(1, "Wrong data at offset %zu", pos + i);
+			}
+		}
+		pos += r;
+	}
+	if (pos != TOTAL) {
+		errx(1, "Got %zu bytes, expected %d", pos, TOTAL);
+	}
+	close(fds[0]);
+	dowait(pid);
+}
+
+/*
+ * Writing to a pipe with no readers should fail with EPIPE.
+ */
+static
+void
+epipetest(void)
+{
+	int fds[2];
+	ssize_t r;
+
+	printf("Checking EPIPE...\n");
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	r = write(fds[1], "x", 1);
+	if (r >= 0) {
+		errx(1, "Write with no reader succeeded");
+	}
+	if (errno != EPIPE) {
+		err(1, "Write with no reader: expected EPIPE, got");
+	}
+	close(fds[1]);
+}
+
+/*
+ * Have several processes write PIPE_BUF-sized records at once, each
+ * record filled with the writer's number, and make sure each record
+ * comes out in one piece.
+ */
+static
+void
+atomictest(void)
+{
+	pid_t pids[NWRITERS];
+	int fds[2];
+	unsigned i, j, k;
+	size_t have;
+	ssize_t r;
+
+	printf("Checking atomicity of PIPE_BUF writes...\n");
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	for (i=0; i<NWRITERS; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			close(fds[0]);
+			memset(buf, 'a' + i, PIPE_BUF);
+			for (j=0; j<NRECORDS; j++) {
+				r = write(fds[1], buf, PIPE_BUF);
+				if (r != PIPE_BUF) {
+					err(1, "writer %u: write", i);
+				}
+			}
+			_exit(0);
+		}
+	}
+	close(fds[1]);
+
+	for (k=0; k<NWRITERS * NRECORDS; k++) {
+		have = 0;
+		while (have < PIPE_BUF) {
+			r = read(fds[0], buf + have, PIPE_BUF - have);
+			if (r < 0) {
+				err(1, "read");
+			}
+			if (r == 0) {
+				errx(1, "Unexpected EOF");
+			}
+			have += r;
+		}
+		for (j=1; j<PIPE_BUF; j++) {
+			if (buf[j] != buf[0]) {
+				errx(1, "Record %u is interleaved", k);
+			}
+		}
+	}
+	if (read(fds[0], buf, 1) != 0) {
+		errx(1, "Expected EOF");
+	}
+	close(fds[0]);
+
+	for (i=0; i<NWRITERS; i++) {
+		dowait(pids[i]);
+	}
+}
+
+int
+main(void)
+{
+	datatest();
+	epipetest();
+	atomictest();
+	printf("Passed.\n");
+	return 0;
+}
@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * polltest - test poll and select.
+ *
+ * Checks that poll and select report pipes and semfs semaphores as
+ * ready exactly when they should be, that a poller waiting on a pipe
+ * wakes up when another process writes to it, that timeouts expire,
+ * and that closed file handles are reported.
+ *
+ * (This test also depends on pipe, fork, and waitpid working, and on
+ * semfs being mounted as sem:.)
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/select.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <err.h>
+
+/* how long to wait in the timeout test, in milliseconds */
+#define TIMEOUT_MS 300
+
+static
+void
+dowait(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (WIFSIGNALED(status)) {
+		errx(1, "pid %d: Signal %d", (int)pid, WTERMSIG(status));
+	}
+	if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: Exit %d", (int)pid, WEXITSTATUS(status));
+	}
+}
+
+/*
+ * Poll one file handle for EVENTS with the given timeout, and check
+ * that the result is WANT.
+ */
+static
+void
+checkpoll(const char *what, int fd, int events, int timeout, int want)
+{
+	struct pollfd pfd;
+	int r;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	r = poll(&pfd, 1, timeout);
+	if (r < 0) {
+		err(1, "%s: poll", what);
+	}
+	if (pfd.revents != want) {
+		errx(1, "%s: revents 0x%x, expected 0x%x", what,
+		     pfd.revents, want);
+	}
+	if (r != (want != 0)) {
+		errx(1, "%s: poll returned %d", what, r);
+	}
+}
+
+/*
+ * Check the readiness reported for each state of a pipe.
+ */
+static
+void
+pipetest(void)
+{
+	int fds[2];
+	char ch;
+
+	printf("Checking pipe readiness...\n");
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	checkpoll("empty pipe", fds[0], POLLIN, 0, 0);
+	checkpoll("empty pipe", fds[1], POLLOUT, 0, POLLOUT);
+
+	if (write(fds[1], "x", 1) != 1) {
+		err(1, "write");
+	}
+	checkpoll("nonempty pipe", fds[0], POLLIN, 0, POLLIN);
+	if (read(fds[0], &ch, 1) != 1) {
+		err(1, "read");
+	}
+	checkpoll("drained pipe", fds[0], POLLIN, 0, 0);
+
+	close(fds[1]);
+	checkpoll("widowed pipe", fds[0], POLLIN, 0, POLLIN | POLLHUP);
+	close(fds[0]);
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	checkpoll("orphaned pipe", fds[1], POLLOUT, 0, POLLOUT | POLLERR);
+	close(fds[1]);
+
+	checkpoll("closed fd", fds[1], POLLOUT, 0, POLLNVAL);
+}
+
+/*
+ * Have a child write to a pipe while we're waiting in poll with no
+ * timeout; we should wake up.
+ */
+static
+void
+wakeuptest(void)
+{
+	int fds[2], i;
+	volatile int spin;
+	pid_t pid;
+	char ch;
+
+	printf("Checking wakeup...\n");
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		/* give the parent time to go to sleep */
+		for (i=0, spin=0; i<500000; i++) {
+			spin += i;
+		}
+		if (write(fds[1], "x", 1) != 1) {
+			err(1, "write");
+		}
+		close(fds[1]);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	checkpoll("waiting for child", fds[0], POLLIN, -1, POLLIN);
+	if (read(fds[0], &ch, 1) != 1 || ch != 'x') {
+		errx(1, "Wrong data from child");
+	}
+	close(fds[0]);
+	dowait(pid);
+}
+
+/*
+ * Poll an empty pipe with a timeout and make sure the timeout is
+ * honored, at least roughly.
+ */
+static
+void
+timeouttest(void)
+{
+	time_t s1, s2;
+	unsigned long ns1, ns2;
+	int fds[2];
+	long ms;
+
+	printf("Checking timeout...\n");
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	__time(&s1, &ns1);
+	checkpoll("timeout", fds[0], POLLIN, TIMEOUT_MS, 0);
+	__time(&s2, &ns2);
+	close(fds[0]);
+	close(fds[1]);
+
+	ms = (long)(s2 - s1) * 1000 + ((long)ns2 - (long)ns1) / 1000000;
+	if (ms < TIMEOUT_MS) {
+		errx(1, "Timeout of %d ms took only %ld ms", TIMEOUT_MS, ms);
+	}
+	if (ms > 10 * TIMEOUT_MS) {
+		errx(1, "Timeout of %d ms took %ld ms", TIMEOUT_MS, ms);
+	}
+}
+
+/*
+ * A semaphore is readable (P won't block) exactly when its count is
+ * nonzero.
+ */
+static
+void
+semtest(void)
+{
+	int fd;
+	char ch;
+
+	printf("Checking semaphore readiness...\n");
+
+	fd = open("sem:polltest", O_RDWR | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "sem:polltest");
+	}
+	checkpoll("zero semaphore", fd, POLLIN | POLLOUT, 0, POLLOUT);
+	if (write(fd, "x", 1) != 1) {
+		err(1, "sem:polltest: V");
+	}
+	checkpoll("semaphore", fd, POLLIN | POLLOUT, 0, POLLIN | POLLOUT);
+	if (read(fd, &ch, 1) != 1) {
+		err(1, "sem:polltest: P");
+	}
+	checkpoll("zero semaphore", fd, POLLIN, 0, 0);
+	close(fd);
+	remove("sem:polltest");
+}
+
+/*
+ * select on a pair of pipes, one with data in it.
+ */
+static
+void
+selecttest(void)
+{
+	int a[2], b[2], nfds, r;
+	fd_set rfds, wfds;
+	struct timeval tv;
+
+	printf("Checking select...\n");
+
+	if (pipe(a) < 0 || pipe(b) < 0) {
+		err(1, "pipe");
+	}
+	if (write(b[1], "x", 1) != 1) {
+		err(1, "write");
+	}
+
+	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
+	FD_SET(a[0], &rfds);
+	FD_SET(b[0], &rfds);
+	FD_SET(a[1], &wfds);
+	nfds = a[0];
+	if (b[0] > nfds) {
+		nfds = b[0];
+	}
+	if (a[1] > nfds) {
+		nfds = a[1];
+	}
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+
+	r = select(nfds + 1, &rfds, &wfds, NULL, &tv);
+	if (r < 0) {
+		err(1, "select");
+	}
+	if (r != 2 || FD_ISSET(a[0], &rfds) || !FD_ISSET(b[0], &rfds) ||
+	    !FD_ISSET(a[1], &wfds)) {
+		errx(1, "select reported the wrong file handles");
+	}
+
+	close(a[0]);
+	close(a[1]);
+	close(b[0]);
+	close(b[1]);
+
+	FD_ZERO(&rfds);
+	FD_SET(a[0], &rfds);
+	r = select(a[0] + 1, &rfds, NULL, NULL, &tv);
+	if (r >= 0) {
+		errx(1, "select on a closed file handle succeeded");
+	}
+	if (errno != EBADF) {
+		err(1, "select on a closed file handle: expected EBADF, got");
+	}
+}
+
+int
+main(void)
+{
+	pipetest();
+	wakeuptest();
+	timeouttest();
+	semtest();
+	selecttest();
+	printf("Passed.\n");
+	return 0;
+}
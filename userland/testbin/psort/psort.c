@@ -56,7 +56,7 @@
 #define PATH_KEYS    "sortkeys"
 #define PATH_SORTED  "output"
 #define PATH_TESTDIR "psortdir"
-#define PATH_RANDOM  "rand:"
+#define PATH_RANDOM  "random:"
 
 /*
  * Workload sizing.
@@ -40,10 +40,13 @@
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <err.h>
+#include <errno.h>
 
 #define ONCELOOPS   3
 #define TWICELOOPS  2
@@ -51,6 +54,11 @@
 #define LOOPS (ONCELOOPS + 2*TWICELOOPS + 3*THRICELOOPS)
 #define NUMJOBS 4
 
+/* for the batch test; a multiple of both batch sizes */
+#define BATCHITEMS 700
+#define PBATCH 5
+#define VBATCH 7
+
 /*
  * Print to the console, one character at a time to encourage
  * interleaving if the semaphores aren't working.
@@ -189,6 +197,70 @@ V(struct usem *sem)
 	}
 }
 
+/*
+ * P and V by more than one at once, with the semfs ioctls.
+ */
+static
+void
+Pn(struct usem *sem, unsigned count)
+{
+	if (ioctl(sem->fd, SEMIOC_P, &count) < 0) {
+		err(1, "%s: ioctl SEMIOC_P", sem->name);
+	}
+}
+
+static
+void
+Vn(struct usem *sem, unsigned count)
+{
+	if (ioctl(sem->fd, SEMIOC_V, &count) < 0) {
+		err(1, "%s: ioctl SEMIOC_V", sem->name);
+	}
+}
+
+/*
+ * Check the count, which fstat reports as the size.
+ */
+static
+void
+checkcount(struct usem *sem, unsigned want)
+{
+	struct stat st;
+
+	if (fstat(sem->fd, &st) < 0) {
+		err(1, "%s: fstat", sem->name);
+	}
+	if (st.st_size != (off_t)want) {
+		errx(1, "%s: count is %lld, expected %u", sem->name,
+		     (long long)st.st_size, want);
+	}
+}
+
+/*
+ * Check that an ioctl fails with EBADF on a handle opened without
+ * the access it needs.
+ */
+static
+void
+accesscheck(struct usem *sem, int accmode, int op, const char *opname)
+{
+	unsigned count = 1;
+	int fd;
+
+	fd = open(sem->name, accmode);
+	if (fd < 0) {
+		err(1, "%s: open", sem->name);
+	}
+	if (ioctl(fd, op, &count) == 0) {
+		errx(1, "%s: ioctl %s succeeded on wrong access mode",
+		     sem->name, opname);
+	}
+	if (errno != EBADF) {
+		err(1, "%s: ioctl %s: expected EBADF", sem->name, opname);
+	}
+	close(fd);
+}
+
 ////////////////////////////////////////////////////////////
 // test components
 
@@ -376,6 +448,63 @@ conctest(void)
 	}
 }
 
+/*
+ * The ioctls and read/write must agree about the count, and batches
+ * of different sizes must add up.
+ */
+static
+void
+batchtest(void)
+{
+	struct usem sem;
+	char buf[5];
+	unsigned i;
+	pid_t pid;
+
+	say("Batches...\n");
+
+	usem_init(&sem, "b", 0);
+	usem_open(&sem);
+
+	Vn(&sem, 5);
+	checkcount(&sem, 5);
+	if (read(sem.fd, buf, 5) != 5) {
+		err(1, "%s: read", sem.name);
+	}
+	checkcount(&sem, 0);
+	if (write(sem.fd, buf, 3) != 3) {
+		err(1, "%s: write", sem.name);
+	}
+	Pn(&sem, 3);
+	checkcount(&sem, 0);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		for (i=0; i<BATCHITEMS; i += VBATCH) {
+			Vn(&sem, VBATCH);
+		}
+		_exit(0);
+	}
+	for (i=0; i<BATCHITEMS; i += PBATCH) {
+		Pn(&sem, PBATCH);
+	}
+	dowait(pid, 0);
+	checkcount(&sem, 0);
+
+	/* The ioctls need the same access as read and write. */
+	Vn(&sem, 1);
+	accesscheck(&sem, O_RDONLY, SEMIOC_V, "SEMIOC_V");
+	accesscheck(&sem, O_WRONLY, SEMIOC_P, "SEMIOC_P");
+	checkcount(&sem, 1);
+	Pn(&sem, 1);
+
+	usem_close(&sem);
+	usem_cleanup(&sem);
+}
+
 ////////////////////////////////////////////////////////////
 // concurrent use test
 
@@ -384,6 +513,7 @@ main(void)
 {
 	basetest();
 	conctest();
+	batchtest();
 	say("Passed.\n");
 	return 0;
 }